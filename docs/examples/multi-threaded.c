@@ -0,0 +1,249 @@
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 1998 - 2015, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at http://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+/* Use all cores with the multi interface: one multi handle per worker
+ * thread, a shared queue of transfers that idle workers pull more work
+ * from, a share object so that the workers use one DNS cache and re-use
+ * each other's connections, and a single queue of completed transfers read
+ * by the main thread.
+ *
+ * A multi handle and its easy handles must only ever be used by one thread
+ * at a time, since all callbacks are called from the thread that drives
+ * it. Spreading the load is therefore done by handing out transfers that
+ * have not started yet, not by moving running ones between threads.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <curl/curl.h>
+
+#define NUM_WORKERS 4 /* worker threads, each with its own multi handle */
+#define MAX_PER_WORKER 10 /* most transfers one worker runs at once */
+
+struct done {
+  struct done *next;
+  char *url;
+  CURLcode result;
+  long response;
+};
+
+/* the state shared by all threads */
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;
+static char **todo;           /* URLs not handed out to any worker yet */
+static int todo_num;
+static int todo_next;
+static struct done *done_head; /* completed transfers, for the main thread */
+static struct done *done_tail;
+static int workers_left;
+
+/* one lock per kind of data the share object may ask to lock */
+static pthread_mutex_t share_lock[CURL_LOCK_DATA_LAST];
+static CURLSH *share;
+
+static void lock_cb(CURL *handle, curl_lock_data data,
+                    curl_lock_access access, void *userptr)
+{
+  (void)handle;
+  (void)access;
+  (void)userptr;
+  pthread_mutex_lock(&share_lock[data]);
+}
+
+static void unlock_cb(CURL *handle, curl_lock_data data, void *userptr)
+{
+  (void)handle;
+  (void)userptr;
+  pthread_mutex_unlock(&share_lock[data]);
+}
+
+static size_t write_cb(char *ptr, size_t size, size_t nmemb, void *userp)
+{
+  (void)ptr;
+  (void)userp;
+  return size * nmemb; /* throw away the body */
+}
+
+/* hand out the next URL to a worker that has room for more, or NULL */
+static char *take_url(void)
+{
+  char *url = NULL;
+
+  pthread_mutex_lock(&queue_lock);
+  if(todo_next < todo_num)
+    url = todo[todo_next++];
+  pthread_mutex_unlock(&queue_lock);
+  return url;
+}
+
+/* pass a finished transfer on to the main thread */
+static void post_done(CURL *easy, CURLcode result)
+{
+  struct done *d = malloc(sizeof(*d));
+  char *url;
+
+  if(!d)
+    return;
+
+  curl_easy_getinfo(easy, CURLINFO_PRIVATE, &url);
+  d->next = NULL;
+  d->url = url;
+  d->result = result;
+  d->response = 0;
+  curl_easy_getinfo(easy, CURLINFO_RESPONSE_CODE, &d->response);
+
+  pthread_mutex_lock(&queue_lock);
+  if(done_tail)
+    done_tail->next = d;
+  else
+    done_head = d;
+  done_tail = d;
+  pthread_cond_signal(&done_cond);
+  pthread_mutex_unlock(&queue_lock);
+}
+
+static void *worker(void *arg)
+{
+  CURLM *multi = curl_multi_init();
+  int active = 0;
+  int more = 1;
+
+  (void)arg;
+
+  while(more || active) {
+    int still_running;
+    int msgs_left;
+    CURLMsg *msg;
+
+    /* a worker with room for more transfers pulls them from the shared
+       queue, so workers that finish early take over the remaining work */
+    while(more && (active < MAX_PER_WORKER)) {
+      char *url = take_url();
+      CURL *easy;
+
+      if(!url) {
+        more = 0;
+        break;
+      }
+      easy = curl_easy_init();
+      curl_easy_setopt(easy, CURLOPT_URL, url);
+      curl_easy_setopt(easy, CURLOPT_PRIVATE, url);
+      curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, write_cb);
+      curl_easy_setopt(easy, CURLOPT_SHARE, share);
+      curl_multi_add_handle(multi, easy);
+      active++;
+    }
+
+    curl_multi_perform(multi, &still_running);
+
+    while((msg = curl_multi_info_read(multi, &msgs_left))) {
+      if(msg->msg == CURLMSG_DONE) {
+        CURL *easy = msg->easy_handle;
+        post_done(easy, msg->data.result);
+        curl_multi_remove_handle(multi, easy);
+        curl_easy_cleanup(easy);
+        active--;
+      }
+    }
+
+    if(active)
+      curl_multi_wait(multi, NULL, 0, 1000, NULL);
+  }
+
+  curl_multi_cleanup(multi);
+
+  pthread_mutex_lock(&queue_lock);
+  workers_left--;
+  pthread_cond_signal(&done_cond);
+  pthread_mutex_unlock(&queue_lock);
+  return NULL;
+}
+
+int main(int argc, char **argv)
+{
+  pthread_t tid[NUM_WORKERS];
+  int i;
+
+  if(argc < 2) {
+    fprintf(stderr, "usage: %s URL [URL...]\n", argv[0]);
+    return 1;
+  }
+
+  todo = &argv[1];
+  todo_num = argc - 1;
+
+  /* Must initialize libcurl before any threads are started */
+  curl_global_init(CURL_GLOBAL_ALL);
+
+  for(i = 0; i < CURL_LOCK_DATA_LAST; i++)
+    pthread_mutex_init(&share_lock[i], NULL);
+
+  share = curl_share_init();
+  curl_share_setopt(share, CURLSHOPT_LOCKFUNC, lock_cb);
+  curl_share_setopt(share, CURLSHOPT_UNLOCKFUNC, unlock_cb);
+  curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+  curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+  curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+
+  workers_left = NUM_WORKERS;
+  for(i = 0; i < NUM_WORKERS; i++) {
+    if(pthread_create(&tid[i], NULL, worker, NULL)) {
+      fprintf(stderr, "Couldn't start worker %d\n", i);
+      return 1;
+    }
+  }
+
+  /* all completions come out of one queue, no matter which worker did the
+     transfer */
+  pthread_mutex_lock(&queue_lock);
+  while(workers_left || done_head) {
+    struct done *d = done_head;
+    if(!d) {
+      pthread_cond_wait(&done_cond, &queue_lock);
+      continue;
+    }
+    done_head = d->next;
+    if(!done_head)
+      done_tail = NULL;
+    pthread_mutex_unlock(&queue_lock);
+
+    if(d->result)
+      printf("%s: %s\n", d->url, curl_easy_strerror(d->result));
+    else
+      printf("%s: %ld\n", d->url, d->response);
+    free(d);
+
+    pthread_mutex_lock(&queue_lock);
+  }
+  pthread_mutex_unlock(&queue_lock);
+
+  for(i = 0; i < NUM_WORKERS; i++)
+    pthread_join(tid[i], NULL);
+
+  curl_share_cleanup(share);
+  for(i = 0; i < CURL_LOCK_DATA_LAST; i++)
+    pthread_mutex_destroy(&share_lock[i]);
+
+  curl_global_cleanup();
+  return 0;
+}
@@ -1622,6 +1622,30 @@ typedef enum {
   /* Path to Unix domain socket */
   CINIT(UNIX_SOCKET_PATH, OBJECTPOINT, 231),
 
+  /* Seconds a connection may have been idle and still be re-used, 0 means
+     no limit */
+  CINIT(MAXAGE_CONN, LONG, 232),
+
+  /* Seconds since it was made that a connection may still be re-used, 0
+     means no limit */
+  CINIT(MAXLIFETIME_CONN, LONG, 233),
+
+  /* Seconds to remember that a name failed to resolve, 0 means not at
+     all */
+  CINIT(DNS_NEGATIVE_CACHE_TIMEOUT, LONG, 234),
+
+  /* Seconds past the DNS cache timeout that a name is still used while it
+     is resolved again in the background, 0 means not at all */
+  CINIT(DNS_SERVE_STALE, LONG, 235),
+
+  /* Seconds before the DNS cache timeout that a name that is used gets
+     resolved again in the background, 0 means not at all */
+  CINIT(DNS_PREFETCH, LONG, 236),
+
+  /* File to fill the DNS cache from before a transfer, and to write it to
+     when the transfer is removed from its multi handle */
+  CINIT(DNS_CACHE_FILE, OBJECTPOINT, 237),
+
   CURLOPT_LASTENTRY /* the last unused */
 } CURLoption;
 
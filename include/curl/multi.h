@@ -66,6 +66,8 @@ typedef enum {
   CURLM_UNKNOWN_OPTION,  /* curl_multi_setopt() with unsupported option */
   CURLM_ADDED_ALREADY,   /* an easy handle already added to a multi handle was
                             attempted to get added - again */
+  CURLM_WAKEUP_FAILURE,  /* curl_multi_wakeup() could not wake up the
+                            waiting thread */
   CURLM_LAST
 } CURLMcode;
 
@@ -162,6 +164,31 @@ CURL_EXTERN CURLMcode curl_multi_wait(CURLM *multi_handle,
                                       int timeout_ms,
                                       int *ret);
 
+/*
+ * Name:     curl_multi_wakeup()
+ *
+ * Desc:     Make a curl_multi_wait() that is waiting on the multi handle
+ *           return as soon as possible, or the next one if none is waiting
+ *           right now. This function may be called from any thread.
+ *
+ * Returns:  CURLMcode type, general multi error code.
+ */
+CURL_EXTERN CURLMcode curl_multi_wakeup(CURLM *multi_handle);
+
+/*
+ * Name:     curl_multi_prewarm()
+ *
+ * Desc:     Open 'count' new connections the way the given easy handle
+ *           would connect and leave them idle in the connection cache of
+ *           the multi handle, ready for transfers added later. The easy
+ *           handle is only used as a template and is not added.
+ *
+ * Returns:  CURLMcode type, general multi error code.
+ */
+CURL_EXTERN CURLMcode curl_multi_prewarm(CURLM *multi_handle,
+                                         CURL *easy_handle,
+                                         int count);
+
  /*
   * Name:    curl_multi_perform()
   *
@@ -224,6 +251,22 @@ CURL_EXTERN CURLMcode curl_multi_cleanup(CURLM *multi_handle);
 CURL_EXTERN CURLMsg *curl_multi_info_read(CURLM *multi_handle,
                                           int *msgs_in_queue);
 
+/*
+ * Name:    curl_multi_info_read_batch()
+ *
+ * Desc:    Like curl_multi_info_read(), but takes up to 'max_msgs' messages
+ *          off the queue at once and copies them into the array 'msgs'
+ *          points to.
+ *
+ * Returns: The number of messages copied into the array. It also writes the
+ *          number of messages left in the queue (after this read) in the
+ *          integer the last argument points to.
+ */
+CURL_EXTERN int curl_multi_info_read_batch(CURLM *multi_handle,
+                                           CURLMsg *msgs,
+                                           int max_msgs,
+                                           int *msgs_in_queue);
+
 /*
  * Name:    curl_multi_strerror()
  *
@@ -278,6 +321,19 @@ typedef int (*curl_multi_timer_callback)(CURLM *multi,    /* multi handle */
                                          void *userp);    /* private callback
                                                              pointer */
 
+/*
+ * Name:    curl_multi_completion_callback
+ *
+ * Desc:    Called by libcurl for each transfer that has completed, before
+ *          curl_multi_perform() or curl_multi_socket*() returns, instead of
+ *          queueing a message for curl_multi_info_read().
+ */
+typedef void (*curl_multi_completion_callback)(CURLM *multi, /* multi handle */
+                                               CURLMsg *msg, /* the message */
+                                               void *userp); /* private
+                                                                callback
+                                                                pointer */
+
 CURL_EXTERN CURLMcode curl_multi_socket(CURLM *multi_handle, curl_socket_t s,
                                         int *running_handles);
 
@@ -365,6 +421,15 @@ typedef enum {
   /* maximum number of open connections in total */
   CINIT(MAX_TOTAL_CONNECTIONS, LONG, 13),
 
+  /* This is the completion callback function pointer */
+  CINIT(COMPLETIONFUNCTION, FUNCTIONPOINT, 14),
+
+  /* This is the argument passed to the completion callback */
+  CINIT(COMPLETIONDATA, OBJECTPOINT, 15),
+
+  /* maximum number of threads resolving names */
+  CINIT(MAX_RESOLVER_THREADS, LONG, 16),
+
   CURLMOPT_LASTENTRY /* the last unused */
 } CURLMoption;
 
@@ -392,6 +457,70 @@ CURL_EXTERN CURLMcode curl_multi_setopt(CURLM *multi_handle,
 CURL_EXTERN CURLMcode curl_multi_assign(CURLM *multi_handle,
                                         curl_socket_t sockfd, void *sockp);
 
+/* The states an easy handle goes through while it is added to a multi
+   handle, used to index the arrays CURLMINFO_STATE_COUNTS and
+   CURLMINFO_STATE_TIMES fill in. */
+typedef enum {
+  CURLMSTATE_INIT,
+  CURLMSTATE_CONNECT_PEND,     /* waiting for a connection to be allowed */
+  CURLMSTATE_CONNECT,
+  CURLMSTATE_WAITRESOLVE,
+  CURLMSTATE_WAITCONNECT,
+  CURLMSTATE_WAITPROXYCONNECT,
+  CURLMSTATE_PROTOCONNECT,
+  CURLMSTATE_WAITDO,           /* waiting for its turn in a pipeline */
+  CURLMSTATE_DO,
+  CURLMSTATE_DOING,
+  CURLMSTATE_DO_MORE,
+  CURLMSTATE_DO_DONE,
+  CURLMSTATE_WAITPERFORM,      /* waiting for its turn in a pipeline */
+  CURLMSTATE_PERFORM,
+  CURLMSTATE_TOOFAST,          /* held back by a transfer speed limit */
+  CURLMSTATE_DONE,
+  CURLMSTATE_COMPLETED,
+  CURLMSTATE_MSGSENT,
+  CURLMSTATE_LAST /* not a state, the number of states */
+} curl_mstate;
+
+/* The reasons connections are closed while they are idle in the connection
+   cache, used to index the array CURLMINFO_EVICTIONS fills in. */
+typedef enum {
+  CURLEVICT_DEAD,         /* closed by the server */
+  CURLEVICT_MAXAGE,       /* idle for longer than CURLOPT_MAXAGE_CONN */
+  CURLEVICT_MAXLIFETIME,  /* older than CURLOPT_MAXLIFETIME_CONN */
+  CURLEVICT_MAXCONNECTS,  /* made room for another one in a full cache */
+  CURLEVICT_LAST /* not a reason, the number of reasons */
+} curl_evict;
+
+typedef enum {
+  CURLMINFO_NONE, /* first, never use this */
+  CURLMINFO_NUM_EASY        = CURLINFO_LONG + 1,
+  CURLMINFO_RUNNING         = CURLINFO_LONG + 2,
+  CURLMINFO_CONNCACHE_SIZE  = CURLINFO_LONG + 3,
+  CURLMINFO_PENDING         = CURLINFO_LONG + 4,
+  CURLMINFO_TIMERS          = CURLINFO_LONG + 5,
+  CURLMINFO_STATE_COUNTS    = CURLINFO_LONG + 6,
+  CURLMINFO_STATE_TIMES     = CURLINFO_DOUBLE + 7,
+  CURLMINFO_EVICTIONS       = CURLINFO_LONG + 8,
+  /* Fill in new entries below here! */
+
+  CURLMINFO_LASTONE         = 8
+} CURLMINFO;
+
+/*
+ * Name:    curl_multi_getinfo()
+ *
+ * Desc:    Request internal information from the multi handle, like how
+ *          many easy handles are in each state. The third argument MUST be
+ *          a pointer to a long or an array of longs, or a pointer to an
+ *          array of doubles, depending on what is asked. See the
+ *          curl_multi_getinfo man page.
+ *
+ * Returns: CURLM error code.
+ */
+CURL_EXTERN CURLMcode curl_multi_getinfo(CURLM *multi_handle,
+                                         CURLMINFO info, ...);
+
 #ifdef __cplusplus
 } /* end of extern "C" */
 #endif
@@ -0,0 +1,237 @@
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 1998 - 2015, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at http://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+
+#include "curl_setup.h"
+
+#include "arena.h"
+
+#define _MPRINTF_REPLACE /* use our functions only */
+#include <curl/mprintf.h>
+
+#include "curl_memory.h"
+/* The last #include file should be: */
+#include "memdebug.h"
+
+/*
+ * @unittest: 1323
+ */
+
+/* all allocations are aligned for any of these types */
+union arena_align {
+  long l;
+  double d;
+  void *p;
+  curl_off_t o;
+};
+
+#define ARENA_ALIGN sizeof(union arena_align)
+#define ARENA_ROUND(x) ((((x) + ARENA_ALIGN - 1) / ARENA_ALIGN) * ARENA_ALIGN)
+
+struct Curl_arena_chunk {
+  struct Curl_arena_chunk *next;
+  size_t size; /* usable bytes in 'mem' */
+  size_t used; /* bytes of 'mem' handed out, always a multiple of
+                  ARENA_ALIGN */
+  union arena_align mem[1]; /* the memory handed out starts here */
+};
+
+/* get a chunk with at least 'need' free bytes */
+static struct Curl_arena_chunk *arena_newchunk(struct Curl_arena *arena,
+                                               size_t need)
+{
+  struct Curl_arena_chunk *c;
+  size_t size = (need > CURL_ARENA_CHUNK) ? need : CURL_ARENA_CHUNK;
+
+  c = malloc(offsetof(struct Curl_arena_chunk, mem) + size);
+  if(!c)
+    return NULL;
+  c->size = size;
+  c->used = 0;
+
+  if((size > CURL_ARENA_CHUNK) && arena->head &&
+     (arena->head->used < arena->head->size)) {
+    /* an oversized chunk is only used for this one allocation, so keep
+       making the small ones from the current chunk */
+    c->next = arena->head->next;
+    arena->head->next = c;
+  }
+  else {
+    c->next = arena->head;
+    arena->head = c;
+  }
+  return c;
+}
+
+/*
+ * Curl_arena_init()
+ *
+ * Prepare an empty arena. Nothing is allocated until it is used.
+ */
+void Curl_arena_init(struct Curl_arena *arena)
+{
+  arena->head = NULL;
+  arena->allocs = 0;
+}
+
+/*
+ * Curl_arena_alloc()
+ *
+ * Return 'size' bytes of memory that stay valid until the arena is reset or
+ * destroyed, or NULL if out of memory.
+ */
+void *Curl_arena_alloc(struct Curl_arena *arena, size_t size)
+{
+  struct Curl_arena_chunk *c = arena->head;
+  void *mem;
+
+  size = ARENA_ROUND(size ? size : 1);
+  if(!c || (c->size - c->used < size)) {
+    c = arena_newchunk(arena, size);
+    if(!c)
+      return NULL;
+  }
+
+  mem = (char *)c->mem + c->used;
+  c->used += size;
+  arena->allocs++;
+#ifdef CURLDEBUG
+  curl_memlog("ARENA %s:%d alloc(%zu) = %p\n", __FILE__, __LINE__, size,
+              mem);
+#endif
+  return mem;
+}
+
+/*
+ * Curl_arena_memdup()
+ *
+ * Copy 'len' bytes into the arena and zero terminate the copy.
+ */
+char *Curl_arena_memdup(struct Curl_arena *arena, const void *src,
+                        size_t len)
+{
+  char *copy = Curl_arena_alloc(arena, len + 1);
+
+  if(copy) {
+    memcpy(copy, src, len);
+    copy[len] = 0;
+  }
+  return copy;
+}
+
+/*
+ * Curl_arena_strdup()
+ *
+ * Copy a zero terminated string into the arena.
+ */
+char *Curl_arena_strdup(struct Curl_arena *arena, const char *str)
+{
+  return Curl_arena_memdup(arena, str, strlen(str));
+}
+
+/*
+ * Curl_arena_aprintf()
+ *
+ * Like aprintf() but the string is stored in the arena.
+ */
+char *Curl_arena_aprintf(struct Curl_arena *arena, const char *format, ...)
+{
+  struct Curl_arena_chunk *c = arena->head;
+  va_list ap;
+  char *str;
+  char *tmp;
+
+  if(c && (c->used < c->size)) {
+    /* print straight into what is left of the current chunk */
+    char *dest = (char *)c->mem + c->used;
+    size_t room = c->size - c->used;
+    int len;
+
+    va_start(ap, format);
+    len = vsnprintf(dest, room, format, ap);
+    va_end(ap);
+
+    /* the output was cut off unless there is room to spare */
+    if((len >= 0) && ((size_t)len + 1 < room)) {
+      /* since 'room' is a multiple of the alignment, this claims the memory
+         that was just printed to */
+      str = Curl_arena_alloc(arena, (size_t)len + 1);
+      DEBUGASSERT(str == dest);
+      return str;
+    }
+  }
+
+  /* it does not fit in the current chunk, print it to a temporary buffer
+     and copy that into a chunk large enough */
+  va_start(ap, format);
+  tmp = vaprintf(format, ap);
+  va_end(ap);
+  if(!tmp)
+    return NULL;
+
+  str = Curl_arena_strdup(arena, tmp);
+  free(tmp);
+  return str;
+}
+
+/*
+ * Curl_arena_reset()
+ *
+ * Release everything allocated from the arena. One regular chunk is kept
+ * for the next round of allocations.
+ */
+void Curl_arena_reset(struct Curl_arena *arena)
+{
+  struct Curl_arena_chunk *c = arena->head;
+  struct Curl_arena_chunk *keep = NULL;
+
+  while(c) {
+    struct Curl_arena_chunk *next = c->next;
+    if(!keep && (c->size == CURL_ARENA_CHUNK))
+      keep = c;
+    else
+      free(c);
+    c = next;
+  }
+  if(keep) {
+    keep->next = NULL;
+    keep->used = 0;
+  }
+  arena->head = keep;
+
+#ifdef CURLDEBUG
+  if(arena->allocs)
+    curl_memlog("ARENA %s:%d reset(%zu)\n", __FILE__, __LINE__,
+                arena->allocs);
+#endif
+  arena->allocs = 0;
+}
+
+/*
+ * Curl_arena_destroy()
+ *
+ * Free all memory the arena holds. It can be used again afterwards.
+ */
+void Curl_arena_destroy(struct Curl_arena *arena)
+{
+  Curl_arena_reset(arena);
+  Curl_safefree(arena->head);
+}
@@ -0,0 +1,52 @@
+#ifndef HEADER_CURL_ARENA_H
+#define HEADER_CURL_ARENA_H
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 1998 - 2015, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at http://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include "curl_setup.h"
+#include <stddef.h>
+
+/*
+ * A request arena hands out memory from larger chunks and frees it all at
+ * once when it is reset. It is meant for the many small strings a single
+ * request needs: there is no way to free one allocation on its own. A reset
+ * keeps one chunk around, so a handle that does transfer after transfer
+ * only mallocs when a request needs more than that.
+ */
+#define CURL_ARENA_CHUNK 1024 /* usable bytes in a regular chunk */
+
+struct Curl_arena_chunk;
+
+struct Curl_arena {
+  struct Curl_arena_chunk *head; /* the chunk allocations are made from */
+  size_t allocs; /* number of allocations since the last reset */
+};
+
+void Curl_arena_init(struct Curl_arena *arena);
+void *Curl_arena_alloc(struct Curl_arena *arena, size_t size);
+char *Curl_arena_memdup(struct Curl_arena *arena, const void *src,
+                        size_t len);
+char *Curl_arena_strdup(struct Curl_arena *arena, const char *str);
+char *Curl_arena_aprintf(struct Curl_arena *arena, const char *format, ...);
+void Curl_arena_reset(struct Curl_arena *arena);
+void Curl_arena_destroy(struct Curl_arena *arena);
+
+#endif /* HEADER_CURL_ARENA_H */
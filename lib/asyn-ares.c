@@ -171,6 +171,17 @@ int Curl_resolver_duphandle(void **to, void *from)
   return CURLE_OK;
 }
 
+/*
+ * Curl_resolver_multi_cleanup()
+ *
+ * Called from curl_multi_cleanup(). The ares channels are per easy handle,
+ * so there is nothing shared to clean up.
+ */
+void Curl_resolver_multi_cleanup(void *resolver)
+{
+  (void)resolver;
+}
+
 static void destroy_async_data (struct Curl_async *async);
 
 /*
@@ -235,7 +246,7 @@ int Curl_resolver_getsock(struct connectdata *conn,
   milli = (timeout->tv_sec * 1000) + (timeout->tv_usec/1000);
   if(milli == 0)
     milli += 10;
-  Curl_expire_latest(conn->data, milli);
+  Curl_expire_latest(conn->data, milli, EXPIRE_ASYNC_NAME);
 
   return max;
 }
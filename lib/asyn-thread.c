@@ -69,6 +69,7 @@
 #include "inet_ntop.h"
 #include "curl_threads.h"
 #include "connect.h"
+#include "multihandle.h"
 
 #define _MPRINTF_REPLACE /* use our functions only */
 #include <curl/mprintf.h>
@@ -82,6 +83,12 @@
  **********************************************************************/
 #ifdef CURLRES_THREADED
 
+#ifdef CURL_HAVE_COND
+/* resolves are handed to a pool of threads kept by the multi handle, without
+   condition variables every resolve gets a thread of its own */
+#define USE_RESOLVER_POOL
+#endif
+
 /*
  * Curl_resolver_global_init()
  * Called from curl_global_init() to initialize global resolver environment.
@@ -157,6 +164,17 @@ static bool init_resolve_thread(struct connectdata *conn,
 struct thread_sync_data {
   curl_mutex_t * mtx;
   int done;
+#ifdef USE_RESOLVER_POOL
+  struct resolver_pool *pool; /* the pool the resolve was handed to */
+  struct thread_sync_data *next; /* next resolve in the pool's queue, or
+                                    next follower of the same leader */
+  bool queued; /* still waiting in the queue for a worker */
+  char *key; /* Curl_hostcache_id() of the name, to find identical resolves */
+  bool inflight; /* others with the same key attach to this resolve */
+  struct thread_sync_data *leader; /* the resolve this one waits for */
+  struct thread_sync_data *followers; /* the resolves waiting for this one */
+  bool cancelled; /* the owner gave up while a thread was resolving */
+#endif
 
   char * hostname;        /* hostname to resolve, Curl_async.hostname
                              duplicate */
@@ -170,7 +188,9 @@ struct thread_sync_data {
 };
 
 struct thread_data {
+#ifndef USE_RESOLVER_POOL
   curl_thread_t thread_hnd;
+#endif
   unsigned int poll_interval;
   long interval_end;
   struct thread_sync_data tsd;
@@ -195,6 +215,11 @@ void destroy_thread_sync_data(struct thread_sync_data * tsd)
   if(tsd->hostname)
     free(tsd->hostname);
 
+#ifdef USE_RESOLVER_POOL
+  if(tsd->key)
+    free(tsd->key);
+#endif
+
   if(tsd->res)
     Curl_freeaddrinfo(tsd->res);
 
@@ -262,15 +287,10 @@ static int getaddrinfo_complete(struct connectdata *conn)
 #ifdef HAVE_GETADDRINFO
 
 /*
- * getaddrinfo_thread() resolves a name and then exits.
- *
- * For builds without ARES, but with ENABLE_IPV6, create a resolver thread
- * and wait on it.
+ * resolve_name() resolves a name with getaddrinfo(), blocking.
  */
-static unsigned int CURL_STDCALL getaddrinfo_thread (void *arg)
+static void resolve_name(struct thread_sync_data *tsd)
 {
-  struct thread_sync_data *tsd = (struct thread_sync_data*)arg;
-  struct thread_data *td = tsd->td;
   char service[12];
   int rc;
 
@@ -283,6 +303,36 @@ static unsigned int CURL_STDCALL getaddrinfo_thread (void *arg)
     if(tsd->sock_error == 0)
       tsd->sock_error = RESOLVER_ENOMEM;
   }
+}
+
+#else /* HAVE_GETADDRINFO */
+
+/*
+ * resolve_name() resolves a name with gethostbyname(), blocking.
+ */
+static void resolve_name(struct thread_sync_data *tsd)
+{
+  tsd->res = Curl_ipv4_resolve_r(tsd->hostname, tsd->port);
+
+  if(!tsd->res) {
+    tsd->sock_error = SOCKERRNO;
+    if(tsd->sock_error == 0)
+      tsd->sock_error = RESOLVER_ENOMEM;
+  }
+}
+
+#endif /* HAVE_GETADDRINFO */
+
+#ifndef USE_RESOLVER_POOL
+/*
+ * resolve_thread() resolves a name and then exits.
+ */
+static unsigned int CURL_STDCALL resolve_thread(void *arg)
+{
+  struct thread_sync_data *tsd = (struct thread_sync_data*)arg;
+  struct thread_data *td = tsd->td;
+
+  resolve_name(tsd);
 
   Curl_mutex_acquire(tsd->mtx);
   if(tsd->done) {
@@ -298,41 +348,499 @@ static unsigned int CURL_STDCALL getaddrinfo_thread (void *arg)
 
   return 0;
 }
+#endif
 
-#else /* HAVE_GETADDRINFO */
+#ifdef USE_RESOLVER_POOL
+
+/* CURLMOPT_MAX_RESOLVER_THREADS default */
+#define DEFAULT_RESOLVER_THREADS 8
 
 /*
- * gethostbyname_thread() resolves a name and then exits.
+ * The resolver threads of a multi handle. A thread is started when a resolve
+ * is queued and no thread is free to take it, up to the maximum number.
+ * Threads then stay around waiting for more work until the multi handle is
+ * cleaned up, so that a resolve does not cost a thread creation.
  */
-static unsigned int CURL_STDCALL gethostbyname_thread (void *arg)
+struct resolver_worker {
+  struct resolver_worker *next;
+  struct resolver_pool *pool;
+  curl_thread_t thread_hnd;
+  bool busy; /* resolving, as opposed to waiting for work */
+  bool detached; /* cleans up after itself when it exits */
+};
+
+struct resolver_pool {
+  curl_mutex_t mtx; /* protects everything in here */
+  curl_cond_t work; /* signalled when a resolve is queued */
+  curl_cond_t done; /* broadcast when a worker is done with a resolve */
+  struct thread_sync_data *head; /* queued resolves, oldest first */
+  struct thread_sync_data *tail;
+  size_t queued; /* number of queued resolves */
+  struct curl_hash inflight; /* the resolves others can attach to, by key */
+  struct resolver_worker *workers;
+  size_t nworkers; /* number of threads started */
+  size_t idle; /* number of threads waiting for work */
+  int refs; /* the multi handle and each running thread */
+  bool shutdown; /* the multi handle is going away */
+};
+
+/* the inflight hash does not own the resolves it points to */
+static void inflight_dtor(void *p)
 {
-  struct thread_sync_data *tsd = (struct thread_sync_data *)arg;
-  struct thread_data *td = tsd->td;
+  (void)p;
+}
 
-  tsd->res = Curl_ipv4_resolve_r(tsd->hostname, tsd->port);
+static struct resolver_pool *pool_create(void)
+{
+  struct resolver_pool *pool = calloc(1, sizeof(struct resolver_pool));
+  if(!pool)
+    return NULL;
 
-  if(!tsd->res) {
-    tsd->sock_error = SOCKERRNO;
-    if(tsd->sock_error == 0)
-      tsd->sock_error = RESOLVER_ENOMEM;
+  if(Curl_hash_init(&pool->inflight, 7, Curl_hash_str, Curl_str_key_compare,
+                    inflight_dtor)) {
+    free(pool);
+    return NULL;
   }
+  Curl_mutex_init(&pool->mtx);
+  Curl_cond_init(&pool->work);
+  Curl_cond_init(&pool->done);
+  pool->refs = 1;
+  return pool;
+}
 
-  Curl_mutex_acquire(tsd->mtx);
-  if(tsd->done) {
-    /* too late, gotta clean up the mess */
-    Curl_mutex_release(tsd->mtx);
+/* drop a reference, the pool mutex must be held and is released */
+static void pool_unref(struct resolver_pool *pool)
+{
+  bool last = (--pool->refs == 0);
+
+  Curl_mutex_release(&pool->mtx);
+  if(last) {
+    DEBUGASSERT(!pool->workers);
+    Curl_hash_clean(&pool->inflight);
+    Curl_cond_destroy(&pool->work);
+    Curl_cond_destroy(&pool->done);
+    Curl_mutex_destroy(&pool->mtx);
+    free(pool);
+  }
+}
+
+/* unlink a worker from the pool, the pool mutex must be held */
+static void pool_remove_worker(struct resolver_pool *pool,
+                               struct resolver_worker *w)
+{
+  struct resolver_worker **wp = &pool->workers;
+
+  while(*wp != w)
+    wp = &(*wp)->next;
+  *wp = w->next;
+  pool->nworkers--;
+}
+
+/* stop others from attaching to a resolve, the pool mutex must be held */
+static void pool_forget(struct resolver_pool *pool,
+                        struct thread_sync_data *tsd)
+{
+  if(tsd->inflight) {
+    Curl_hash_delete(&pool->inflight, tsd->key, strlen(tsd->key) + 1);
+    tsd->inflight = FALSE;
+  }
+}
+
+/*
+ * pool_done() hands the result of a resolve to all the resolves that waited
+ * for it and marks them all done. The pool mutex must be held. A resolve its
+ * owner gave up on is freed.
+ */
+static void pool_done(struct resolver_pool *pool,
+                      struct thread_sync_data *tsd)
+{
+  struct thread_sync_data *f;
+
+  pool_forget(pool, tsd);
+
+  while(tsd->followers) {
+    f = tsd->followers;
+    tsd->followers = f->next;
+    f->next = NULL;
+    f->leader = NULL;
+
+    if(tsd->res) {
+      /* every owner caches and frees its own copy */
+      f->res = Curl_dupaddrinfo(tsd->res);
+      if(!f->res)
+        f->sock_error = RESOLVER_ENOMEM;
+    }
+    else
+      f->sock_error = tsd->sock_error;
+
+    Curl_mutex_acquire(f->mtx);
+    f->done = 1;
+    Curl_mutex_release(f->mtx);
+  }
+
+  if(tsd->cancelled) {
+    struct thread_data *td = tsd->td;
     destroy_thread_sync_data(tsd);
     free(td);
   }
   else {
+    Curl_mutex_acquire(tsd->mtx);
     tsd->done = 1;
     Curl_mutex_release(tsd->mtx);
   }
+}
+
+/*
+ * pool_worker() is the body of a resolver thread: it resolves queued names
+ * until the pool is shut down.
+ */
+static unsigned int CURL_STDCALL pool_worker(void *arg)
+{
+  struct resolver_worker *w = (struct resolver_worker *)arg;
+  struct resolver_pool *pool = w->pool;
+
+  Curl_mutex_acquire(&pool->mtx);
+  for(;;) {
+    struct thread_sync_data *tsd;
+
+    while(!pool->head && !pool->shutdown) {
+      pool->idle++;
+      Curl_cond_wait(&pool->work, &pool->mtx);
+      pool->idle--;
+    }
+    if(pool->shutdown)
+      break;
+
+    tsd = pool->head;
+    pool->head = tsd->next;
+    if(!pool->head)
+      pool->tail = NULL;
+    pool->queued--;
+    tsd->queued = FALSE;
+    tsd->next = NULL;
+    w->busy = TRUE;
+    Curl_mutex_release(&pool->mtx);
+
+    /* the owner only marks the resolve cancelled once it is taken out of
+       the queue, so it stays around until pool_done() */
+    resolve_name(tsd);
+
+    Curl_mutex_acquire(&pool->mtx);
+    pool_done(pool, tsd);
+    w->busy = FALSE;
+    Curl_cond_broadcast(&pool->done);
+  }
 
+  /* a thread that is shut down while idle is joined by the multi handle,
+     a busy one was detached and has to clean up after itself */
+  if(w->detached) {
+    pool_remove_worker(pool, w);
+    free(w);
+  }
+  pool_unref(pool);
   return 0;
 }
 
-#endif /* HAVE_GETADDRINFO */
+/* check if two resolves give the same result */
+static bool same_resolve(struct thread_sync_data *a,
+                         struct thread_sync_data *b)
+{
+#ifdef HAVE_GETADDRINFO
+  return (a->hints.ai_family == b->hints.ai_family) &&
+    (a->hints.ai_socktype == b->hints.ai_socktype);
+#else
+  (void)a;
+  (void)b;
+  return TRUE;
+#endif
+}
+
+/*
+ * pool_submit() queues a resolve in the pool of the multi handle, creating
+ * the pool and starting a thread when needed. When the same name is already
+ * being resolved, the resolve waits for that one to finish instead.
+ *
+ * Returns an errno value on failure, otherwise zero.
+ */
+static int pool_submit(struct connectdata *conn, struct thread_sync_data *tsd)
+{
+  struct Curl_multi *multi = conn->data->multi;
+  struct resolver_pool *pool;
+  struct thread_sync_data *leader = NULL;
+  size_t max;
+
+  DEBUGASSERT(multi);
+  if(!multi)
+    return EINVAL;
+
+  pool = multi->resolver;
+  if(!pool) {
+    pool = pool_create();
+    if(!pool)
+      return RESOLVER_ENOMEM;
+    multi->resolver = pool;
+  }
+  max = multi->max_resolver_threads ?
+    (size_t)multi->max_resolver_threads : DEFAULT_RESOLVER_THREADS;
+
+  /* without a key the resolve is just not shared */
+  tsd->key = Curl_hostcache_id(tsd->hostname, tsd->port);
+
+  Curl_mutex_acquire(&pool->mtx);
+  tsd->pool = pool;
+
+  if(tsd->key)
+    leader = Curl_hash_pick(&pool->inflight, tsd->key, strlen(tsd->key) + 1);
+  if(leader && same_resolve(leader, tsd)) {
+    /* no need to ask for the same name twice */
+    tsd->leader = leader;
+    tsd->next = leader->followers;
+    leader->followers = tsd;
+    Curl_mutex_release(&pool->mtx);
+    return 0;
+  }
+  if(tsd->key && !leader &&
+     Curl_hash_add(&pool->inflight, tsd->key, strlen(tsd->key) + 1, tsd))
+    tsd->inflight = TRUE;
+
+  tsd->next = NULL;
+  tsd->queued = TRUE;
+  if(pool->tail)
+    pool->tail->next = tsd;
+  else
+    pool->head = tsd;
+  pool->tail = tsd;
+  pool->queued++;
+
+  if((pool->queued > pool->idle) && (pool->nworkers < max)) {
+    /* more work than free threads */
+    struct resolver_worker *w = calloc(1, sizeof(struct resolver_worker));
+    if(w) {
+      w->pool = pool;
+      /* the thread does not start working before the mutex is released */
+      w->thread_hnd = Curl_thread_create(pool_worker, w);
+      if(w->thread_hnd) {
+        w->next = pool->workers;
+        pool->workers = w;
+        pool->nworkers++;
+        pool->refs++;
+      }
+      else {
+        free(w);
+        w = NULL;
+      }
+    }
+    if(!w && !pool->nworkers) {
+      /* nobody would ever pick this resolve up */
+      int err = RESOLVER_ENOMEM;
+#ifndef _WIN32_WCE
+      err = errno;
+#endif
+      pool_forget(pool, tsd);
+      pool->head = pool->tail = NULL;
+      pool->queued = 0;
+      tsd->queued = FALSE;
+      tsd->pool = NULL;
+      Curl_mutex_release(&pool->mtx);
+      return err;
+    }
+  }
+
+  Curl_cond_signal(&pool->work);
+  Curl_mutex_release(&pool->mtx);
+  return 0;
+}
+
+/*
+ * pool_unqueue() takes a resolve out of the queue. The first of the
+ * resolves waiting for it takes its place. The pool mutex must be held.
+ */
+static void pool_unqueue(struct resolver_pool *pool,
+                         struct thread_sync_data *tsd)
+{
+  struct thread_sync_data *f = tsd->followers;
+  struct thread_sync_data **tp = &pool->head;
+  struct thread_sync_data *prev = NULL;
+
+  while(*tp != tsd) {
+    prev = *tp;
+    tp = &(*tp)->next;
+  }
+
+  if(f) {
+    struct thread_sync_data *g;
+
+    f->followers = f->next;
+    for(g = f->followers; g; g = g->next)
+      g->leader = f;
+    f->leader = NULL;
+    f->queued = TRUE;
+    f->next = tsd->next;
+    *tp = f;
+    if(pool->tail == tsd)
+      pool->tail = f;
+    tsd->followers = NULL;
+
+    if(tsd->inflight) {
+      /* the key stays, only the resolve it points to changes */
+      Curl_hash_add(&pool->inflight, tsd->key, strlen(tsd->key) + 1, f);
+      tsd->inflight = FALSE;
+      f->inflight = TRUE;
+    }
+  }
+  else {
+    *tp = tsd->next;
+    if(pool->tail == tsd)
+      pool->tail = prev;
+    pool->queued--;
+    pool_forget(pool, tsd);
+  }
+  tsd->next = NULL;
+  tsd->queued = FALSE;
+}
+
+/*
+ * pool_cancel() is called by the owner of a resolve that gives up on it.
+ * Returns TRUE if no thread has the resolve, so the caller has to free it.
+ * Otherwise the thread frees it when it is done.
+ */
+static bool pool_cancel(struct thread_sync_data *tsd)
+{
+  struct resolver_pool *pool = tsd->pool;
+  bool mine = TRUE;
+
+  if(!pool)
+    /* never queued, or dropped when the pool was shut down */
+    return TRUE;
+
+  Curl_mutex_acquire(&pool->mtx);
+  if(tsd->queued)
+    pool_unqueue(pool, tsd);
+  else if(tsd->leader) {
+    /* waiting for another resolve, stop doing that */
+    struct thread_sync_data **fp = &tsd->leader->followers;
+
+    while(*fp != tsd)
+      fp = &(*fp)->next;
+    *fp = tsd->next;
+    tsd->next = NULL;
+    tsd->leader = NULL;
+  }
+  else {
+    int done;
+
+    Curl_mutex_acquire(tsd->mtx);
+    done = tsd->done;
+    Curl_mutex_release(tsd->mtx);
+    if(!done) {
+      /* a thread is resolving it right now */
+      tsd->cancelled = TRUE;
+      mine = FALSE;
+    }
+  }
+  Curl_mutex_release(&pool->mtx);
+  return mine;
+}
+
+/* block until a queued resolve is done */
+static void pool_wait(struct thread_sync_data *tsd)
+{
+  struct resolver_pool *pool = tsd->pool;
+
+  Curl_mutex_acquire(&pool->mtx);
+  for(;;) {
+    int done;
+
+    Curl_mutex_acquire(tsd->mtx);
+    done = tsd->done;
+    Curl_mutex_release(tsd->mtx);
+    if(done)
+      break;
+    Curl_cond_wait(&pool->done, &pool->mtx);
+  }
+  Curl_mutex_release(&pool->mtx);
+}
+
+/*
+ * Curl_resolver_multi_cleanup()
+ *
+ * Stops the resolver threads of a multi handle. Idle threads are joined. A
+ * thread still stuck resolving a cancelled name is detached, it frees the
+ * pool when it is the last one to finish.
+ */
+void Curl_resolver_multi_cleanup(void *resolver)
+{
+  struct resolver_pool *pool = (struct resolver_pool *)resolver;
+  struct resolver_worker *idle = NULL;
+  struct resolver_worker *w;
+
+  if(!pool)
+    return;
+
+  Curl_mutex_acquire(&pool->mtx);
+  /* resolves of handles left in the multi handle are never going to be
+     done, their owners free them when cancelling */
+  while(pool->head) {
+    struct thread_sync_data *tsd = pool->head;
+    pool->head = tsd->next;
+    while(tsd->followers) {
+      struct thread_sync_data *f = tsd->followers;
+      tsd->followers = f->next;
+      f->next = NULL;
+      f->leader = NULL;
+      f->pool = NULL;
+    }
+    pool_forget(pool, tsd);
+    tsd->next = NULL;
+    tsd->queued = FALSE;
+    tsd->pool = NULL;
+  }
+  pool->tail = NULL;
+  pool->queued = 0;
+  pool->shutdown = TRUE;
+  Curl_cond_broadcast(&pool->work);
+
+  w = pool->workers;
+  while(w) {
+    struct resolver_worker *next = w->next;
+    if(w->busy) {
+      Curl_thread_destroy(w->thread_hnd);
+      w->thread_hnd = curl_thread_t_null;
+      w->detached = TRUE;
+    }
+    else {
+      pool_remove_worker(pool, w);
+      w->next = idle;
+      idle = w;
+    }
+    w = next;
+  }
+  Curl_mutex_release(&pool->mtx);
+
+  while(idle) {
+    w = idle;
+    idle = w->next;
+    Curl_thread_join(&w->thread_hnd);
+    free(w);
+  }
+
+  Curl_mutex_acquire(&pool->mtx);
+  pool_unref(pool);
+}
+
+#else /* USE_RESOLVER_POOL */
+
+/*
+ * Curl_resolver_multi_cleanup()
+ * Called from curl_multi_cleanup(). Every resolve has a thread of its own
+ * here, so there is nothing shared to clean up.
+ */
+void Curl_resolver_multi_cleanup(void *resolver)
+{
+  (void)resolver;
+}
+
+#endif /* USE_RESOLVER_POOL */
 
 /*
  * destroy_async_data() cleans up async resolver data and thread handle.
@@ -343,21 +851,35 @@ static void destroy_async_data (struct Curl_async *async)
     struct thread_data *td = (struct thread_data*) async->os_specific;
     int done;
 
+#ifdef USE_RESOLVER_POOL
+    /* a thread that is still resolving frees it when done */
+    done = pool_cancel(&td->tsd);
+#else
     /*
      * if the thread is still blocking in the resolve syscall, detach it and
      * let the thread do the cleanup...
      */
-    Curl_mutex_acquire(td->tsd.mtx);
-    done = td->tsd.done;
-    td->tsd.done = 1;
-    Curl_mutex_release(td->tsd.mtx);
+    if(td->tsd.mtx) {
+      Curl_mutex_acquire(td->tsd.mtx);
+      done = td->tsd.done;
+      td->tsd.done = 1;
+      Curl_mutex_release(td->tsd.mtx);
+    }
+    else
+      /* setting up the resolve failed, no thread knows about it */
+      done = 1;
+#endif
 
     if(!done) {
+#ifndef USE_RESOLVER_POOL
       Curl_thread_destroy(td->thread_hnd);
+#endif
     }
     else {
+#ifndef USE_RESOLVER_POOL
       if(td->thread_hnd != curl_thread_t_null)
         Curl_thread_join(&td->thread_hnd);
+#endif
 
       destroy_thread_sync_data(&td->tsd);
 
@@ -373,8 +895,8 @@ static void destroy_async_data (struct Curl_async *async)
 }
 
 /*
- * init_resolve_thread() starts a new thread that performs the actual
- * resolve. This function returns before the resolve is done.
+ * init_resolve_thread() hands the resolve to a resolver thread. This function
+ * returns before the resolve is done.
  *
  * Returns FALSE in case of failure, otherwise TRUE.
  */
@@ -393,7 +915,9 @@ static bool init_resolve_thread (struct connectdata *conn,
   conn->async.done = FALSE;
   conn->async.status = 0;
   conn->async.dns = NULL;
+#ifndef USE_RESOLVER_POOL
   td->thread_hnd = curl_thread_t_null;
+#endif
 
   if(!init_thread_sync_data(td, hostname, port, hints))
     goto err_exit;
@@ -403,11 +927,12 @@ static bool init_resolve_thread (struct connectdata *conn,
   if(!conn->async.hostname)
     goto err_exit;
 
-#ifdef HAVE_GETADDRINFO
-  td->thread_hnd = Curl_thread_create(getaddrinfo_thread, &td->tsd);
+#ifdef USE_RESOLVER_POOL
+  err = pool_submit(conn, &td->tsd);
+  if(err)
+    goto err_exit;
 #else
-  td->thread_hnd = Curl_thread_create(gethostbyname_thread, &td->tsd);
-#endif
+  td->thread_hnd = Curl_thread_create(resolve_thread, &td->tsd);
 
   if(!td->thread_hnd) {
 #ifndef _WIN32_WCE
@@ -415,6 +940,7 @@ static bool init_resolve_thread (struct connectdata *conn,
 #endif
     goto err_exit;
   }
+#endif
 
   return TRUE;
 
@@ -470,10 +996,15 @@ CURLcode Curl_resolver_wait_resolv(struct connectdata *conn,
   DEBUGASSERT(conn && td);
 
   /* wait for the thread to resolve the name */
+#ifdef USE_RESOLVER_POOL
+  pool_wait(&td->tsd);
+  result = getaddrinfo_complete(conn);
+#else
   if(Curl_thread_join(&td->thread_hnd))
     result = getaddrinfo_complete(conn);
   else
     DEBUGASSERT(0);
+#endif
 
   conn->async.done = TRUE;
 
@@ -543,7 +1074,7 @@ CURLcode Curl_resolver_is_resolved(struct connectdata *conn,
       td->poll_interval = 250;
 
     td->interval_end = elapsed + td->poll_interval;
-    Curl_expire(conn->data, td->poll_interval);
+    Curl_expire(conn->data, td->poll_interval, EXPIRE_ASYNC_NAME);
   }
 
   return CURLE_OK;
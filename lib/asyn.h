@@ -81,6 +81,15 @@ void Curl_resolver_cleanup(void *resolver);
  */
 int Curl_resolver_duphandle(void **to, void *from);
 
+/*
+ * Curl_resolver_multi_cleanup()
+ * Called from curl_multi_cleanup() to destroy resolver state shared by all
+ * easy handles of a multi handle ('resolver' member of the Curl_multi
+ * structure). All resolves of the multi handle are done or cancelled by
+ * then.
+ */
+void Curl_resolver_multi_cleanup(void *resolver);
+
 /*
  * Curl_resolver_cancel().
  *
@@ -155,6 +164,7 @@ Curl_addrinfo *Curl_resolver_getaddrinfo(struct connectdata *conn,
 #define Curl_resolver_global_init() CURLE_OK
 #define Curl_resolver_global_cleanup() Curl_nop_stmt
 #define Curl_resolver_cleanup(x) Curl_nop_stmt
+#define Curl_resolver_multi_cleanup(x) Curl_nop_stmt
 #endif
 
 #ifdef CURLRES_ASYNCH
@@ -45,6 +45,12 @@ static void conn_llist_dtor(void *user, void *element)
   data->bundle = NULL;
 }
 
+static void idle_llist_dtor(void *user, void *element)
+{
+  (void)user;
+  (void)element;
+}
+
 CURLcode Curl_bundle_create(struct SessionHandle *data,
                             struct connectbundle **cb_ptr)
 {
@@ -57,8 +63,13 @@ CURLcode Curl_bundle_create(struct SessionHandle *data,
   (*cb_ptr)->num_connections = 0;
   (*cb_ptr)->server_supports_pipelining = FALSE;
 
-  (*cb_ptr)->conn_list = Curl_llist_alloc((curl_llist_dtor) conn_llist_dtor);
-  if(!(*cb_ptr)->conn_list) {
+  (*cb_ptr)->conn_list =
+    Curl_llist_alloc_embedded((curl_llist_dtor) conn_llist_dtor);
+  (*cb_ptr)->idle_list =
+    Curl_llist_alloc_embedded((curl_llist_dtor) idle_llist_dtor);
+  if(!(*cb_ptr)->conn_list || !(*cb_ptr)->idle_list) {
+    Curl_llist_destroy((*cb_ptr)->conn_list, NULL);
+    Curl_llist_destroy((*cb_ptr)->idle_list, NULL);
     Curl_safefree(*cb_ptr);
     return CURLE_OUT_OF_MEMORY;
   }
@@ -70,6 +81,10 @@ void Curl_bundle_destroy(struct connectbundle *cb_ptr)
   if(!cb_ptr)
     return;
 
+  if(cb_ptr->idle_list) {
+    Curl_llist_destroy(cb_ptr->idle_list, NULL);
+    cb_ptr->idle_list = NULL;
+  }
   if(cb_ptr->conn_list) {
     Curl_llist_destroy(cb_ptr->conn_list, NULL);
     cb_ptr->conn_list = NULL;
@@ -81,8 +96,8 @@ void Curl_bundle_destroy(struct connectbundle *cb_ptr)
 CURLcode Curl_bundle_add_conn(struct connectbundle *cb_ptr,
                               struct connectdata *conn)
 {
-  if(!Curl_llist_insert_next(cb_ptr->conn_list, cb_ptr->conn_list->tail, conn))
-    return CURLE_OUT_OF_MEMORY;
+  Curl_llist_insert_node(cb_ptr->conn_list, cb_ptr->conn_list->tail, conn,
+                         &conn->bundle_node);
 
   conn->bundle = cb_ptr;
 
@@ -94,17 +109,38 @@ CURLcode Curl_bundle_add_conn(struct connectbundle *cb_ptr,
 int Curl_bundle_remove_conn(struct connectbundle *cb_ptr,
                             struct connectdata *conn)
 {
-  struct curl_llist_element *curr;
-
-  curr = cb_ptr->conn_list->head;
-  while(curr) {
-    if(curr->ptr == conn) {
-      Curl_llist_remove(cb_ptr->conn_list, curr, NULL);
-      cb_ptr->num_connections--;
-      conn->bundle = NULL;
-      return 1; /* we removed a handle */
-    }
-    curr = curr->next;
-  }
-  return 0;
+  /* the connection's own list element makes this a direct unlink */
+  if(conn->bundle != cb_ptr)
+    return 0;
+
+  Curl_bundle_conn_busy(cb_ptr, conn);
+  Curl_llist_remove(cb_ptr->conn_list, &conn->bundle_node, NULL);
+  cb_ptr->num_connections--;
+  conn->bundle = NULL;
+  return 1; /* we removed a handle */
+}
+
+/* The connection is not in use anymore, make it the first one to try when
+   looking for a connection to re-use */
+void Curl_bundle_conn_idle(struct connectbundle *cb_ptr,
+                           struct connectdata *conn)
+{
+  if(conn->idle_node.ptr)
+    Curl_llist_remove(cb_ptr->idle_list, &conn->idle_node, NULL);
+  Curl_llist_insert_node(cb_ptr->idle_list, NULL, conn, &conn->idle_node);
+}
+
+/* The connection is in use again, or leaving the bundle */
+void Curl_bundle_conn_busy(struct connectbundle *cb_ptr,
+                           struct connectdata *conn)
+{
+  if(conn->idle_node.ptr)
+    Curl_llist_remove(cb_ptr->idle_list, &conn->idle_node, NULL);
+}
+
+/* Return the connection in the bundle that has been idle the longest, or
+   NULL if all of them are in use */
+struct connectdata *Curl_bundle_oldest_idle(struct connectbundle *cb_ptr)
+{
+  return cb_ptr->idle_list->tail ? cb_ptr->idle_list->tail->ptr : NULL;
 }
@@ -27,6 +27,8 @@ struct connectbundle {
                                       set after first response */
   size_t num_connections;       /* Number of connections in the bundle */
   struct curl_llist *conn_list; /* The connectdata members of the bundle */
+  struct curl_llist *idle_list; /* The members not in use, the most recently
+                                   used first */
 };
 
 CURLcode Curl_bundle_create(struct SessionHandle *data,
@@ -40,6 +42,14 @@ CURLcode Curl_bundle_add_conn(struct connectbundle *cb_ptr,
 int Curl_bundle_remove_conn(struct connectbundle *cb_ptr,
                             struct connectdata *conn);
 
+void Curl_bundle_conn_idle(struct connectbundle *cb_ptr,
+                           struct connectdata *conn);
+
+void Curl_bundle_conn_busy(struct connectbundle *cb_ptr,
+                           struct connectdata *conn);
+
+struct connectdata *Curl_bundle_oldest_idle(struct connectbundle *cb_ptr);
+
 
 #endif /* HEADER_CURL_BUNDLES_H */
 
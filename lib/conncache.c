@@ -33,6 +33,8 @@
 #include "rawstr.h"
 #include "bundles.h"
 #include "conncache.h"
+#include "share.h"
+#include "sigpipe.h"
 
 #include "curl_memory.h"
 /* The last #include file should be: */
@@ -45,6 +47,12 @@ static void free_bundle_hash_entry(void *freethis)
   Curl_bundle_destroy(b);
 }
 
+static void idle_llist_dtor(void *user, void *element)
+{
+  (void)user;
+  (void)element;
+}
+
 struct conncache *Curl_conncache_init(int size)
 {
   struct conncache *connc;
@@ -55,12 +63,18 @@ struct conncache *Curl_conncache_init(int size)
 
   connc->hash = Curl_hash_alloc(size, Curl_hash_str,
                                 Curl_str_key_compare, free_bundle_hash_entry);
+  connc->idle = Curl_llist_alloc_embedded((curl_llist_dtor) idle_llist_dtor);
 
-  if(!connc->hash) {
+  if(!connc->hash || !connc->idle) {
+    Curl_hash_destroy(connc->hash);
+    Curl_llist_destroy(connc->idle, NULL);
     free(connc);
     return NULL;
   }
 
+  /* the first pruning round is due a second from now */
+  connc->last_cleanup = Curl_tvnow();
+
   return connc;
 }
 
@@ -69,54 +83,44 @@ void Curl_conncache_destroy(struct conncache *connc)
   if(connc) {
     Curl_hash_destroy(connc->hash);
     connc->hash = NULL;
+    Curl_llist_destroy(connc->idle, NULL);
+    connc->idle = NULL;
     free(connc);
   }
 }
 
+/* Find the bundle with the given key, made by conn_bundle_key() in url.c */
 struct connectbundle *Curl_conncache_find_bundle(struct conncache *connc,
-                                                 char *hostname)
+                                                 char *key)
 {
   struct connectbundle *bundle = NULL;
 
   if(connc)
-    bundle = Curl_hash_pick(connc->hash, hostname, strlen(hostname)+1);
+    bundle = Curl_hash_pick(connc->hash, key, strlen(key)+1);
 
   return bundle;
 }
 
 static bool conncache_add_bundle(struct conncache *connc,
-                                 char *hostname,
+                                 char *key,
                                  struct connectbundle *bundle)
 {
   void *p;
 
-  p = Curl_hash_add(connc->hash, hostname, strlen(hostname)+1, bundle);
+  p = Curl_hash_add(connc->hash, key, strlen(key)+1, bundle);
 
   return p?TRUE:FALSE;
 }
 
 static void conncache_remove_bundle(struct conncache *connc,
-                                    struct connectbundle *bundle)
+                                    char *key)
 {
-  struct curl_hash_iterator iter;
-  struct curl_hash_element *he;
-
   if(!connc)
     return;
 
-  Curl_hash_start_iterate(connc->hash, &iter);
-
-  he = Curl_hash_next_element(&iter);
-  while(he) {
-    if(he->ptr == bundle) {
-      /* The bundle is destroyed by the hash destructor function,
-         free_bundle_hash_entry() */
-      Curl_hash_delete(connc->hash, he->key, he->key_len);
-      return;
-    }
-
-    he = Curl_hash_next_element(&iter);
-  }
+  /* The bundle is destroyed by the hash destructor function,
+     free_bundle_hash_entry() */
+  Curl_hash_delete(connc->hash, key, strlen(key)+1);
 }
 
 CURLcode Curl_conncache_add_conn(struct conncache *connc,
@@ -128,14 +132,14 @@ CURLcode Curl_conncache_add_conn(struct conncache *connc,
   struct SessionHandle *data = conn->data;
 
   bundle = Curl_conncache_find_bundle(data->state.conn_cache,
-                                      conn->host.name);
+                                      conn->bundle_key);
   if(!bundle) {
     result = Curl_bundle_create(data, &new_bundle);
     if(result)
       return result;
 
     if(!conncache_add_bundle(data->state.conn_cache,
-                             conn->host.name, new_bundle)) {
+                             conn->bundle_key, new_bundle)) {
       Curl_bundle_destroy(new_bundle);
       return CURLE_OUT_OF_MEMORY;
     }
@@ -145,7 +149,7 @@ CURLcode Curl_conncache_add_conn(struct conncache *connc,
   result = Curl_bundle_add_conn(bundle, conn);
   if(result) {
     if(new_bundle)
-      conncache_remove_bundle(data->state.conn_cache, new_bundle);
+      conncache_remove_bundle(data->state.conn_cache, conn->bundle_key);
     return result;
   }
 
@@ -167,9 +171,11 @@ void Curl_conncache_remove_conn(struct conncache *connc,
   /* The bundle pointer can be NULL, since this function can be called
      due to a failed connection attempt, before being added to a bundle */
   if(bundle) {
+    if(connc)
+      Curl_conncache_conn_busy(connc, conn);
     Curl_bundle_remove_conn(bundle, conn);
     if(bundle->num_connections == 0) {
-      conncache_remove_bundle(connc, bundle);
+      conncache_remove_bundle(connc, conn->bundle_key);
     }
 
     if(connc) {
@@ -182,6 +188,53 @@ void Curl_conncache_remove_conn(struct conncache *connc,
   }
 }
 
+/* take a connection out of the list of idle ones, if it is in it */
+static void lru_unlink(struct conncache *connc, struct connectdata *conn)
+{
+  if(!conn->lru_node.ptr)
+    return;
+
+  if(connc->prune_next == conn)
+    /* keep the pruning round going with the connection after this one */
+    connc->prune_next =
+      conn->lru_node.next ? conn->lru_node.next->ptr : NULL;
+  Curl_llist_remove(connc->idle, &conn->lru_node, NULL);
+}
+
+/*
+ * The connection is done being used and stays in the cache. It becomes the
+ * first to try for re-use within its bundle and the last to close when the
+ * cache needs room.
+ */
+void Curl_conncache_conn_idle(struct conncache *connc,
+                              struct connectdata *conn)
+{
+  if(!conn->bundle)
+    return;
+
+  conn->lastused = Curl_tvnow();
+  Curl_bundle_conn_idle(conn->bundle, conn);
+  lru_unlink(connc, conn);
+  Curl_llist_insert_node(connc->idle, connc->idle->tail, conn,
+                         &conn->lru_node);
+}
+
+/* The connection is being used again */
+void Curl_conncache_conn_busy(struct conncache *connc,
+                              struct connectdata *conn)
+{
+  if(conn->bundle)
+    Curl_bundle_conn_busy(conn->bundle, conn);
+  lru_unlink(connc, conn);
+}
+
+/* Return the connection that has been idle the longest, or NULL if all
+   connections are in use */
+struct connectdata *Curl_conncache_oldest_idle(struct conncache *connc)
+{
+  return connc->idle->head ? connc->idle->head->ptr : NULL;
+}
+
 /* This function iterates the entire connection cache and calls the
    function func() with the connection pointer as the first argument
    and the supplied 'param' argument as the other,
@@ -248,6 +301,48 @@ Curl_conncache_find_first_connection(struct conncache *connc)
   return NULL;
 }
 
+/*
+ * Close every connection in the cache. 'closure' is a handle of its own
+ * that the connections are closed on behalf of, used when the multi handle
+ * or share object that holds the cache goes away.
+ */
+void Curl_conncache_close_all_connections(struct conncache *connc,
+                                          struct SessionHandle *closure)
+{
+  struct connectdata *conn;
+
+  conn = Curl_conncache_find_first_connection(connc);
+  while(conn) {
+    SIGPIPE_VARIABLE(pipe_st);
+    conn->data = closure;
+
+    sigpipe_ignore(conn->data, &pipe_st);
+    /* This will remove the connection from the cache */
+    (void)Curl_disconnect(conn, FALSE);
+    sigpipe_restore(&pipe_st);
+
+    conn = Curl_conncache_find_first_connection(connc);
+  }
+}
+
+/*
+ * Curl_conncache_lock() and Curl_conncache_unlock() guard the connection
+ * cache of a handle that shares it with others through a share object,
+ * they do nothing otherwise. A handle may lock again while it holds the
+ * lock, like when a connection it looks at for re-use turns out to be dead
+ * and gets closed, and only the outermost pair calls the application.
+ */
+void Curl_conncache_lock(struct SessionHandle *data)
+{
+  if(data->share && !data->state.conncache_locked++)
+    Curl_share_lock(data, CURL_LOCK_DATA_CONNECT, CURL_LOCK_ACCESS_SINGLE);
+}
+
+void Curl_conncache_unlock(struct SessionHandle *data)
+{
+  if(data->share && !--data->state.conncache_locked)
+    Curl_share_unlock(data, CURL_LOCK_DATA_CONNECT);
+}
 
 #if 0
 /* Useful for debugging the connection cache */
@@ -24,17 +24,33 @@
 
 struct conncache {
   struct curl_hash *hash;
+  struct curl_llist *idle; /* the connections not in use, the least recently
+                              used first */
   size_t num_connections;
   long next_connection_id;
-  struct timeval last_cleanup;
+  struct timeval last_cleanup; /* when the last pruning round completed */
+  struct connectdata *prune_next; /* the idle connection the pruning round
+                                     in progress checks next, or NULL */
+  struct timeval last_prune; /* when the last batch of a round was checked */
+  long evictions[CURLEVICT_LAST]; /* idle connections closed, per reason */
 };
 
+/* the default hash size of a connection cache */
+#define CURL_CONNECTION_HASH_SIZE 97
+
+/* the number of idle connections Curl_prune_dead_connections() checks per
+   call for being dead or too old */
+#define CONNCACHE_PRUNE_BATCH 8
+
+/* the least number of milliseconds between two batches of the same round */
+#define CONNCACHE_PRUNE_INTERVAL 100
+
 struct conncache *Curl_conncache_init(int size);
 
 void Curl_conncache_destroy(struct conncache *connc);
 
 struct connectbundle *Curl_conncache_find_bundle(struct conncache *connc,
-                                                 char *hostname);
+                                                 char *key);
 
 CURLcode Curl_conncache_add_conn(struct conncache *connc,
                                  struct connectdata *conn);
@@ -42,6 +58,14 @@ CURLcode Curl_conncache_add_conn(struct conncache *connc,
 void Curl_conncache_remove_conn(struct conncache *connc,
                                 struct connectdata *conn);
 
+void Curl_conncache_conn_idle(struct conncache *connc,
+                              struct connectdata *conn);
+
+void Curl_conncache_conn_busy(struct conncache *connc,
+                              struct connectdata *conn);
+
+struct connectdata *Curl_conncache_oldest_idle(struct conncache *connc);
+
 void Curl_conncache_foreach(struct conncache *connc,
                             void *param,
                             int (*func)(struct connectdata *conn,
@@ -50,6 +74,12 @@ void Curl_conncache_foreach(struct conncache *connc,
 struct connectdata *
 Curl_conncache_find_first_connection(struct conncache *connc);
 
+void Curl_conncache_close_all_connections(struct conncache *connc,
+                                          struct SessionHandle *closure);
+
+void Curl_conncache_lock(struct SessionHandle *data);
+void Curl_conncache_unlock(struct SessionHandle *data);
+
 void Curl_conncache_print(struct conncache *connc);
 
 #endif /* HEADER_CURL_CONNCACHE_H */
@@ -76,6 +76,7 @@
 #include "warnless.h"
 #include "conncache.h"
 #include "multihandle.h"
+#include "share.h"
 
 /* The last #include file should be: */
 #include "memdebug.h"
@@ -1062,7 +1063,8 @@ static CURLcode singleipconnect(struct connectdata *conn,
 
   conn->connecttime = Curl_tvnow();
   if(conn->num_addr > 1)
-    Curl_expire_latest(data, conn->timeoutms_per_addr);
+    Curl_expire_latest(data, conn->timeoutms_per_addr,
+                       EXPIRE_DNS_PER_NAME);
 
   /* Connect TCP sockets, bind UDP */
   if(!isconnected && (conn->socktype == SOCK_STREAM)) {
@@ -1139,7 +1141,7 @@ CURLcode Curl_connecthost(struct connectdata *conn,  /* context */
   conn->tempaddr[1] = NULL;
   conn->tempsock[0] = CURL_SOCKET_BAD;
   conn->tempsock[1] = CURL_SOCKET_BAD;
-  Curl_expire(conn->data, HAPPY_EYEBALLS_TIMEOUT);
+  Curl_expire(conn->data, HAPPY_EYEBALLS_TIMEOUT, EXPIRE_HAPPY_EYEBALLS);
 
   /* Max time for the next connection attempt */
   conn->timeoutms_per_addr =
@@ -1197,7 +1199,15 @@ curl_socket_t Curl_getconnectinfo(struct SessionHandle *data,
     find.tofind = data->state.lastconnect;
     find.found = FALSE;
 
-    Curl_conncache_foreach(data->multi_easy->conn_cache, &find, conn_is_conn);
+    if(data->share && data->share->conn_cache) {
+      /* the connection was left in the cache of the share object */
+      Curl_conncache_lock(data);
+      Curl_conncache_foreach(data->share->conn_cache, &find, conn_is_conn);
+      Curl_conncache_unlock(data);
+    }
+    else
+      Curl_conncache_foreach(data->multi_easy->conn_cache, &find,
+                             conn_is_conn);
 
     if(!find.found) {
       data->state.lastconnect = NULL;
@@ -1248,8 +1258,12 @@ int Curl_closesocket(struct connectdata *conn,
          accept, then we MUST NOT call the callback but clear the accepted
          status */
       conn->sock_accepted[SECONDARYSOCKET] = FALSE;
-    else
+    else {
+      /* tell the multi-socket code about this before the application gets
+         to close it, as the socket number may be reused right away */
+      Curl_multi_closed(conn, sock);
       return conn->fclosesocket(conn->closesocket_client, sock);
+    }
   }
 
   if(conn)
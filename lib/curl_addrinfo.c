@@ -97,6 +97,60 @@ Curl_freeaddrinfo(Curl_addrinfo *cahead)
 }
 
 
+/*
+ * Curl_dupaddrinfo()
+ *
+ * Returns a copy of a linked list of Curl_addrinfo structs, or NULL if out
+ * of memory. The copy must be free'd with Curl_freeaddrinfo().
+ */
+
+Curl_addrinfo *
+Curl_dupaddrinfo(const Curl_addrinfo *orig)
+{
+  Curl_addrinfo *cafirst = NULL;
+  Curl_addrinfo *calast = NULL;
+  const Curl_addrinfo *ai;
+
+  for(ai = orig; ai != NULL; ai = ai->ai_next) {
+    Curl_addrinfo *ca = calloc(1, sizeof(Curl_addrinfo));
+    if(!ca)
+      goto fail;
+
+    /* add this element last in the return list */
+    if(calast)
+      calast->ai_next = ca;
+    else
+      cafirst = ca;
+    calast = ca;
+
+    ca->ai_flags     = ai->ai_flags;
+    ca->ai_family    = ai->ai_family;
+    ca->ai_socktype  = ai->ai_socktype;
+    ca->ai_protocol  = ai->ai_protocol;
+    ca->ai_addrlen   = ai->ai_addrlen;
+
+    if(ai->ai_addr) {
+      ca->ai_addr = malloc(ai->ai_addrlen);
+      if(!ca->ai_addr)
+        goto fail;
+      memcpy(ca->ai_addr, ai->ai_addr, ai->ai_addrlen);
+    }
+
+    if(ai->ai_canonname) {
+      ca->ai_canonname = strdup(ai->ai_canonname);
+      if(!ca->ai_canonname)
+        goto fail;
+    }
+  }
+
+  return cafirst;
+
+  fail:
+  Curl_freeaddrinfo(cafirst);
+  return NULL;
+}
+
+
 #ifdef HAVE_GETADDRINFO
 /*
  * Curl_getaddrinfo_ex()
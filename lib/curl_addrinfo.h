@@ -63,6 +63,9 @@ typedef struct Curl_addrinfo Curl_addrinfo;
 void
 Curl_freeaddrinfo(Curl_addrinfo *cahead);
 
+Curl_addrinfo *
+Curl_dupaddrinfo(const Curl_addrinfo *orig);
+
 #ifdef HAVE_GETADDRINFO
 int
 Curl_getaddrinfo_ex(const char *nodename,
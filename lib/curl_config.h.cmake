@@ -136,6 +136,9 @@
 /* Define to 1 if you have the <err.h> header file. */
 #cmakedefine HAVE_ERR_H 1
 
+/* Define to 1 if you have a working eventfd */
+#cmakedefine HAVE_EVENTFD 1
+
 /* Define to 1 if you have the fcntl function. */
 #cmakedefine HAVE_FCNTL 1
 
@@ -903,6 +906,9 @@
 /* if NSS is enabled */
 #cmakedefine USE_NSS 1
 
+/* Use epoll in curl_multi_wait() */
+#cmakedefine USE_EPOLL 1
+
 /* if you want to use OpenLDAP code instead of legacy ldap implementation */
 #cmakedefine USE_OPENLDAP 1
 
@@ -574,9 +574,9 @@ static CURLcode AllowServerConnect(struct connectdata *conn, bool *connected)
     /* Add timeout to multi handle and break out of the loop */
     if(!result && *connected == FALSE) {
       if(data->set.accepttimeout > 0)
-        Curl_expire(data, data->set.accepttimeout);
+        Curl_expire(data, data->set.accepttimeout, EXPIRE_FTP_ACCEPT);
       else
-        Curl_expire(data, DEFAULT_ACCEPT_TIMEOUT);
+        Curl_expire(data, DEFAULT_ACCEPT_TIMEOUT, EXPIRE_FTP_ACCEPT);
     }
   }
 
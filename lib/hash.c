@@ -32,22 +32,113 @@
 /* The last #include file should be: */
 #include "memdebug.h"
 
-static void
-hash_element_dtor(void *user, void *element)
+/* smallest table to allocate */
+#define HASH_MINSLOTS 8
+
+/* the key of a deleted element, it never matches anything */
+static char deleted_key;
+#define DELETED (&deleted_key)
+
+#define IS_USED(e) ((e)->key && ((e)->key != DELETED))
+
+/*
+ * Get the full hash value of a key. The hash functions in use do not all
+ * spread their values over every bit, like for socket numbers, so the bits
+ * get mixed before the value is used to pick a slot in a power of two sized
+ * table.
+ */
+static size_t hash_code(struct curl_hash *h, void *key, size_t key_len)
+{
+  size_t hv = h->hash_func(key, key_len, (size_t)-1);
+
+  hv ^= hv >> 16;
+  hv *= 0x85ebca6bUL;
+  hv ^= hv >> 13;
+  hv *= 0xc2b2ae35UL;
+  hv ^= hv >> 16;
+  return hv;
+}
+
+/* return the element holding this key, or NULL */
+static struct curl_hash_element *
+hash_find(struct curl_hash *h, void *key, size_t key_len, size_t hv)
 {
-  struct curl_hash *h = (struct curl_hash *) user;
-  struct curl_hash_element *e = (struct curl_hash_element *) element;
+  size_t mask;
+  size_t i;
 
-  Curl_safefree(e->key);
+  if(!h->slots)
+    return NULL;
 
-  if(e->ptr) {
-    h->dtor(e->ptr);
-    e->ptr = NULL;
+  mask = (size_t)h->slots - 1;
+  for(i = hv & mask; h->table[i].key; i = (i + 1) & mask) {
+    struct curl_hash_element *he = &h->table[i];
+    if((he->key != DELETED) && (he->hash == hv) &&
+       h->comp_func(he->key, he->key_len, key, key_len))
+      return he;
   }
+  return NULL;
+}
 
-  e->key_len = 0;
+/* return the free or deleted element a new entry with this hash goes to */
+static struct curl_hash_element *hash_slot(struct curl_hash *h, size_t hv)
+{
+  size_t mask = (size_t)h->slots - 1;
+  size_t i;
 
-  free(e);
+  for(i = hv & mask; IS_USED(&h->table[i]); i = (i + 1) & mask)
+    ;
+  return &h->table[i];
+}
+
+/*
+ * Move all entries to a new table with 'slots' slots, which drops the
+ * deleted ones. The cached hash values make this cheap. Returns non-zero on
+ * failure, in which case the old table is left as it was.
+ */
+static int hash_rebuild(struct curl_hash *h, int slots)
+{
+  struct curl_hash_element *old = h->table;
+  int oldslots = h->slots;
+  int i;
+
+  h->table = calloc((size_t)slots, sizeof(struct curl_hash_element));
+  if(!h->table) {
+    h->table = old;
+    return 1; /* failure */
+  }
+  h->slots = slots;
+  h->deleted = 0;
+
+  for(i = 0; i < oldslots; i++) {
+    if(IS_USED(&old[i]))
+      *hash_slot(h, old[i].hash) = old[i];
+  }
+  free(old);
+  return 0;
+}
+
+/* remove the entry in this element and call the destructor for its data */
+static void hash_remove(struct curl_hash *h, struct curl_hash_element *he)
+{
+  void *ptr = he->ptr;
+
+  free(he->key);
+  he->key = DELETED;
+  he->ptr = NULL;
+  he->key_len = 0;
+  --h->size;
+
+  if(!h->size) {
+    /* nothing left, so no probe sequences to keep intact */
+    memset(h->table, 0, h->slots * sizeof(struct curl_hash_element));
+    h->deleted = 0;
+  }
+  else
+    ++h->deleted;
+
+  /* the destructor is called last as it might use the hash again */
+  if(ptr)
+    h->dtor(ptr);
 }
 
 /* return 1 on error, 0 is fine */
@@ -58,7 +149,7 @@ Curl_hash_init(struct curl_hash *h,
                comp_function comparator,
                curl_hash_dtor dtor)
 {
-  int i;
+  int size = HASH_MINSLOTS;
 
   if(!slots || !hfunc || !comparator ||!dtor) {
     return 1; /* failure */
@@ -68,23 +159,15 @@ Curl_hash_init(struct curl_hash *h,
   h->comp_func = comparator;
   h->dtor = dtor;
   h->size = 0;
-  h->slots = slots;
+  h->deleted = 0;
 
-  h->table = malloc(slots * sizeof(struct curl_llist *));
+  /* the table must be a power of two in size */
+  while(size < slots)
+    size *= 2;
+
+  h->table = calloc((size_t)size, sizeof(struct curl_hash_element));
   if(h->table) {
-    for(i = 0; i < slots; ++i) {
-      h->table[i] = Curl_llist_alloc((curl_llist_dtor) hash_element_dtor);
-      if(!h->table[i]) {
-        while(i--) {
-          Curl_llist_destroy(h->table[i], NULL);
-          h->table[i] = NULL;
-        }
-        free(h->table);
-        h->table = NULL;
-        h->slots = 0;
-        return 1; /* failure */
-      }
-    }
+    h->slots = size;
     return 0; /* fine */
   }
   else {
@@ -117,34 +200,6 @@ Curl_hash_alloc(int slots,
   return h;
 }
 
-
-
-static struct curl_hash_element *
-mk_hash_element(const void *key, size_t key_len, const void *p)
-{
-  struct curl_hash_element *he = malloc(sizeof(struct curl_hash_element));
-
-  if(he) {
-    void *dupkey = malloc(key_len);
-    if(dupkey) {
-      /* copy the key */
-      memcpy(dupkey, key, key_len);
-
-      he->key = dupkey;
-      he->key_len = key_len;
-      he->ptr = (void *) p;
-    }
-    else {
-      /* failed to duplicate the key, free memory and fail */
-      free(he);
-      he = NULL;
-    }
-  }
-  return he;
-}
-
-#define FETCH_LIST(x,y,z) x->table[x->hash_func(y, z, x->slots)]
-
 /* Insert the data in the hash. If there already was a match in the hash,
  * that data is replaced.
  *
@@ -153,52 +208,57 @@ mk_hash_element(const void *key, size_t key_len, const void *p)
 void *
 Curl_hash_add(struct curl_hash *h, void *key, size_t key_len, void *p)
 {
-  struct curl_hash_element  *he;
-  struct curl_llist_element *le;
-  struct curl_llist *l = FETCH_LIST (h, key, key_len);
-
-  for(le = l->head; le; le = le->next) {
-    he = (struct curl_hash_element *) le->ptr;
-    if(h->comp_func(he->key, he->key_len, key, key_len)) {
-      Curl_llist_remove(l, le, (void *)h);
-      --h->size;
-      break;
-    }
-  }
+  struct curl_hash_element *he;
+  size_t hv = hash_code(h, key, key_len);
+  char *dupkey;
 
-  he = mk_hash_element(key, key_len, p);
+  he = hash_find(h, key, key_len, hv);
   if(he) {
-    if(Curl_llist_insert_next(l, l->tail, he)) {
-      ++h->size;
-      return p; /* return the new entry */
-    }
-    /*
-     * Couldn't insert it, destroy the 'he' element and the key again. We
-     * don't call hash_element_dtor() since that would also call the
-     * "destructor" for the actual data 'p'. When we fail, we shall not touch
-     * that data.
-     */
-    free(he->key);
-    free(he);
+    /* replace the data, the key stays */
+    void *old = he->ptr;
+    he->ptr = p;
+    if(old && (old != p))
+      h->dtor(old);
+    return p; /* return the new entry */
   }
 
-  return NULL; /* failure */
+  /* Keep at least half of the slots free of entries and a quarter free of
+     both entries and deleted ones, so that probe sequences stay short. */
+  if(((h->size + 1) * 2 > (size_t)h->slots) ||
+     ((h->size + h->deleted + 1) * 4 > (size_t)h->slots * 3)) {
+    int slots = h->slots ? h->slots : HASH_MINSLOTS;
+    while((h->size + 1) * 2 > (size_t)slots)
+      slots *= 2;
+    if(hash_rebuild(h, slots))
+      return NULL; /* failure */
+  }
+
+  dupkey = malloc(key_len);
+  if(!dupkey)
+    return NULL; /* failure, we shall not touch the data */
+  memcpy(dupkey, key, key_len);
+
+  he = hash_slot(h, hv);
+  if(he->key == DELETED)
+    --h->deleted;
+  he->key = dupkey;
+  he->key_len = key_len;
+  he->hash = hv;
+  he->ptr = p;
+  ++h->size;
+
+  return p; /* return the new entry */
 }
 
 /* remove the identified hash entry, returns non-zero on failure */
 int Curl_hash_delete(struct curl_hash *h, void *key, size_t key_len)
 {
-  struct curl_llist_element *le;
-  struct curl_hash_element  *he;
-  struct curl_llist *l = FETCH_LIST(h, key, key_len);
-
-  for(le = l->head; le; le = le->next) {
-    he = le->ptr;
-    if(h->comp_func(he->key, he->key_len, key, key_len)) {
-      Curl_llist_remove(l, le, (void *) h);
-      --h->size;
-      return 0;
-    }
+  struct curl_hash_element *he =
+    hash_find(h, key, key_len, hash_code(h, key, key_len));
+
+  if(he) {
+    hash_remove(h, he);
+    return 0;
   }
   return 1;
 }
@@ -206,18 +266,12 @@ int Curl_hash_delete(struct curl_hash *h, void *key, size_t key_len)
 void *
 Curl_hash_pick(struct curl_hash *h, void *key, size_t key_len)
 {
-  struct curl_llist_element *le;
-  struct curl_hash_element  *he;
-  struct curl_llist *l;
+  struct curl_hash_element *he;
 
   if(h) {
-    l = FETCH_LIST(h, key, key_len);
-    for(le = l->head; le; le = le->next) {
-      he = le->ptr;
-      if(h->comp_func(he->key, he->key_len, key, key_len)) {
-        return he->ptr;
-      }
-    }
+    he = hash_find(h, key, key_len, hash_code(h, key, key_len));
+    if(he)
+      return he->ptr;
   }
 
   return NULL;
@@ -228,16 +282,11 @@ void
 Curl_hash_apply(curl_hash *h, void *user,
                 void (*cb)(void *user, void *ptr))
 {
-  struct curl_llist_element  *le;
-  int                  i;
+  int i;
 
   for(i = 0; i < h->slots; ++i) {
-    for(le = (h->table[i])->head;
-        le;
-        le = le->next) {
-      curl_hash_element *el = le->ptr;
-      cb(user, el->ptr);
-    }
+    if(IS_USED(&h->table[i]))
+      cb(user, h->table[i].ptr);
   }
 }
 #endif
@@ -248,12 +297,17 @@ Curl_hash_clean(struct curl_hash *h)
   int i;
 
   for(i = 0; i < h->slots; ++i) {
-    Curl_llist_destroy(h->table[i], (void *) h);
-    h->table[i] = NULL;
+    struct curl_hash_element *he = &h->table[i];
+    if(IS_USED(he)) {
+      free(he->key);
+      if(he->ptr)
+        h->dtor(he->ptr);
+    }
   }
 
   Curl_safefree(h->table);
   h->size = 0;
+  h->deleted = 0;
   h->slots = 0;
 }
 
@@ -261,27 +315,17 @@ void
 Curl_hash_clean_with_criterium(struct curl_hash *h, void *user,
                                int (*comp)(void *, void *))
 {
-  struct curl_llist_element *le;
-  struct curl_llist_element *lnext;
-  struct curl_llist *list;
   int i;
 
   if(!h)
     return;
 
+  /* deleting never moves any other entry */
   for(i = 0; i < h->slots; ++i) {
-    list = h->table[i];
-    le = list->head; /* get first list entry */
-    while(le) {
-      struct curl_hash_element *he = le->ptr;
-      lnext = le->next;
-      /* ask the callback function if we shall remove this entry or not */
-      if(comp(user, he->ptr)) {
-        Curl_llist_remove(list, le, (void *) h);
-        --h->size; /* one less entry in the hash now */
-      }
-      le = lnext;
-    }
+    struct curl_hash_element *he = &h->table[i];
+    /* ask the callback function if we shall remove this entry or not */
+    if(IS_USED(he) && comp(user, he->ptr))
+      hash_remove(h, he);
   }
 }
 
@@ -296,15 +340,16 @@ Curl_hash_destroy(struct curl_hash *h)
   free(h);
 }
 
+/* FNV-1a, which is fast and spreads similar strings well */
 size_t Curl_hash_str(void* key, size_t key_length, size_t slots_num)
 {
-  const char* key_str = (const char *) key;
-  const char *end = key_str + key_length;
-  unsigned long h = 5381;
+  const unsigned char *key_str = (const unsigned char *) key;
+  const unsigned char *end = key_str + key_length;
+  unsigned int h = 2166136261U;
 
   while(key_str < end) {
-    h += h << 5;
-    h ^= (unsigned long) *key_str++;
+    h ^= *key_str++;
+    h *= 16777619U;
   }
 
   return (h % slots_num);
@@ -332,37 +377,25 @@ void Curl_hash_start_iterate(struct curl_hash *hash,
   iter->current_element = NULL;
 }
 
+/* Entries may be deleted while iterating, but none may be added */
 struct curl_hash_element *
 Curl_hash_next_element(struct curl_hash_iterator *iter)
 {
   int i;
   struct curl_hash *h = iter->hash;
 
-  /* Get the next element in the current list, if any */
-  if(iter->current_element)
-    iter->current_element = iter->current_element->next;
-
-  /* If we have reached the end of the list, find the next one */
-  if(!iter->current_element) {
-    for(i = iter->slot_index;i < h->slots;i++) {
-      if(h->table[i]->head) {
-        iter->current_element = h->table[i]->head;
-        iter->slot_index = i+1;
-        break;
-      }
+  iter->current_element = NULL;
+
+  for(i = iter->slot_index; i < h->slots; i++) {
+    if(IS_USED(&h->table[i])) {
+      iter->current_element = &h->table[i];
+      iter->slot_index = i+1;
+      break;
     }
   }
 
-  if(iter->current_element) {
-    struct curl_hash_element *he = iter->current_element->ptr;
-    return he;
-  }
-  else {
-    iter->current_element = NULL;
-    return NULL;
-  }
+  return iter->current_element;
 }
-
 #if 0 /* useful function for debugging hashes and their contents */
 void Curl_hash_print(struct curl_hash *h,
                      void (*func)(void *))
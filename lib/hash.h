@@ -28,7 +28,10 @@
 
 #include "llist.h"
 
-/* Hash function prototype */
+/* Hash function prototype. It returns a value below 'slots_num'. The hash
+   table asks for a value in the full size_t range by passing (size_t)-1 and
+   keeps it with the entry, so the function is called once per add, delete
+   or pick and never when the table grows. */
 typedef size_t (*hash_function) (void* key,
                                  size_t key_length,
                                  size_t slots_num);
@@ -43,8 +46,11 @@ typedef size_t (*comp_function) (void* key1,
 
 typedef void (*curl_hash_dtor)(void *);
 
+/* The table is an array of elements using open addressing with linear
+   probing. It doubles in size when it gets half full, so the number of
+   slots given when creating it is only a hint of the expected size. */
 struct curl_hash {
-  struct curl_llist **table;
+  struct curl_hash_element *table;
 
   /* Hash function to be used for this hash table */
   hash_function hash_func;
@@ -52,20 +58,24 @@ struct curl_hash {
   /* Comparator function to compare keys */
   comp_function comp_func;
   curl_hash_dtor   dtor;
-  int slots;
-  size_t size;
+  int slots;      /* size of 'table', a power of two or zero */
+  size_t size;    /* number of entries in the table */
+  size_t deleted; /* number of slots marked as deleted */
 };
 
+/* An element is free when 'key' is NULL. Deleted elements keep their slot
+   to not break up probe sequences until the table is rebuilt. */
 struct curl_hash_element {
   void   *ptr;
   char   *key;
   size_t key_len;
+  size_t hash; /* the full hash value of the key */
 };
 
 struct curl_hash_iterator {
   struct curl_hash *hash;
   int slot_index;
-  struct curl_llist_element *current_element;
+  struct curl_hash_element *current_element;
 };
 
 int Curl_hash_init(struct curl_hash *h,
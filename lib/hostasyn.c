@@ -66,7 +66,8 @@
  *
  * If the status argument is CURL_ASYNC_SUCCESS, this function takes
  * ownership of the Curl_addrinfo passed, storing the resolved data
- * in the DNS cache.
+ * in the DNS cache. Otherwise the failure is stored in the cache when
+ * negative caching is enabled.
  *
  * The storage operation locks and unlocks the DNS cache.
  */
@@ -74,6 +75,7 @@ CURLcode Curl_addrinfo_callback(struct connectdata *conn,
                                 int status,
                                 struct Curl_addrinfo *ai)
 {
+  struct SessionHandle *data = conn->data;
   struct Curl_dns_entry *dns = NULL;
   CURLcode result = CURLE_OK;
 
@@ -81,8 +83,6 @@ CURLcode Curl_addrinfo_callback(struct connectdata *conn,
 
   if(CURL_ASYNC_SUCCESS == status) {
     if(ai) {
-      struct SessionHandle *data = conn->data;
-
       if(data->share)
         Curl_share_lock(data, CURL_LOCK_DATA_DNS, CURL_LOCK_ACCESS_SINGLE);
 
@@ -102,6 +102,16 @@ CURLcode Curl_addrinfo_callback(struct connectdata *conn,
       result = CURLE_OUT_OF_MEMORY;
     }
   }
+  else if(data->set.dns_negative_timeout) {
+    /* remember that the name doesn't resolve */
+    if(data->share)
+      Curl_share_lock(data, CURL_LOCK_DATA_DNS, CURL_LOCK_ACCESS_SINGLE);
+
+    Curl_cache_negative(data, conn->async.hostname, conn->async.port);
+
+    if(data->share)
+      Curl_share_unlock(data, CURL_LOCK_DATA_DNS);
+  }
 
   conn->async.dns = dns;
 
@@ -54,6 +54,7 @@
 #include "share.h"
 #include "strerror.h"
 #include "url.h"
+#include "multiif.h"
 #include "inet_ntop.h"
 #include "warnless.h"
 
@@ -110,24 +111,33 @@
  */
 
 /* These two symbols are for the global DNS cache */
-static struct curl_hash hostname_cache;
+static struct Curl_dnscache hostname_cache;
 static int host_cache_initialized;
 
 static void freednsentry(void *freethis);
 
+/* make 'cache' an empty DNS cache, returns non-zero on failure */
+static int dnscache_init(struct Curl_dnscache *cache)
+{
+  cache->changes = 0;
+  cache->resolved.oldest = cache->resolved.newest = NULL;
+  cache->failed.oldest = cache->failed.newest = NULL;
+  return Curl_hash_init(&cache->entries, 7, Curl_hash_str,
+                        Curl_str_key_compare, freednsentry);
+}
+
 /*
  * Curl_global_host_cache_init() initializes and sets up a global DNS cache.
  * Global DNS cache is general badness. Do not use. This will be removed in
  * a future version. Use the share interface instead!
  *
- * Returns a struct curl_hash pointer on success, NULL on failure.
+ * Returns a struct Curl_dnscache pointer on success, NULL on failure.
  */
-struct curl_hash *Curl_global_host_cache_init(void)
+struct Curl_dnscache *Curl_global_host_cache_init(void)
 {
   int rc = 0;
   if(!host_cache_initialized) {
-    rc = Curl_hash_init(&hostname_cache, 7, Curl_hash_str,
-                        Curl_str_key_compare, freednsentry);
+    rc = dnscache_init(&hostname_cache);
     if(!rc)
       host_cache_initialized = 1;
   }
@@ -144,7 +154,7 @@ void Curl_global_host_cache_dtor(void)
        cleared off */
     Curl_hostcache_clean(NULL, &hostname_cache);
     /* then free the remaining hash completely */
-    Curl_hash_clean(&hostname_cache);
+    Curl_hash_clean(&hostname_cache.entries);
     host_cache_initialized = 0;
   }
 }
@@ -202,8 +212,8 @@ Curl_printable_address(const Curl_addrinfo *ai, char *buf, size_t bufsize)
  * Return a hostcache id string for the provided host + port, to be used by
  * the DNS caching.
  */
-static char *
-create_hostcache_id(const char *name, int port)
+char *
+Curl_hostcache_id(const char *name, int port)
 {
   /* create and return the new allocated entry */
   char *id = aprintf("%s:%d", name, port);
@@ -218,42 +228,161 @@ create_hostcache_id(const char *name, int port)
   return id;
 }
 
-struct hostcache_prune_data {
-  long cache_timeout;
-  time_t now;
-};
-
 /*
- * This function is set as a callback to be called for every entry in the DNS
- * cache when we want to prune old unused entries.
+ * Put an entry in an age list. Entries are mostly added with the current
+ * time, so the place is searched for from the newest end.
  *
- * Returning non-zero means remove the entry, return 0 to keep it in the
- * cache.
+ * With a 'cursor' the search goes forward from the entry it points to, or
+ * from the oldest end when that is NULL, and the cursor is moved to the new
+ * entry. Entries linked in timestamp order this way cost one walk over the
+ * list in total.
  */
-static int
-hostcache_timestamp_remove(void *datap, void *hc)
+static void dns_age_link(struct Curl_dns_age *age, struct Curl_dns_entry *dns,
+                         struct Curl_dns_entry **cursor)
 {
-  struct hostcache_prune_data *data =
-    (struct hostcache_prune_data *) datap;
-  struct Curl_dns_entry *c = (struct Curl_dns_entry *) hc;
+  struct Curl_dns_entry *older;
 
-  return !c->inuse && (data->now - c->timestamp >= data->cache_timeout);
+  if(cursor) {
+    struct Curl_dns_entry *next = *cursor ? (*cursor)->newer : age->oldest;
+
+    older = *cursor;
+    while(next && (next->timestamp <= dns->timestamp)) {
+      older = next;
+      next = next->newer;
+    }
+    *cursor = dns;
+  }
+  else {
+    older = age->newest;
+    while(older && (older->timestamp > dns->timestamp))
+      older = older->older;
+  }
+
+  dns->age = age;
+  dns->older = older;
+  if(older) {
+    dns->newer = older->newer;
+    older->newer = dns;
+  }
+  else {
+    dns->newer = age->oldest;
+    age->oldest = dns;
+  }
+  if(dns->newer)
+    dns->newer->older = dns;
+  else
+    age->newest = dns;
+}
+
+/* take an entry out of its age list, if it is in one */
+static void dns_age_unlink(struct Curl_dns_entry *dns)
+{
+  struct Curl_dns_age *age = dns->age;
+
+  if(!age)
+    return;
+
+  if(dns->older)
+    dns->older->newer = dns->newer;
+  else
+    age->oldest = dns->newer;
+  if(dns->newer)
+    dns->newer->older = dns->older;
+  else
+    age->newest = dns->older;
+  dns->age = NULL;
+  dns->older = dns->newer = NULL;
+}
+
+/* check if an entry is too old to be used, 'timeout' -1 means never */
+static bool dns_expired(struct Curl_dns_entry *dns, long timeout, time_t now)
+{
+  return (timeout != -1) && (now - dns->timestamp >= timeout);
 }
 
 /*
- * Prune the DNS cache. This assumes that a lock has already been taken.
+ * The number of seconds a resolved name stays in the cache: its timeout plus
+ * the time it may be used stale while it is resolved again. Background
+ * resolves need an asynch resolver, so names are never used stale without.
+ */
+static long cache_lifetime(struct SessionHandle *data)
+{
+  long timeout = data->set.dns_cache_timeout;
+
+#ifdef CURLRES_ASYNCH
+  if(timeout > 0)
+    timeout += data->set.dns_serve_stale;
+#endif
+  return timeout;
+}
+
+/*
+ * Check if a name found in the cache should be resolved again in the
+ * background: it has expired but may still be used stale, or it expires
+ * within the CURLOPT_DNS_PREFETCH time. Assumes a locked cache.
+ */
+static bool wants_refresh(struct SessionHandle *data,
+                          struct Curl_dns_entry *dns)
+{
+#ifdef CURLRES_ASYNCH
+  long timeout = data->set.dns_cache_timeout;
+  long ahead = data->set.dns_prefetch;
+  time_t now;
+
+  if(!dns->addr || dns->refreshing || dns->pinned || (timeout <= 0) ||
+     (!data->set.dns_serve_stale && !ahead))
+    return FALSE;
+
+  time(&now);
+  if(now < dns->refresh_after)
+    /* the last background resolve failed a moment ago */
+    return FALSE;
+
+  if(ahead >= timeout)
+    /* a fresh entry is not resolved again right away */
+    ahead = timeout - 1;
+
+  return (now - dns->timestamp) >= (timeout - ahead);
+#else
+  (void)data;
+  (void)dns;
+  return FALSE;
+#endif
+}
+
+/*
+ * Remove the expired entries of an age list from the cache. The walk stops
+ * at the first entry that has not expired, so only expired entries are
+ * looked at. Those still in use are left for a later prune. This assumes
+ * that a lock has already been taken.
  */
 static void
-hostcache_prune(struct curl_hash *hostcache, long cache_timeout, time_t now)
+hostcache_prune_age(struct Curl_dnscache *cache, struct Curl_dns_age *age,
+                    long timeout, time_t now)
 {
-  struct hostcache_prune_data user;
+  struct Curl_dns_entry *dns = age->oldest;
+
+  if(timeout == -1)
+    return;
 
-  user.cache_timeout = cache_timeout;
-  user.now = now;
+  while(dns && dns_expired(dns, timeout, now)) {
+    /* the hash destructor takes the entry out of the list */
+    struct Curl_dns_entry *next = dns->newer;
+    if(!dns->inuse)
+      Curl_hash_delete(&cache->entries, dns->id, strlen(dns->id) + 1);
+    dns = next;
+  }
+}
 
-  Curl_hash_clean_with_criterium(hostcache,
-                                 (void *) &user,
-                                 hostcache_timestamp_remove);
+/*
+ * Prune the DNS cache. This assumes that a lock has already been taken.
+ */
+static void
+hostcache_prune(struct Curl_dnscache *cache, long cache_timeout,
+                long negative_timeout, time_t now)
+{
+  hostcache_prune_age(cache, &cache->resolved, cache_timeout, now);
+  hostcache_prune_age(cache, &cache->failed, negative_timeout, now);
 }
 
 /*
@@ -264,9 +393,11 @@ void Curl_hostcache_prune(struct SessionHandle *data)
 {
   time_t now;
 
-  if((data->set.dns_cache_timeout == -1) || !data->dns.hostcache)
+  if(((data->set.dns_cache_timeout == -1) &&
+      !data->set.dns_negative_timeout) || !data->dns.hostcache)
     /* cache forever means never prune, and NULL hostcache means
-       we can't do it */
+       we can't do it. Negative entries other handles added to a shared
+       cache are then zapped when looked up. */
     return;
 
   if(data->share)
@@ -276,7 +407,8 @@ void Curl_hostcache_prune(struct SessionHandle *data)
 
   /* Remove outdated and unused entries from the hostcache */
   hostcache_prune(data->dns.hostcache,
-                  data->set.dns_cache_timeout,
+                  cache_lifetime(data),
+                  data->set.dns_negative_timeout,
                   now);
 
   if(data->share)
@@ -289,23 +421,20 @@ void Curl_hostcache_prune(struct SessionHandle *data)
 static int
 remove_entry_if_stale(struct SessionHandle *data, struct Curl_dns_entry *dns)
 {
-  struct hostcache_prune_data user;
+  time_t now;
 
-  if(!dns || (data->set.dns_cache_timeout == -1) || !data->dns.hostcache ||
-     dns->inuse)
-    /* cache forever means never prune, and NULL hostcache means we can't do
-       it, if it still is in use then we leave it */
+  if(!dns || !data->dns.hostcache || dns->inuse || !dns->age)
+    /* NULL hostcache means we can't do it, if it still is in use then we
+       leave it, and it never expires if it isn't in an age list */
     return 0;
 
-  time(&user.now);
-  user.cache_timeout = data->set.dns_cache_timeout;
-
-  if(!hostcache_timestamp_remove(&user,dns) )
+  time(&now);
+  if(!dns_expired(dns, dns->addr ? cache_lifetime(data) :
+                  data->set.dns_negative_timeout, now))
     return 0;
 
-  Curl_hash_clean_with_criterium(data->dns.hostcache,
-                                 (void *) &user,
-                                 hostcache_timestamp_remove);
+  Curl_hash_delete(&data->dns.hostcache->entries, dns->id,
+                   strlen(dns->id) + 1);
 
   return 1;
 }
@@ -327,7 +456,9 @@ sigjmp_buf curl_jmpenv;
  * the DNS cache. This short circuits waiting for a lot of pending
  * lookups for the same hostname requested by different handles.
  *
- * Returns the Curl_dns_entry entry pointer or NULL if not in the cache.
+ * Returns the Curl_dns_entry entry pointer or NULL if not in the cache. An
+ * entry without addresses is a negative one: the name recently failed to
+ * resolve.
  */
 struct Curl_dns_entry *
 Curl_fetch_addr(struct connectdata *conn,
@@ -341,7 +472,7 @@ Curl_fetch_addr(struct connectdata *conn,
   int stale;
 
   /* Create an entry id, based upon the hostname and port */
-  entry_id = create_hostcache_id(hostname, port);
+  entry_id = Curl_hostcache_id(hostname, port);
   /* If we can't create the entry id, fail */
   if(!entry_id)
     return dns;
@@ -349,7 +480,7 @@ Curl_fetch_addr(struct connectdata *conn,
   entry_len = strlen(entry_id);
 
   /* See if its already in our dns cache */
-  dns = Curl_hash_pick(data->dns.hostcache, entry_id, entry_len+1);
+  dns = Curl_hash_pick(&data->dns.hostcache->entries, entry_id, entry_len+1);
 
   /* free the allocated entry_id again */
   free(entry_id);
@@ -364,28 +495,21 @@ Curl_fetch_addr(struct connectdata *conn,
   return dns;
 }
 
-/*
- * Curl_cache_addr() stores a 'Curl_addrinfo' struct in the DNS cache.
- *
- * When calling Curl_resolv() has resulted in a response with a returned
- * address, we call this function to store the information in the dns
- * cache etc
- *
- * Returns the Curl_dns_entry entry pointer or NULL if the storage failed.
- */
-struct Curl_dns_entry *
-Curl_cache_addr(struct SessionHandle *data,
-                Curl_addrinfo *addr,
-                const char *hostname,
-                int port)
+/* add an entry for the addresses, or a negative one for NULL */
+static struct Curl_dns_entry *
+cache_entry(struct SessionHandle *data,
+            Curl_addrinfo *addr,
+            const char *hostname,
+            int port)
 {
   char *entry_id;
   size_t entry_len;
   struct Curl_dns_entry *dns;
   struct Curl_dns_entry *dns2;
+  struct Curl_dnscache *cache = data->dns.hostcache;
 
   /* Create an entry id, based upon the hostname and port */
-  entry_id = create_hostcache_id(hostname, port);
+  entry_id = Curl_hostcache_id(hostname, port);
   /* If we can't create the entry id, fail */
   if(!entry_id)
     return NULL;
@@ -404,24 +528,227 @@ Curl_cache_addr(struct SessionHandle *data,
   if(dns->timestamp == 0)
     dns->timestamp = 1;   /* zero indicates that entry isn't in hash table */
 
+  /* the entry keeps the id to remove itself from the cache */
+  dns->id = entry_id;
+
   /* Store the resolved data in our DNS cache. */
-  dns2 = Curl_hash_add(data->dns.hostcache, entry_id, entry_len+1,
-                       (void *)dns);
+  dns2 = Curl_hash_add(&cache->entries, entry_id, entry_len+1, (void *)dns);
   if(!dns2) {
     free(dns);
     free(entry_id);
     return NULL;
   }
 
-  dns = dns2;
-  dns->inuse++;         /* mark entry as in-use */
+  dns_age_link(addr ? &cache->resolved : &cache->failed, dns2, NULL);
+  if(addr)
+    cache->changes++;
 
-  /* free the allocated entry_id */
-  free(entry_id);
+  return dns2;
+}
+
+/*
+ * Curl_cache_addr() stores a 'Curl_addrinfo' struct in the DNS cache.
+ *
+ * When calling Curl_resolv() has resulted in a response with a returned
+ * address, we call this function to store the information in the dns
+ * cache etc
+ *
+ * Returns the Curl_dns_entry entry pointer or NULL if the storage failed.
+ */
+struct Curl_dns_entry *
+Curl_cache_addr(struct SessionHandle *data,
+                Curl_addrinfo *addr,
+                const char *hostname,
+                int port)
+{
+  struct Curl_dns_entry *dns = cache_entry(data, addr, hostname, port);
+
+  if(dns)
+    dns->inuse++;         /* mark entry as in-use */
 
   return dns;
 }
 
+/*
+ * Curl_cache_negative() stores in the DNS cache that a name failed to
+ * resolve, so that lookups of it fail right away until the entry is older
+ * than CURLOPT_DNS_NEGATIVE_CACHE_TIMEOUT. Nothing is stored if memory runs
+ * out. This assumes that a lock has already been taken.
+ */
+void Curl_cache_negative(struct SessionHandle *data,
+                         const char *hostname,
+                         int port)
+{
+  (void)cache_entry(data, NULL, hostname, port);
+}
+
+#ifdef CURLRES_ASYNCH
+/* seconds before a name is resolved in the background again after that
+   failed */
+#define DNS_REFRESH_BACKOFF 5
+
+/*
+ * A background resolve of the name did not get new addresses. The entry is
+ * kept until it expires and may be resolved again after a while.
+ */
+static void dns_refresh_failed(struct SessionHandle *data,
+                               const char *hostname, int port)
+{
+  struct Curl_dns_entry *dns;
+  char *entry_id = Curl_hostcache_id(hostname, port);
+
+  if(!entry_id)
+    return;
+
+  if(data->share)
+    Curl_share_lock(data, CURL_LOCK_DATA_DNS, CURL_LOCK_ACCESS_SINGLE);
+
+  dns = Curl_hash_pick(&data->dns.hostcache->entries, entry_id,
+                       strlen(entry_id)+1);
+  if(dns && dns->refreshing) {
+    dns->refreshing = FALSE;
+    time(&dns->refresh_after);
+    dns->refresh_after += DNS_REFRESH_BACKOFF;
+  }
+
+  if(data->share)
+    Curl_share_unlock(data, CURL_LOCK_DATA_DNS);
+
+  free(entry_id);
+}
+
+/*
+ * dns_refresh() starts resolving a name in the cache again, without making
+ * the transfer that found it wait. The new addresses replace the entry when
+ * they arrive. If the resolve fails, the old entry is kept until it expires.
+ */
+static void dns_refresh(struct connectdata *conn, const char *hostname,
+                        int port)
+{
+  struct SessionHandle *data = conn->data;
+  struct Curl_multi *multi = data->multi;
+  struct Curl_dns_refresh *refresh = NULL;
+  struct SessionHandle *copy;
+  void *resolver = NULL;
+  Curl_addrinfo *addr;
+  int respwait = 0;
+
+  if(!multi)
+    goto fail;
+
+  refresh = calloc(1, sizeof(struct Curl_dns_refresh));
+  if(!refresh)
+    goto fail;
+
+  refresh->hostname = strdup(hostname);
+  refresh->port = port;
+  if(!refresh->hostname || Curl_open(&refresh->data))
+    goto fail;
+  copy = refresh->data;
+
+  /* resolve with the same resolver settings, into the same cache */
+  if(Curl_resolver_duphandle(&resolver, data->state.resolver))
+    goto fail;
+  Curl_resolver_cleanup(copy->state.resolver);
+  copy->state.resolver = resolver;
+  if(data->share &&
+     curl_easy_setopt(copy, CURLOPT_SHARE, data->share))
+    goto fail;
+  copy->dns.hostcache = data->dns.hostcache;
+  copy->dns.hostcachetype = data->dns.hostcachetype;
+
+  refresh->conn = calloc(1, sizeof(struct connectdata));
+  if(!refresh->conn)
+    goto fail;
+  refresh->conn->data = copy;
+  refresh->conn->ip_version = conn->ip_version;
+
+  infof(data, "Resolving %s again in the background\n", hostname);
+
+  /* the resolver may keep what it needs in the multi handle, but the copy
+     must not be seen as one of its easy handles afterwards */
+  copy->multi = multi;
+  addr = Curl_getaddrinfo(refresh->conn, hostname, port, &respwait);
+  copy->multi = NULL;
+
+  if(addr) {
+    /* resolved already */
+    struct Curl_dns_entry *dns;
+
+    if(copy->share)
+      Curl_share_lock(copy, CURL_LOCK_DATA_DNS, CURL_LOCK_ACCESS_SINGLE);
+
+    dns = Curl_cache_addr(copy, addr, hostname, port);
+
+    if(copy->share)
+      Curl_share_unlock(copy, CURL_LOCK_DATA_DNS);
+
+    if(dns) {
+      Curl_resolv_unlock(copy, dns);
+      refresh->done = TRUE;
+    }
+    else
+      Curl_freeaddrinfo(addr);
+  }
+  else if(respwait) {
+    Curl_multi_add_dns_refresh(multi, refresh);
+    return;
+  }
+
+  fail:
+  if(!refresh || !refresh->done)
+    dns_refresh_failed(data, hostname, port);
+  if(refresh) {
+    refresh->done = TRUE;
+    Curl_dns_refresh_free(refresh);
+  }
+}
+
+/*
+ * Curl_dns_refresh_done() checks if a background resolve is over. The
+ * resolver has stored the new addresses in the cache then.
+ */
+bool Curl_dns_refresh_done(struct Curl_dns_refresh *refresh)
+{
+  struct Curl_dns_entry *dns = NULL;
+
+  if(Curl_resolver_is_resolved(refresh->conn, &dns)) {
+    /* failed, the old entry stays until it expires */
+    dns_refresh_failed(refresh->data, refresh->hostname, refresh->port);
+    refresh->done = TRUE;
+    return TRUE;
+  }
+
+  if(!dns)
+    return FALSE;
+
+  refresh->conn->async.dns = NULL;
+  Curl_resolv_unlock(refresh->data, dns);
+  refresh->done = TRUE;
+  return TRUE;
+}
+
+/*
+ * Curl_dns_refresh_free() stops a background resolve and frees it. A
+ * resolve stopped before it is over counts as failed.
+ */
+void Curl_dns_refresh_free(struct Curl_dns_refresh *refresh)
+{
+  if(!refresh->done)
+    dns_refresh_failed(refresh->data, refresh->hostname, refresh->port);
+  if(refresh->conn) {
+    Curl_resolver_cancel(refresh->conn);
+    free(refresh->conn);
+  }
+  Curl_close(refresh->data);
+  free(refresh->hostname);
+  free(refresh);
+}
+#else
+/* without an asynch resolver, names are not resolved in the background */
+#define dns_refresh(x,y,z) Curl_nop_stmt
+#endif /* CURLRES_ASYNCH */
+
 /*
  * Curl_resolv() is the main name resolve function within libcurl. It resolves
  * a name and returns a pointer to the entry in the 'entry' argument (if one
@@ -452,6 +779,8 @@ int Curl_resolv(struct connectdata *conn,
   struct SessionHandle *data = conn->data;
   CURLcode result;
   int rc = CURLRESOLV_ERROR; /* default to failure */
+  bool negative = FALSE;
+  bool refresh = FALSE;
 
   *entry = NULL;
 
@@ -460,16 +789,27 @@ int Curl_resolv(struct connectdata *conn,
 
   dns = Curl_fetch_addr(conn, hostname, port);
 
-  if(dns) {
+  if(dns && !dns->addr) {
+    infof(data, "Hostname %s was found in DNS cache as not resolving\n",
+          hostname);
+    negative = TRUE;
+    dns = NULL;
+  }
+  else if(dns) {
     infof(data, "Hostname %s was found in DNS cache\n", hostname);
     dns->inuse++; /* we use it! */
     rc = CURLRESOLV_RESOLVED;
+    if(wants_refresh(data, dns))
+      refresh = dns->refreshing = TRUE;
   }
 
   if(data->share)
     Curl_share_unlock(data, CURL_LOCK_DATA_DNS);
 
-  if(!dns) {
+  if(refresh)
+    dns_refresh(conn, hostname, port);
+
+  if(!dns && !negative) {
     /* The entry was not in the cache. Resolve it to IP address */
 
     Curl_addrinfo *addr;
@@ -504,6 +844,16 @@ int Curl_resolv(struct connectdata *conn,
         else
           rc = CURLRESOLV_PENDING; /* no info yet */
       }
+      else if(data->set.dns_negative_timeout) {
+        /* remember that the name doesn't resolve */
+        if(data->share)
+          Curl_share_lock(data, CURL_LOCK_DATA_DNS, CURL_LOCK_ACCESS_SINGLE);
+
+        Curl_cache_negative(data, hostname, port);
+
+        if(data->share)
+          Curl_share_unlock(data, CURL_LOCK_DATA_DNS);
+      }
     }
     else {
       if(data->share)
@@ -729,6 +1079,7 @@ void Curl_resolv_unlock(struct SessionHandle *data, struct Curl_dns_entry *dns)
      0) */
   if(dns->inuse == 0 && dns->timestamp == 0) {
     Curl_freeaddrinfo(dns->addr);
+    free(dns->id);
     free(dns);
   }
 
@@ -745,8 +1096,10 @@ static void freednsentry(void *freethis)
 
   /* mark the entry as not in hostcache */
   p->timestamp = 0;
+  dns_age_unlink(p);
   if(p->inuse == 0) {
     Curl_freeaddrinfo(p->addr);
+    free(p->id);
     free(p);
   }
 }
@@ -754,9 +1107,26 @@ static void freednsentry(void *freethis)
 /*
  * Curl_mk_dnscache() creates a new DNS cache and returns the handle for it.
  */
-struct curl_hash *Curl_mk_dnscache(void)
+struct Curl_dnscache *Curl_mk_dnscache(void)
+{
+  struct Curl_dnscache *cache = malloc(sizeof(struct Curl_dnscache));
+
+  if(cache && dnscache_init(cache)) {
+    free(cache);
+    cache = NULL;
+  }
+  return cache;
+}
+
+/*
+ * Curl_hostcache_destroy() frees a cache made with Curl_mk_dnscache().
+ */
+void Curl_hostcache_destroy(struct Curl_dnscache *cache)
 {
-  return Curl_hash_alloc(7, Curl_hash_str, Curl_str_key_compare, freednsentry);
+  if(cache) {
+    Curl_hash_clean(&cache->entries);
+    free(cache);
+  }
 }
 
 static int hostcache_inuse(void *data, void *hc)
@@ -777,16 +1147,83 @@ static int hostcache_inuse(void *data, void *hc)
  */
 
 void Curl_hostcache_clean(struct SessionHandle *data,
-                          struct curl_hash *hash)
+                          struct Curl_dnscache *cache)
 {
   /* Entries added to the hostcache with the CURLOPT_RESOLVE function are
    * still present in the cache with the inuse counter set to 1. Detect them
    * and cleanup!
    */
-  Curl_hash_clean_with_criterium(hash, data, hostcache_inuse);
+  Curl_hash_clean_with_criterium(&cache->entries, data, hostcache_inuse);
 }
 
 
+/*
+ * hostpair_add() puts addresses for a host name and port number in the DNS
+ * cache, unless the cache already has addresses for them. A zero 'timestamp'
+ * adds an entry for CURLOPT_RESOLVE that never expires, others age from the
+ * given time and are put in the age list with 'cursor', see dns_age_link().
+ * 'addr' is freed if it isn't used. This assumes that a lock has already
+ * been taken.
+ *
+ * Returns TRUE in '*added' when the entry was stored.
+ */
+static CURLcode hostpair_add(struct SessionHandle *data,
+                             const char *hostname, int port,
+                             Curl_addrinfo *addr, time_t timestamp,
+                             struct Curl_dns_entry **cursor, bool *added)
+{
+  struct Curl_dns_entry *dns;
+  char *entry_id;
+  size_t entry_len;
+
+  *added = FALSE;
+
+  /* Create an entry id, based upon the hostname and port */
+  entry_id = Curl_hostcache_id(hostname, port);
+  /* If we can't create the entry id, fail */
+  if(!entry_id) {
+    Curl_freeaddrinfo(addr);
+    return CURLE_OUT_OF_MEMORY;
+  }
+
+  entry_len = strlen(entry_id);
+
+  /* See if its already in our dns cache */
+  dns = Curl_hash_pick(&data->dns.hostcache->entries, entry_id, entry_len+1);
+
+  /* free the allocated entry_id again */
+  free(entry_id);
+
+  if(!dns || !dns->addr) {
+    /* if not in the cache already, or only known not to resolve, put
+       this host in the cache */
+    dns = cache_entry(data, addr, hostname, port);
+    if(dns) {
+      dns_age_unlink(dns);
+      if(timestamp) {
+        /* it ages from the given time, which moves it in the list */
+        dns->timestamp = timestamp;
+        dns_age_link(&data->dns.hostcache->resolved, dns, cursor);
+      }
+      else {
+        /* kept in use so that it is never pruned */
+        dns->inuse++;
+        dns->pinned = TRUE;
+      }
+      *added = TRUE;
+    }
+  }
+  else
+    /* this is a duplicate, free it again */
+    Curl_freeaddrinfo(addr);
+
+  if(!dns) {
+    Curl_freeaddrinfo(addr);
+    return CURLE_OUT_OF_MEMORY;
+  }
+  return CURLE_OK;
+}
+
 CURLcode Curl_loadhostpairs(struct SessionHandle *data)
 {
   struct curl_slist *hostp;
@@ -802,10 +1239,9 @@ CURLcode Curl_loadhostpairs(struct SessionHandle *data)
     }
     else if(3 == sscanf(hostp->data, "%255[^:]:%d:%255s", hostname, &port,
                         address)) {
-      struct Curl_dns_entry *dns;
       Curl_addrinfo *addr;
-      char *entry_id;
-      size_t entry_len;
+      CURLcode result;
+      bool added;
 
       addr = Curl_str2addr(address, port);
       if(!addr) {
@@ -813,39 +1249,16 @@ CURLcode Curl_loadhostpairs(struct SessionHandle *data)
         continue;
       }
 
-      /* Create an entry id, based upon the hostname and port */
-      entry_id = create_hostcache_id(hostname, port);
-      /* If we can't create the entry id, fail */
-      if(!entry_id) {
-        Curl_freeaddrinfo(addr);
-        return CURLE_OUT_OF_MEMORY;
-      }
-
-      entry_len = strlen(entry_id);
-
       if(data->share)
         Curl_share_lock(data, CURL_LOCK_DATA_DNS, CURL_LOCK_ACCESS_SINGLE);
 
-      /* See if its already in our dns cache */
-      dns = Curl_hash_pick(data->dns.hostcache, entry_id, entry_len+1);
-
-      /* free the allocated entry_id again */
-      free(entry_id);
-
-      if(!dns)
-        /* if not in the cache already, put this host in the cache */
-        dns = Curl_cache_addr(data, addr, hostname, port);
-      else
-        /* this is a duplicate, free it again */
-        Curl_freeaddrinfo(addr);
+      result = hostpair_add(data, hostname, port, addr, 0, NULL, &added);
 
       if(data->share)
         Curl_share_unlock(data, CURL_LOCK_DATA_DNS);
 
-      if(!dns) {
-        Curl_freeaddrinfo(addr);
-        return CURLE_OUT_OF_MEMORY;
-      }
+      if(result)
+        return result;
       infof(data, "Added %s:%d:%s to DNS cache\n",
             hostname, port, address);
     }
@@ -854,3 +1267,290 @@ CURLcode Curl_loadhostpairs(struct SessionHandle *data)
 
   return CURLE_OK;
 }
+
+/* a name read from the DNS cache file */
+struct hostfile_entry {
+  long stamp;
+  int port;
+  char *name;
+  Curl_addrinfo *addr;
+};
+
+/* qsort() callback putting the names from the file in timestamp order */
+static int hostfile_cmp(const void *p1, const void *p2)
+{
+  long s1 = ((const struct hostfile_entry *)p1)->stamp;
+  long s2 = ((const struct hostfile_entry *)p2)->stamp;
+
+  return (s1 < s2) ? -1 : (s1 > s2);
+}
+
+/*
+ * Curl_hostcache_load()
+ *
+ * Adds the names in the CURLOPT_DNS_CACHE_FILE file to the DNS cache. Each
+ * line has the time the name was resolved, followed by the name, port number
+ * and addresses in the CURLOPT_RESOLVE format with the addresses separated
+ * by commas:
+ *
+ *   1424131200 example.com:80:192.0.2.1,2001:db8::1
+ *
+ * Names that are too old to be used with the handle's DNS cache timeout are
+ * skipped, the others expire as if they had been resolved at that time. A
+ * file that can't be read or a line that can't be parsed is ignored.
+ *
+ * The names are sorted by time before they are added, so that they go into
+ * the cache's age list in a single walk.
+ */
+CURLcode Curl_hostcache_load(struct SessionHandle *data)
+{
+  const char *file = data->set.str[STRING_DNS_CACHE_FILE];
+  long lifetime = cache_lifetime(data);
+  struct hostfile_entry *list = NULL;
+  struct Curl_dns_entry *cursor = NULL;
+  size_t num = 0;
+  size_t alloc = 0;
+  size_t i;
+  char line[1024];
+  int added = 0;
+  CURLcode result = CURLE_OK;
+  time_t now;
+  FILE *fp;
+
+  data->state.dns_file_loaded = TRUE;
+
+  if(!file || !data->dns.hostcache)
+    return CURLE_OK;
+
+  fp = fopen(file, "r");
+  if(!fp) {
+    infof(data, "Could not read DNS cache file %s\n", file);
+    return CURLE_OK;
+  }
+
+  time(&now);
+  while(fgets(line, sizeof(line), fp)) {
+    char hostname[256];
+    Curl_addrinfo *addr = NULL;
+    Curl_addrinfo *last = NULL;
+    char *ptr;
+    char *end;
+    long stamp;
+    int port;
+    int offset = 0;
+    bool ok = TRUE;
+    bool fresh;
+
+    end = strchr(line, '\n');
+    if(!end) {
+      /* too long to be ours, skip the rest of it */
+      int c;
+      do
+        c = getc(fp);
+      while((c != EOF) && (c != '\n'));
+      continue;
+    }
+    /* cut off trailing white space */
+    while((end > line) && ISSPACE(end[-1]))
+      end--;
+    *end = 0;
+
+    if((line[0] == '#') ||
+       (sscanf(line, "%ld %255[^:]:%d:%n", &stamp, hostname, &port,
+               &offset) != 3) || !offset || (stamp <= 0) ||
+       (port < 0) || (port > 65535))
+      continue;
+
+    /* an entry from the future is treated as resolved now */
+    if(stamp > (long)now)
+      stamp = (long)now;
+    fresh = (lifetime == -1) || ((long)now - stamp < lifetime);
+    if(!fresh)
+      continue;
+
+    /* the comma separated addresses */
+    for(ptr = &line[offset]; ok && *ptr; ) {
+      Curl_addrinfo *ai;
+      char *comma = strchr(ptr, ',');
+      if(comma)
+        *comma = 0;
+      ai = Curl_str2addr(ptr, port);
+      if(ai) {
+        if(last)
+          last->ai_next = ai;
+        else
+          addr = ai;
+        last = ai;
+      }
+      else
+        ok = FALSE;
+      ptr = comma ? comma + 1 : ptr + strlen(ptr);
+    }
+
+    if(!ok || !addr) {
+      Curl_freeaddrinfo(addr);
+      continue;
+    }
+
+    if(num == alloc) {
+      struct hostfile_entry *bigger;
+      alloc = alloc ? alloc * 2 : 32;
+      bigger = realloc(list, alloc * sizeof(struct hostfile_entry));
+      if(!bigger) {
+        Curl_freeaddrinfo(addr);
+        result = CURLE_OUT_OF_MEMORY;
+        break;
+      }
+      list = bigger;
+    }
+    list[num].name = strdup(hostname);
+    if(!list[num].name) {
+      Curl_freeaddrinfo(addr);
+      result = CURLE_OUT_OF_MEMORY;
+      break;
+    }
+    list[num].stamp = stamp;
+    list[num].port = port;
+    list[num].addr = addr;
+    num++;
+  }
+  fclose(fp);
+
+  if(!result) {
+    qsort(list, num, sizeof(struct hostfile_entry), hostfile_cmp);
+
+    if(data->share)
+      Curl_share_lock(data, CURL_LOCK_DATA_DNS, CURL_LOCK_ACCESS_SINGLE);
+
+    for(i = 0; (i < num) && !result; i++) {
+      bool stored;
+      result = hostpair_add(data, list[i].name, list[i].port, list[i].addr,
+                            (time_t)list[i].stamp, &cursor, &stored);
+      list[i].addr = NULL; /* freed or stored by hostpair_add() */
+      if(stored)
+        added++;
+    }
+
+    /* the names added from the file don't need to be written back */
+    data->state.dns_file_changes = data->dns.hostcache->changes;
+
+    if(data->share)
+      Curl_share_unlock(data, CURL_LOCK_DATA_DNS);
+  }
+
+  for(i = 0; i < num; i++) {
+    Curl_freeaddrinfo(list[i].addr);
+    free(list[i].name);
+  }
+  free(list);
+
+  if(!result)
+    infof(data, "Added %d names from DNS cache file %s\n", added, file);
+  return result;
+}
+
+/*
+ * Curl_hostcache_save()
+ *
+ * Writes the names in the DNS cache that have addresses and have not expired
+ * to the CURLOPT_DNS_CACHE_FILE file, in the format Curl_hostcache_load()
+ * reads and oldest first. Names added with CURLOPT_RESOLVE are not written.
+ * Nothing is done if no names were added to the cache since this handle
+ * last read or wrote the file.
+ *
+ * The names are written to a temporary file that then replaces the old one,
+ * so that the file is complete even if this is interrupted or several
+ * handles and programs write it at once.
+ */
+void Curl_hostcache_save(struct SessionHandle *data)
+{
+  const char *file = data->set.str[STRING_DNS_CACHE_FILE];
+  long lifetime = cache_lifetime(data);
+  struct Curl_dnscache *cache = data->dns.hostcache;
+  struct Curl_dns_entry *dns;
+  struct timeval tv;
+  unsigned long changes;
+  char *tempfile;
+  time_t now;
+  FILE *fp;
+  bool fail = FALSE;
+
+  if(!file || !cache)
+    return;
+
+  if(data->share)
+    Curl_share_lock(data, CURL_LOCK_DATA_DNS, CURL_LOCK_ACCESS_SINGLE);
+  changes = cache->changes;
+  if(data->share)
+    Curl_share_unlock(data, CURL_LOCK_DATA_DNS);
+
+  if(changes == data->state.dns_file_changes)
+    return;
+
+  /* unique for this handle at this time */
+  tv = Curl_tvnow();
+  tempfile = aprintf("%s.%lx.%lx.tmp", file, (unsigned long)(size_t)data,
+                     (unsigned long)tv.tv_sec ^ (unsigned long)tv.tv_usec);
+  if(!tempfile)
+    return;
+
+  fp = fopen(tempfile, "w");
+  if(!fp) {
+    infof(data, "Could not write DNS cache file %s\n", tempfile);
+    free(tempfile);
+    return;
+  }
+
+  fputs("# libcurl DNS cache\n"
+        "# This file was generated by libcurl! Edit at your own risk.\n\n",
+        fp);
+
+  time(&now);
+
+  if(data->share)
+    Curl_share_lock(data, CURL_LOCK_DATA_DNS, CURL_LOCK_ACCESS_SINGLE);
+
+  changes = cache->changes;
+  for(dns = cache->resolved.oldest; dns; dns = dns->newer) {
+    Curl_addrinfo *ai;
+    char buf[MAX_IPADR_LEN];
+    const char *sep = "";
+
+    if((lifetime != -1) && (now - dns->timestamp >= lifetime))
+      continue;
+
+    /* the id is the lower cased name and the port number */
+    fprintf(fp, "%ld %s:", (long)dns->timestamp, dns->id);
+    for(ai = dns->addr; ai; ai = ai->ai_next) {
+      if(Curl_printable_address(ai, buf, sizeof(buf))) {
+        fprintf(fp, "%s%s", sep, buf);
+        sep = ",";
+      }
+    }
+    fputs("\n", fp);
+  }
+
+  if(data->share)
+    Curl_share_unlock(data, CURL_LOCK_DATA_DNS);
+
+  if(ferror(fp))
+    fail = TRUE;
+  if(fclose(fp))
+    fail = TRUE;
+
+  if(!fail && rename(tempfile, file)) {
+    /* rename() doesn't replace an existing file everywhere */
+    unlink(file);
+    if(rename(tempfile, file))
+      fail = TRUE;
+  }
+
+  if(fail) {
+    infof(data, "Could not write DNS cache file %s\n", file);
+    unlink(tempfile);
+  }
+  else
+    data->state.dns_file_changes = changes;
+
+  free(tempfile);
+}
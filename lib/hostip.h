@@ -58,20 +58,75 @@ struct connectdata;
  * Global DNS cache is general badness. Do not use. This will be removed in
  * a future version. Use the share interface instead!
  *
- * Returns a struct curl_hash pointer on success, NULL on failure.
+ * Returns a struct Curl_dnscache pointer on success, NULL on failure.
  */
-struct curl_hash *Curl_global_host_cache_init(void);
+struct Curl_dnscache *Curl_global_host_cache_init(void);
 void Curl_global_host_cache_dtor(void);
 
 struct Curl_dns_entry {
-  Curl_addrinfo *addr;
+  Curl_addrinfo *addr; /* NULL for a name that failed to resolve */
   /* timestamp == 0 -- entry not in hostcache
      timestamp != 0 -- entry is in hostcache */
   time_t timestamp;
   long inuse;      /* use-counter, make very sure you decrease this
                       when you're done using the address you received */
+  bool refreshing; /* a background resolve of the name is running */
+  time_t refresh_after; /* no new background resolve before this time, set
+                           when one failed */
+  bool pinned;     /* added with CURLOPT_RESOLVE, never refreshed */
+  char *id;        /* the key in the cache, see Curl_hostcache_id() */
+  struct Curl_dns_age *age;    /* list the entry is in, NULL if none */
+  struct Curl_dns_entry *older; /* neighbours in the 'age' list */
+  struct Curl_dns_entry *newer;
 };
 
+/* cache entries ordered by timestamp, the oldest expires first */
+struct Curl_dns_age {
+  struct Curl_dns_entry *oldest;
+  struct Curl_dns_entry *newest;
+};
+
+/*
+ * A DNS cache. The entries are found by name in the hash, and are also kept
+ * in age order so that pruning stops at the first entry that has not
+ * expired. Names resolved and names that failed to resolve have different
+ * timeouts and are kept in separate lists. Entries added with
+ * CURLOPT_RESOLVE never expire and are in neither.
+ */
+struct Curl_dnscache {
+  struct curl_hash entries;
+  struct Curl_dns_age resolved;
+  struct Curl_dns_age failed;
+  unsigned long changes; /* counts the names resolved into the cache */
+};
+
+/*
+ * A background resolve of a name that is in the DNS cache already, started
+ * by Curl_resolv() when the entry is about to expire or is used stale. It
+ * has a private handle so that it can outlive the transfer that started it.
+ * The multi handle keeps a list of them and polls them with
+ * Curl_dns_refresh_done().
+ */
+struct Curl_dns_refresh {
+  struct Curl_dns_refresh *next;
+  struct SessionHandle *data; /* private handle doing the resolve */
+  struct connectdata *conn;   /* only used for resolving */
+  char *hostname;             /* the name and port resolved */
+  int port;
+  bool done;                  /* the resolve is over, good or bad */
+};
+
+#ifdef CURLRES_ASYNCH
+/* returns TRUE when the background resolve is over, good or bad */
+bool Curl_dns_refresh_done(struct Curl_dns_refresh *refresh);
+/* stops the background resolve if still running and frees it */
+void Curl_dns_refresh_free(struct Curl_dns_refresh *refresh);
+#else
+/* there are no background resolves without an asynch resolver */
+#define Curl_dns_refresh_done(x) TRUE
+#define Curl_dns_refresh_free(x) Curl_nop_stmt
+#endif
+
 /*
  * Curl_resolv() returns an entry with the info for the specified host
  * and port.
@@ -126,11 +181,14 @@ void Curl_resolv_unlock(struct SessionHandle *data,
 void Curl_scan_cache_used(void *user, void *ptr);
 
 /* make a new dns cache and return the handle */
-struct curl_hash *Curl_mk_dnscache(void);
+struct Curl_dnscache *Curl_mk_dnscache(void);
 
 /* prune old entries from the DNS cache */
 void Curl_hostcache_prune(struct SessionHandle *data);
 
+/* the allocated DNS cache key for a host name and port number */
+char *Curl_hostcache_id(const char *name, int port);
+
 /* Return # of adresses in a Curl_addrinfo struct */
 int Curl_num_addresses (const Curl_addrinfo *addr);
 
@@ -189,6 +247,13 @@ struct Curl_dns_entry *
 Curl_cache_addr(struct SessionHandle *data, Curl_addrinfo *addr,
                 const char *hostname, int port);
 
+/*
+ * Curl_cache_negative() stores in the DNS cache that a name failed to
+ * resolve.
+ */
+void Curl_cache_negative(struct SessionHandle *data,
+                         const char *hostname, int port);
+
 #ifndef INADDR_NONE
 #define CURL_INADDR_NONE (in_addr_t) ~0
 #else
@@ -233,16 +298,24 @@ CURLcode Curl_set_dns_local_ip6(struct SessionHandle *data,
 /*
  * Clean off entries from the cache
  */
-void Curl_hostcache_clean(struct SessionHandle *data, struct curl_hash *hash);
+void Curl_hostcache_clean(struct SessionHandle *data,
+                          struct Curl_dnscache *cache);
 
 /*
- * Destroy the hostcache of this handle.
+ * Free a DNS cache made with Curl_mk_dnscache().
  */
-void Curl_hostcache_destroy(struct SessionHandle *data);
+void Curl_hostcache_destroy(struct Curl_dnscache *cache);
 
 /*
  * Populate the cache with specified entries from CURLOPT_RESOLVE.
  */
 CURLcode Curl_loadhostpairs(struct SessionHandle *data);
 
+/*
+ * Populate the cache from the CURLOPT_DNS_CACHE_FILE file, and write the
+ * cache to it.
+ */
+CURLcode Curl_hostcache_load(struct SessionHandle *data);
+void Curl_hostcache_save(struct SessionHandle *data);
+
 #endif /* HEADER_CURL_HOSTIP_H */
@@ -211,17 +211,14 @@ char *Curl_checkProxyheaders(const struct connectdata *conn,
 }
 
 /*
- * Strip off leading and trailing whitespace from the value in the
- * given HTTP header line and return a strdupped copy. Returns NULL in
- * case of allocation failure. Returns an empty string if the header value
- * consists entirely of whitespace.
+ * Find the value in the given HTTP header line with leading and trailing
+ * whitespace stripped off. Returns a pointer to the start of the value and
+ * stores its length in *lenp.
  */
-char *Curl_copy_header_value(const char *header)
+static const char *header_value(const char *header, size_t *lenp)
 {
   const char *start;
   const char *end;
-  char *value;
-  size_t len;
 
   DEBUGASSERT(header);
 
@@ -253,7 +250,25 @@ char *Curl_copy_header_value(const char *header)
     end--;
 
   /* get length of the type */
-  len = end - start + 1;
+  *lenp = end - start + 1;
+  return start;
+}
+
+/*
+ * Strip off leading and trailing whitespace from the value in the
+ * given HTTP header line and return a strdupped copy. Returns NULL in
+ * case of allocation failure. Returns an empty string if the header value
+ * consists entirely of whitespace.
+ */
+char *Curl_copy_header_value(const char *header)
+{
+  const char *start;
+  char *value;
+  size_t len;
+
+  start = header_value(header, &len);
+  if(!start)
+    return NULL;
 
   value = malloc(len + 1);
   if(!value)
@@ -265,6 +280,22 @@ char *Curl_copy_header_value(const char *header)
   return value;
 }
 
+/*
+ * Like Curl_copy_header_value() but the copy is made in the request arena,
+ * for values that are not needed once the request is done.
+ */
+static char *copy_header_value(struct Curl_arena *arena, const char *header)
+{
+  const char *start;
+  size_t len;
+
+  start = header_value(header, &len);
+  if(!start)
+    return NULL;
+
+  return Curl_arena_memdup(arena, start, len);
+}
+
 /*
  * http_output_basic() sets up an Authorization: header (or the proxy version)
  * for HTTP Basic authentication.
@@ -1655,7 +1686,7 @@ CURLcode Curl_add_custom_headers(struct connectdata *conn,
         if(*ptr) {
           /* only send this if the contents was non-blank */
 
-          if(conn->allocptr.host &&
+          if(data->state.aptr.host &&
              /* a Host: header was sent already, don't pass on any custom Host:
                 header as that will produce *two* in the same request! */
              checkprefix("Host:", headers->data))
@@ -1669,7 +1700,7 @@ CURLcode Curl_add_custom_headers(struct connectdata *conn,
                      we will force length zero then */
                   checkprefix("Content-Length", headers->data))
             ;
-          else if(conn->allocptr.te &&
+          else if(data->state.aptr.te &&
                   /* when asking for Transfer-Encoding, don't pass on a custom
                      Connection: */
                   checkprefix("Connection", headers->data))
@@ -1896,14 +1927,15 @@ CURLcode Curl_http(struct connectdata *conn, bool *done)
   else
     conn->bits.authneg = FALSE;
 
-  Curl_safefree(conn->allocptr.ref);
   if(data->change.referer && !Curl_checkheaders(conn, "Referer:")) {
-    conn->allocptr.ref = aprintf("Referer: %s\r\n", data->change.referer);
-    if(!conn->allocptr.ref)
+    data->state.aptr.ref = Curl_arena_aprintf(&data->state.arena,
+                                              "Referer: %s\r\n",
+                                              data->change.referer);
+    if(!data->state.aptr.ref)
       return CURLE_OUT_OF_MEMORY;
   }
   else
-    conn->allocptr.ref = NULL;
+    data->state.aptr.ref = NULL;
 
 #if !defined(CURL_DISABLE_COOKIES)
   if(data->set.str[STRING_COOKIE] && !Curl_checkheaders(conn, "Cookie:"))
@@ -1912,10 +1944,10 @@ CURLcode Curl_http(struct connectdata *conn, bool *done)
 
   if(!Curl_checkheaders(conn, "Accept-Encoding:") &&
      data->set.str[STRING_ENCODING]) {
-    Curl_safefree(conn->allocptr.accept_encoding);
-    conn->allocptr.accept_encoding =
-      aprintf("Accept-Encoding: %s\r\n", data->set.str[STRING_ENCODING]);
-    if(!conn->allocptr.accept_encoding)
+    data->state.aptr.accept_encoding =
+      Curl_arena_aprintf(&data->state.arena, "Accept-Encoding: %s\r\n",
+                         data->set.str[STRING_ENCODING]);
+    if(!data->state.aptr.accept_encoding)
       return CURLE_OUT_OF_MEMORY;
   }
 
@@ -1932,13 +1964,12 @@ CURLcode Curl_http(struct connectdata *conn, bool *done)
     char *cptr = Curl_checkheaders(conn, "Connection:");
 #define TE_HEADER "TE: gzip\r\n"
 
-    Curl_safefree(conn->allocptr.te);
-
     /* Create the (updated) Connection: header */
-    conn->allocptr.te = cptr? aprintf("%s, TE\r\n" TE_HEADER, cptr):
-      strdup("Connection: TE\r\n" TE_HEADER);
+    data->state.aptr.te = cptr?
+      Curl_arena_aprintf(&data->state.arena, "%s, TE\r\n" TE_HEADER, cptr):
+      Curl_arena_strdup(&data->state.arena, "Connection: TE\r\n" TE_HEADER);
 
-    if(!conn->allocptr.te)
+    if(!data->state.aptr.te)
       return CURLE_OUT_OF_MEMORY;
   }
 #endif
@@ -1979,7 +2010,7 @@ CURLcode Curl_http(struct connectdata *conn, bool *done)
     }
   }
 
-  Curl_safefree(conn->allocptr.host);
+  data->state.aptr.host = NULL;
 
   ptr = Curl_checkheaders(conn, "Host:");
   if(ptr && (!data->state.this_is_a_follow ||
@@ -1990,21 +2021,19 @@ CURLcode Curl_http(struct connectdata *conn, bool *done)
        custom Host: header if this is NOT a redirect, as setting Host: in the
        redirected request is being out on thin ice. Except if the host name
        is the same as the first one! */
-    char *cookiehost = Curl_copy_header_value(ptr);
+    char *cookiehost = copy_header_value(&data->state.arena, ptr);
     if(!cookiehost)
       return CURLE_OUT_OF_MEMORY;
-    if(!*cookiehost)
-      /* ignore empty data */
-      free(cookiehost);
-    else {
+    if(*cookiehost) {
+      /* empty data is ignored */
       /* If the host begins with '[', we start searching for the port after
          the bracket has been closed */
       int startsearch = 0;
       if(*cookiehost == '[') {
         char *closingbracket;
-        /* since the 'cookiehost' is an allocated memory area that will be
-           freed later we cannot simply increment the pointer */
-        memmove(cookiehost, cookiehost + 1, strlen(cookiehost) - 1);
+        /* the arena frees the whole area later, so we can simply increment
+           the pointer */
+        cookiehost++;
         closingbracket = strchr(cookiehost, ']');
         if(closingbracket)
           *closingbracket = 0;
@@ -2014,12 +2043,9 @@ CURLcode Curl_http(struct connectdata *conn, bool *done)
         if(colon)
           *colon = 0; /* The host must not include an embedded port number */
       }
-      Curl_safefree(conn->allocptr.cookiehost);
-      conn->allocptr.cookiehost = cookiehost;
+      data->state.aptr.cookiehost = cookiehost;
     }
 #endif
-
-    conn->allocptr.host = NULL;
   }
   else {
     /* When building Host: headers, we must put the host name within
@@ -2031,18 +2057,20 @@ CURLcode Curl_http(struct connectdata *conn, bool *done)
         (conn->remote_port == PORT_HTTP)) )
       /* if(HTTPS on port 443) OR (HTTP on port 80) then don't include
          the port number in the host string */
-      conn->allocptr.host = aprintf("Host: %s%s%s\r\n",
-                                    conn->bits.ipv6_ip?"[":"",
-                                    host,
-                                    conn->bits.ipv6_ip?"]":"");
+      data->state.aptr.host = Curl_arena_aprintf(&data->state.arena,
+                                                 "Host: %s%s%s\r\n",
+                                                 conn->bits.ipv6_ip?"[":"",
+                                                 host,
+                                                 conn->bits.ipv6_ip?"]":"");
     else
-      conn->allocptr.host = aprintf("Host: %s%s%s:%hu\r\n",
-                                    conn->bits.ipv6_ip?"[":"",
-                                    host,
-                                    conn->bits.ipv6_ip?"]":"",
-                                    conn->remote_port);
-
-    if(!conn->allocptr.host)
+      data->state.aptr.host = Curl_arena_aprintf(&data->state.arena,
+                                                 "Host: %s%s%s:%hu\r\n",
+                                                 conn->bits.ipv6_ip?"[":"",
+                                                 host,
+                                                 conn->bits.ipv6_ip?"]":"",
+                                                 conn->remote_port);
+
+    if(!data->state.aptr.host)
       /* without Host: we can't make a nice request */
       return CURLE_OUT_OF_MEMORY;
   }
@@ -2213,47 +2241,46 @@ CURLcode Curl_http(struct connectdata *conn, bool *done)
      */
     if(((httpreq == HTTPREQ_GET) || (httpreq == HTTPREQ_HEAD)) &&
        !Curl_checkheaders(conn, "Range:")) {
-      /* if a line like this was already allocated, free the previous one */
-      if(conn->allocptr.rangeline)
-        free(conn->allocptr.rangeline);
-      conn->allocptr.rangeline = aprintf("Range: bytes=%s\r\n",
-                                         data->state.range);
+      data->state.aptr.rangeline = Curl_arena_aprintf(&data->state.arena,
+                                                      "Range: bytes=%s\r\n",
+                                                      data->state.range);
     }
     else if((httpreq != HTTPREQ_GET) &&
             !Curl_checkheaders(conn, "Content-Range:")) {
 
-      /* if a line like this was already allocated, free the previous one */
-      if(conn->allocptr.rangeline)
-        free(conn->allocptr.rangeline);
-
       if(data->set.set_resume_from < 0) {
         /* Upload resume was asked for, but we don't know the size of the
            remote part so we tell the server (and act accordingly) that we
            upload the whole file (again) */
-        conn->allocptr.rangeline =
-          aprintf("Content-Range: bytes 0-%" CURL_FORMAT_CURL_OFF_T
-                  "/%" CURL_FORMAT_CURL_OFF_T "\r\n",
-                  data->state.infilesize - 1, data->state.infilesize);
+        data->state.aptr.rangeline =
+          Curl_arena_aprintf(&data->state.arena,
+                             "Content-Range: bytes 0-%" CURL_FORMAT_CURL_OFF_T
+                             "/%" CURL_FORMAT_CURL_OFF_T "\r\n",
+                             data->state.infilesize - 1,
+                             data->state.infilesize);
 
       }
       else if(data->state.resume_from) {
         /* This is because "resume" was selected */
         curl_off_t total_expected_size=
           data->state.resume_from + data->state.infilesize;
-        conn->allocptr.rangeline =
-          aprintf("Content-Range: bytes %s%" CURL_FORMAT_CURL_OFF_T
-                  "/%" CURL_FORMAT_CURL_OFF_T "\r\n",
-                  data->state.range, total_expected_size-1,
-                  total_expected_size);
+        data->state.aptr.rangeline =
+          Curl_arena_aprintf(&data->state.arena,
+                             "Content-Range: bytes %s%" CURL_FORMAT_CURL_OFF_T
+                             "/%" CURL_FORMAT_CURL_OFF_T "\r\n",
+                             data->state.range, total_expected_size-1,
+                             total_expected_size);
       }
       else {
         /* Range was selected and then we just pass the incoming range and
            append total size */
-        conn->allocptr.rangeline =
-          aprintf("Content-Range: bytes %s/%" CURL_FORMAT_CURL_OFF_T "\r\n",
-                  data->state.range, data->state.infilesize);
+        data->state.aptr.rangeline =
+          Curl_arena_aprintf(&data->state.arena,
+                             "Content-Range: bytes %s/%" CURL_FORMAT_CURL_OFF_T
+                             "\r\n", data->state.range,
+                             data->state.infilesize);
       }
-      if(!conn->allocptr.rangeline)
+      if(!data->state.aptr.rangeline)
         return CURLE_OUT_OF_MEMORY;
     }
   }
@@ -2305,21 +2332,21 @@ CURLcode Curl_http(struct connectdata *conn, bool *done)
                      conn->allocptr.proxyuserpwd?
                      conn->allocptr.proxyuserpwd:"",
                      conn->allocptr.userpwd?conn->allocptr.userpwd:"",
-                     (data->state.use_range && conn->allocptr.rangeline)?
-                     conn->allocptr.rangeline:"",
+                     (data->state.use_range && data->state.aptr.rangeline)?
+                     data->state.aptr.rangeline:"",
                      (data->set.str[STRING_USERAGENT] &&
                       *data->set.str[STRING_USERAGENT] &&
                       conn->allocptr.uagent)?
                      conn->allocptr.uagent:"",
-                     (conn->allocptr.host?conn->allocptr.host:""),
+                     (data->state.aptr.host?data->state.aptr.host:""),
                      http->p_accept?http->p_accept:"",
-                     conn->allocptr.te?conn->allocptr.te:"",
+                     data->state.aptr.te?data->state.aptr.te:"",
                      (data->set.str[STRING_ENCODING] &&
                       *data->set.str[STRING_ENCODING] &&
-                      conn->allocptr.accept_encoding)?
-                     conn->allocptr.accept_encoding:"",
-                     (data->change.referer && conn->allocptr.ref)?
-                     conn->allocptr.ref:"" /* Referer: <data> */,
+                      data->state.aptr.accept_encoding)?
+                     data->state.aptr.accept_encoding:"",
+                     (data->change.referer && data->state.aptr.ref)?
+                     data->state.aptr.ref:"" /* Referer: <data> */,
                      (conn->bits.httpproxy &&
                       !conn->bits.tunnel_proxy &&
                       !Curl_checkProxyheaders(conn, "Proxy-Connection:"))?
@@ -2371,8 +2398,8 @@ CURLcode Curl_http(struct connectdata *conn, bool *done)
     if(data->cookies) {
       Curl_share_lock(data, CURL_LOCK_DATA_COOKIE, CURL_LOCK_ACCESS_SINGLE);
       co = Curl_cookie_getlist(data->cookies,
-                               conn->allocptr.cookiehost?
-                               conn->allocptr.cookiehost:host,
+                               data->state.aptr.cookiehost?
+                               data->state.aptr.cookiehost:host,
                                data->state.path,
                                (conn->handler->protocol&CURLPROTO_HTTPS)?
                                TRUE:FALSE);
@@ -3479,14 +3506,13 @@ CURLcode Curl_http_readwrite_headers(struct SessionHandle *data,
       }
     }
     else if(checkprefix("Server:", k->p)) {
-      char *server_name = Curl_copy_header_value(k->p);
+      char *server_name = copy_header_value(&data->state.arena, k->p);
 
       /* Turn off pipelining if the server version is blacklisted */
       if(conn->bundle && conn->bundle->server_supports_pipelining) {
         if(Curl_pipeline_server_blacklisted(data, server_name))
           conn->bundle->server_supports_pipelining = FALSE;
       }
-      Curl_safefree(server_name);
     }
     else if((conn->httpversion == 10) &&
             conn->bits.httpproxy &&
@@ -3665,8 +3691,8 @@ CURLcode Curl_http_readwrite_headers(struct SessionHandle *data,
                       data->cookies, TRUE, k->p+11,
                       /* If there is a custom-set Host: name, use it
                          here, or else use real peer host name. */
-                      conn->allocptr.cookiehost?
-                      conn->allocptr.cookiehost:conn->host.name,
+                      data->state.aptr.cookiehost?
+                      data->state.aptr.cookiehost:conn->host.name,
                       data->state.path);
       Curl_share_unlock(data, CURL_LOCK_DATA_COOKIE);
     }
@@ -3685,14 +3711,11 @@ CURLcode Curl_http_readwrite_headers(struct SessionHandle *data,
              (407 == k->httpcode))) {
 
       bool proxy = (k->httpcode == 407) ? TRUE : FALSE;
-      char *auth = Curl_copy_header_value(k->p);
+      char *auth = copy_header_value(&data->state.arena, k->p);
       if(!auth)
         return CURLE_OUT_OF_MEMORY;
 
       result = Curl_http_input_auth(conn, proxy, auth);
-
-      Curl_safefree(auth);
-
       if(result)
         return result;
     }
@@ -38,6 +38,7 @@ llist_init(struct curl_llist *l, curl_llist_dtor dtor)
   l->dtor = dtor;
   l->head = NULL;
   l->tail = NULL;
+  l->embedded = FALSE;
 }
 
 struct curl_llist *
@@ -55,24 +56,29 @@ Curl_llist_alloc(curl_llist_dtor dtor)
 }
 
 /*
- * Curl_llist_insert_next()
- *
- * Inserts a new list element after the given one 'e'. If the given existing
- * entry is NULL and the list already has elements, the new one will be
- * inserted first in the list.
- *
- * Returns: 1 on success and 0 on failure.
+ * Curl_llist_alloc_embedded()
  *
- * @unittest: 1300
+ * Creates a list that holds elements the caller provides, normally ones that
+ * are part of the struct they point to. Elements must be added with
+ * Curl_llist_insert_node() and removing them does not free them, so list
+ * membership costs no allocations.
  */
-int
-Curl_llist_insert_next(struct curl_llist *list, struct curl_llist_element *e,
-                       const void *p)
+struct curl_llist *
+Curl_llist_alloc_embedded(curl_llist_dtor dtor)
 {
-  struct curl_llist_element *ne = malloc(sizeof(struct curl_llist_element));
-  if(!ne)
-    return 0;
+  struct curl_llist *list = Curl_llist_alloc(dtor);
 
+  if(list)
+    list->embedded = TRUE;
+
+  return list;
+}
+
+/* link the element 'ne' holding 'p' into the list after 'e' */
+static void
+llist_link(struct curl_llist *list, struct curl_llist_element *e,
+           const void *p, struct curl_llist_element *ne)
+{
   ne->ptr = (void *) p;
   if(list->size == 0) {
     list->head = ne;
@@ -99,10 +105,54 @@ Curl_llist_insert_next(struct curl_llist *list, struct curl_llist_element *e,
   }
 
   ++list->size;
+}
+
+/*
+ * Curl_llist_insert_next()
+ *
+ * Inserts a new list element after the given one 'e'. If the given existing
+ * entry is NULL and the list already has elements, the new one will be
+ * inserted first in the list.
+ *
+ * Returns: 1 on success and 0 on failure.
+ *
+ * @unittest: 1300
+ */
+int
+Curl_llist_insert_next(struct curl_llist *list, struct curl_llist_element *e,
+                       const void *p)
+{
+  struct curl_llist_element *ne;
+
+  DEBUGASSERT(!list->embedded);
+
+  ne = malloc(sizeof(struct curl_llist_element));
+  if(!ne)
+    return 0;
+
+  llist_link(list, e, p, ne);
 
   return 1;
 }
 
+/*
+ * Curl_llist_insert_node()
+ *
+ * Like Curl_llist_insert_next() but for lists created with
+ * Curl_llist_alloc_embedded(): 'ne' is the element to insert, which must
+ * not be in any list. This cannot fail.
+ *
+ * @unittest: 1300
+ */
+void
+Curl_llist_insert_node(struct curl_llist *list, struct curl_llist_element *e,
+                       const void *p, struct curl_llist_element *ne)
+{
+  DEBUGASSERT(list->embedded);
+
+  llist_link(list, e, p, ne);
+}
+
 /*
  * @unittest: 1300
  */
@@ -135,7 +185,8 @@ Curl_llist_remove(struct curl_llist *list, struct curl_llist_element *e,
   e->prev = NULL;
   e->next = NULL;
 
-  free(e);
+  if(!list->embedded)
+    free(e);
   --list->size;
 
   return 1;
@@ -169,6 +220,10 @@ int Curl_llist_move(struct curl_llist *list, struct curl_llist_element *e,
   if(e == NULL || list->size == 0)
     return 0;
 
+  /* the element is not reallocated, so both lists must be of the same
+     kind */
+  DEBUGASSERT(list->embedded == to_list->embedded);
+
   if(e == list->head) {
     list->head = e->next;
 
@@ -41,11 +41,17 @@ struct curl_llist {
   curl_llist_dtor dtor;
 
   size_t size;
+
+  bool embedded; /* the elements are part of the structs they point to, so
+                    the list never allocates or frees them */
 };
 
 struct curl_llist *Curl_llist_alloc(curl_llist_dtor);
+struct curl_llist *Curl_llist_alloc_embedded(curl_llist_dtor);
 int Curl_llist_insert_next(struct curl_llist *, struct curl_llist_element *,
                            const void *);
+void Curl_llist_insert_node(struct curl_llist *, struct curl_llist_element *,
+                            const void *, struct curl_llist_element *);
 int Curl_llist_remove(struct curl_llist *, struct curl_llist_element *,
                       void *);
 size_t Curl_llist_count(struct curl_llist *);
@@ -22,6 +22,13 @@
 
 #include "curl_setup.h"
 
+#ifdef USE_EPOLL
+#include <sys/epoll.h>
+#endif
+#ifdef HAVE_EVENTFD
+#include <sys/eventfd.h>
+#endif
+
 #include <curl/curl.h>
 
 #include "urldata.h"
@@ -51,6 +58,14 @@
 /* The last #include file should be: */
 #include "memdebug.h"
 
+/* compare two struct timevals without the millisecond truncation of
+   curlx_tvdiff() */
+#define TV_LATER(a,b) (((a).tv_sec > (b).tv_sec) ||                        \
+                       (((a).tv_sec == (b).tv_sec) &&                       \
+                        ((a).tv_usec > (b).tv_usec)))
+#define TV_EQUAL(a,b) (((a).tv_sec == (b).tv_sec) &&                        \
+                       ((a).tv_usec == (b).tv_usec))
+
 /*
   CURL_SOCKET_HASH_TABLE_SIZE should be a prime number. Increasing it from 97
   to 911 takes on a 32-bit machine 4 x 804 = 3211 more bytes.  Still, every
@@ -60,8 +75,6 @@
 #define CURL_SOCKET_HASH_TABLE_SIZE 911
 #endif
 
-#define CURL_CONNECTION_HASH_SIZE 97
-
 #define CURL_MULTI_HANDLE 0x000bab1e
 
 #define GOOD_MULTI_HANDLE(x) \
@@ -75,11 +88,17 @@ static int update_timer(struct Curl_multi *multi);
 
 static bool isHandleAtHead(struct SessionHandle *handle,
                            struct curl_llist *pipeline);
+static bool isHandleInPipeline(struct SessionHandle *handle,
+                               struct curl_llist *pipeline);
 static CURLMcode add_next_timeout(struct timeval now,
                                   struct Curl_multi *multi,
                                   struct SessionHandle *d);
 static CURLMcode multi_timeout(struct Curl_multi *multi,
                                long *timeout_ms);
+static void multi_prune(struct Curl_multi *multi);
+static void multi_dns_refresh(struct Curl_multi *multi);
+static void multi_unpend(struct Curl_multi *multi,
+                         struct SessionHandle *data);
 
 #ifdef DEBUGBUILD
 static const char * const statename[]={
@@ -104,7 +123,33 @@ static const char * const statename[]={
 };
 #endif
 
-static void multi_freetimeout(void *a, void *b);
+
+/* microseconds since the base time of the multi handle's statistics */
+static curl_off_t multi_statnow(struct Curl_multi *multi)
+{
+  struct timeval now = Curl_tvnow();
+
+  return (curl_off_t)(now.tv_sec - multi->statbase.tv_sec) * 1000000 +
+    (now.tv_usec - multi->statbase.tv_usec);
+}
+
+/* count a handle as having entered its current state at time 'now' */
+static void multi_statenter(struct Curl_multi *multi,
+                            struct SessionHandle *data, curl_off_t now)
+{
+  data->mstate_entered = now;
+  multi->state_count[data->mstate]++;
+  multi->state_entered[data->mstate] += now;
+}
+
+/* count a handle as having left its current state at time 'now' */
+static void multi_statleave(struct Curl_multi *multi,
+                            struct SessionHandle *data, curl_off_t now)
+{
+  multi->state_count[data->mstate]--;
+  multi->state_entered[data->mstate] -= data->mstate_entered;
+  multi->state_time[data->mstate] += now - data->mstate_entered;
+}
 
 /* always use this function to change state, to make debugging easier */
 static void mstate(struct SessionHandle *data, CURLMstate state
@@ -123,7 +168,26 @@ static void mstate(struct SessionHandle *data, CURLMstate state
     /* don't bother when the new state is the same as the old state */
     return;
 
-  data->mstate = state;
+  if(data->multi) {
+    struct Curl_multi *multi = data->multi;
+    curl_off_t now = multi_statnow(multi);
+
+    multi_statleave(multi, data, now);
+    data->mstate = state;
+    multi_statenter(multi, data, now);
+  }
+  else
+    /* not added yet, curl_multi_add_handle() starts counting it */
+    data->mstate = state;
+
+  /* a handle that leaves the wait for a connection, other than by being
+     woken up or by having to wait again, gives up its place in the queue */
+  if(data->pendq &&
+     !((oldstate == CURLM_STATE_CONNECT_PEND) &&
+       (state == CURLM_STATE_CONNECT)) &&
+     !((oldstate == CURLM_STATE_CONNECT) &&
+       (state == CURLM_STATE_CONNECT_PEND)))
+    multi_unpend(data->multi, data);
 
 #if defined(DEBUGBUILD) && !defined(CURL_DISABLE_VERBOSE_STRINGS)
   if(data->mstate >= CURLM_STATE_CONNECT_PEND &&
@@ -161,19 +225,144 @@ struct Curl_sh_entry {
   int action;  /* what action READ/WRITE this socket waits for */
   curl_socket_t socket; /* mainly to ease debugging */
   void *socketp; /* settable by users with curl_multi_assign() */
+  bool inuse; /* this entry holds a socket */
+  bool in_epoll; /* the socket is in the epoll interest set */
+  struct Curl_idle_watch *idle; /* set for the socket of an idle connection,
+                                   'easy' is NULL then */
 };
 /* bits for 'action' having no bits means this socket is not expecting any
    action */
 #define SH_READ  1
 #define SH_WRITE 2
 
+#ifdef USE_SOCKET_TABLE
+
+/* number of entries in each page of the socket table, a power of two */
+#define SH_PAGEBITS 8
+#define SH_PAGESIZE (1 << SH_PAGEBITS)
+#define SH_PAGE(s) ((size_t)(s) >> SH_PAGEBITS)
+#define SH_SLOT(s) ((size_t)(s) & (SH_PAGESIZE - 1))
+
+/*
+ * The table holds the entries themselves, indexed by the socket value, so
+ * looking up, adding and removing a socket is done without scanning any
+ * list and without any allocation once the page for that range of sockets
+ * exists. Pages are allocated when the first socket in their range is added
+ * and kept until the multi handle is cleaned up, since the operating system
+ * hands out the lowest free descriptor and the same ranges get used again.
+ */
+
+/* return the entry for this socket, or NULL if it is not in the table */
+static struct Curl_sh_entry *sh_getentry(struct Curl_sockhash *sh,
+                                         curl_socket_t s)
+{
+  struct Curl_sh_entry *page;
+
+  if(s < 0)
+    return NULL;
+  if(SH_PAGE(s) >= sh->npages)
+    return NULL;
+  page = sh->pages[SH_PAGE(s)];
+  if(!page || !page[SH_SLOT(s)].inuse)
+    return NULL;
+  return &page[SH_SLOT(s)];
+}
+
+/* make sure this socket is present in the table for this handle */
+static struct Curl_sh_entry *sh_addentry(struct Curl_sockhash *sh,
+                                         curl_socket_t s,
+                                         struct SessionHandle *data)
+{
+  struct Curl_sh_entry *check;
+  size_t pageno;
+
+  if(s < 0)
+    return NULL;
+
+  pageno = SH_PAGE(s);
+  if(pageno >= sh->npages) {
+    /* grow the page index to fit this socket, at least doubling it */
+    size_t npages = sh->npages ? sh->npages * 2 : 4;
+    struct Curl_sh_entry **pages;
+
+    while(npages <= pageno)
+      npages *= 2;
+    pages = realloc(sh->pages, npages * sizeof(struct Curl_sh_entry *));
+    if(!pages)
+      return NULL; /* major failure */
+    memset(&pages[sh->npages], 0,
+           (npages - sh->npages) * sizeof(struct Curl_sh_entry *));
+    sh->pages = pages;
+    sh->npages = npages;
+  }
+
+  if(!sh->pages[pageno]) {
+    sh->pages[pageno] = calloc(SH_PAGESIZE, sizeof(struct Curl_sh_entry));
+    if(!sh->pages[pageno])
+      return NULL; /* major failure */
+  }
+
+  check = &sh->pages[pageno][SH_SLOT(s)];
+  if(check->inuse)
+    /* it is present, return fine */
+    return check;
+
+  /* not present, add it */
+  memset(check, 0, sizeof(struct Curl_sh_entry));
+  check->easy = data;
+  check->socket = s;
+  check->inuse = TRUE;
+
+  return check; /* things are good in sockhash land */
+}
+
+/* delete the given socket + handle from the table */
+static void sh_delentry(struct Curl_sockhash *sh, curl_socket_t s)
+{
+  struct Curl_sh_entry *there = sh_getentry(sh, s);
+
+  if(there)
+    there->inuse = FALSE;
+}
+
+/*
+ * sh_init() creates a new, empty socket table. The hash size is only used
+ * when sockets are looked up in a hash.
+ */
+static CURLMcode sh_init(struct Curl_sockhash *sh, int hashsize)
+{
+  (void)hashsize;
+  sh->pages = NULL;
+  sh->npages = 0;
+  return CURLM_OK;
+}
+
+static void sh_destroy(struct Curl_sockhash *sh)
+{
+  size_t i;
+
+  for(i = 0; i < sh->npages; i++)
+    free(sh->pages[i]);
+  Curl_safefree(sh->pages);
+  sh->npages = 0;
+}
+
+#else /* USE_SOCKET_TABLE */
+
+static struct Curl_sh_entry *sh_getentry(struct Curl_sockhash *sh,
+                                         curl_socket_t s)
+{
+  if(!sh->hash)
+    return NULL;
+  return Curl_hash_pick(sh->hash, (char *)&s, sizeof(curl_socket_t));
+}
+
 /* make sure this socket is present in the hash for this handle */
-static struct Curl_sh_entry *sh_addentry(struct curl_hash *sh,
+static struct Curl_sh_entry *sh_addentry(struct Curl_sockhash *sh,
                                          curl_socket_t s,
                                          struct SessionHandle *data)
 {
-  struct Curl_sh_entry *there =
-    Curl_hash_pick(sh, (char *)&s, sizeof(curl_socket_t));
+  struct Curl_sh_entry *there = sh_getentry(sh, s);
   struct Curl_sh_entry *check;
 
   if(there)
@@ -187,9 +376,10 @@ static struct Curl_sh_entry *sh_addentry(struct curl_hash *sh,
 
   check->easy = data;
   check->socket = s;
+  check->inuse = TRUE;
 
   /* make/add new hash entry */
-  if(!Curl_hash_add(sh, (char *)&s, sizeof(curl_socket_t), check)) {
+  if(!Curl_hash_add(sh->hash, (char *)&s, sizeof(curl_socket_t), check)) {
     free(check);
     return NULL; /* major failure */
   }
@@ -199,16 +389,15 @@ static struct Curl_sh_entry *sh_addentry(struct curl_hash *sh,
 
 
 /* delete the given socket + handle from the hash */
-static void sh_delentry(struct curl_hash *sh, curl_socket_t s)
+static void sh_delentry(struct Curl_sockhash *sh, curl_socket_t s)
 {
-  struct Curl_sh_entry *there =
-    Curl_hash_pick(sh, (char *)&s, sizeof(curl_socket_t));
+  struct Curl_sh_entry *there = sh_getentry(sh, s);
 
   if(there) {
     /* this socket is in the hash */
     /* We remove the hash entry. (This'll end up in a call to
        sh_freeentry().) */
-    Curl_hash_delete(sh, (char *)&s, sizeof(curl_socket_t));
+    Curl_hash_delete(sh->hash, (char *)&s, sizeof(curl_socket_t));
   }
 }
 
@@ -227,19 +416,19 @@ static size_t fd_key_compare(void *k1, size_t k1_len, void *k2, size_t k2_len)
 {
   (void) k1_len; (void) k2_len;
 
-  return (*((int *) k1)) == (*((int *) k2));
+  return (*((curl_socket_t *) k1)) == (*((curl_socket_t *) k2));
 }
 
 static size_t hash_fd(void *key, size_t key_length, size_t slots_num)
 {
-  int fd = *((int *) key);
+  curl_socket_t fd = *((curl_socket_t *) key);
   (void) key_length;
 
-  return (fd % (int)slots_num);
+  return (size_t)(fd % slots_num);
 }
 
 /*
- * sh_init() creates a new socket hash and returns the handle for it.
+ * sh_init() creates a new socket hash.
  *
  * Quote from README.multi_socket:
  *
@@ -256,36 +445,426 @@ static size_t hash_fd(void *key, size_t key_length, size_t slots_num)
  * per call."
  *
  */
-static struct curl_hash *sh_init(int hashsize)
+static CURLMcode sh_init(struct Curl_sockhash *sh, int hashsize)
+{
+  sh->hash = Curl_hash_alloc(hashsize, hash_fd, fd_key_compare,
+                             sh_freeentry);
+  return sh->hash ? CURLM_OK : CURLM_OUT_OF_MEMORY;
+}
+
+static void sh_destroy(struct Curl_sockhash *sh)
+{
+  Curl_hash_destroy(sh->hash);
+  sh->hash = NULL;
+}
+
+#endif /* USE_SOCKET_TABLE */
+
+#ifdef USE_EPOLL
+/*
+ * multi_epoll_update() brings the epoll interest set up to date for a single
+ * socket when its action changes to 'newaction'. It is only called when
+ * singlesocket() detects a difference, so the cost is tied to the number of
+ * changed sockets and not to the number of easy handles. The entry tells if
+ * the socket is in the set already, which is what 'epoll_nfds' counts.
+ *
+ * Should epoll fail on us in an unexpected way, the epoll descriptor is
+ * closed and curl_multi_wait() goes back to building a poll set.
+ */
+static void multi_epoll_update(struct Curl_multi *multi,
+                               struct Curl_sh_entry *entry, int newaction)
 {
-  return Curl_hash_alloc(hashsize, hash_fd, fd_key_compare,
-                         sh_freeentry);
+  struct epoll_event ev;
+  int op;
+
+  if(multi->epollfd == -1)
+    return;
+
+  if(!newaction) {
+    if(!entry->in_epoll)
+      return;
+    /* this fails when the socket was closed already, which took it out of
+       the set as well */
+    memset(&ev, 0, sizeof(ev));
+    (void)epoll_ctl(multi->epollfd, EPOLL_CTL_DEL, entry->socket, &ev);
+    entry->in_epoll = FALSE;
+    multi->epoll_nfds--;
+    return;
+  }
+
+  op = entry->in_epoll ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+
+  memset(&ev, 0, sizeof(ev));
+  if(newaction & CURL_POLL_IN)
+    ev.events |= EPOLLIN;
+  if(newaction & CURL_POLL_OUT)
+    ev.events |= EPOLLOUT;
+  ev.data.fd = entry->socket;
+
+  if(epoll_ctl(multi->epollfd, op, entry->socket, &ev)) {
+    int error = SOCKERRNO;
+
+    if((op == EPOLL_CTL_MOD) && (error == ENOENT))
+      /* the socket was closed and its number reused without us noticing,
+         the kernel dropped it from the set so add it again */
+      op = EPOLL_CTL_ADD;
+    else if((op == EPOLL_CTL_ADD) && (error == EEXIST))
+      /* left in the set by a socket with the same number */
+      op = EPOLL_CTL_MOD;
+    else
+      op = -1;
+
+    if((op == -1) || epoll_ctl(multi->epollfd, op, entry->socket, &ev)) {
+      /* give up on epoll for this multi handle */
+      close(multi->epollfd);
+      multi->epollfd = -1;
+      multi->epoll_nfds = 0;
+      return;
+    }
+  }
+
+  if(!entry->in_epoll) {
+    entry->in_epoll = TRUE;
+    multi->epoll_nfds++;
+  }
+}
+#else
+#define multi_epoll_update(x,y,z) Curl_nop_stmt
+#endif
+
+#ifdef ENABLE_WAKEUP
+/*
+ * multi_wakeup_init() creates the descriptors curl_multi_wakeup() signals
+ * the multi handle with. Failing is not fatal, the multi handle then works
+ * as before and curl_multi_wakeup() returns an error.
+ */
+static void multi_wakeup_init(struct Curl_multi *multi)
+{
+#ifdef HAVE_EVENTFD
+  multi->wakeup_fds[0] = multi->wakeup_fds[1] =
+    eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+#else
+  if(pipe(multi->wakeup_fds))
+    multi->wakeup_fds[0] = multi->wakeup_fds[1] = -1;
+  else {
+    /* a full pipe already has a wakeup pending, so writes must not block,
+       and draining must stop when it is empty */
+    curlx_nonblock(multi->wakeup_fds[0], TRUE);
+    curlx_nonblock(multi->wakeup_fds[1], TRUE);
+  }
+#endif
+}
+
+static void multi_wakeup_cleanup(struct Curl_multi *multi)
+{
+  if(multi->wakeup_fds[0] != -1)
+    close(multi->wakeup_fds[0]);
+  if(multi->wakeup_fds[1] != multi->wakeup_fds[0])
+    close(multi->wakeup_fds[1]);
+}
+
+/* consume all wakeups signalled so far */
+static void multi_wakeup_drain(struct Curl_multi *multi)
+{
+#ifdef HAVE_EVENTFD
+  eventfd_t value;
+  (void)eventfd_read(multi->wakeup_fds[0], &value);
+#else
+  char buf[64];
+  while(read(multi->wakeup_fds[0], buf, sizeof(buf)) > 0)
+    ;
+#endif
+}
+
+/* the descriptor curl_multi_wait() polls for wakeups, or -1 */
+#define multi_wakeup_fd(x) ((x)->wakeup_fds[0])
+#else
+#define multi_wakeup_init(x) Curl_nop_stmt
+#define multi_wakeup_cleanup(x) Curl_nop_stmt
+#define multi_wakeup_drain(x) Curl_nop_stmt
+#define multi_wakeup_fd(x) -1
+#endif
+
+/*
+ * multi_readyadd()
+ *
+ * Put a handle last in the ready queue, unless it already is queued.
+ */
+static void multi_readyadd(struct Curl_multi *multi,
+                           struct SessionHandle *data)
+{
+  if(data->ready_queued)
+    return;
+
+  data->ready_next = NULL;
+  data->ready_prev = multi->readylp;
+  if(multi->readylp)
+    multi->readylp->ready_next = data;
+  else
+    multi->readyp = data;
+  multi->readylp = data;
+  data->ready_queued = TRUE;
+}
+
+/*
+ * multi_readyremove()
+ *
+ * Take a handle out of the ready queue, if it is queued.
+ */
+static void multi_readyremove(struct Curl_multi *multi,
+                              struct SessionHandle *data)
+{
+  if(!data->ready_queued)
+    return;
+
+  if(data->ready_prev)
+    data->ready_prev->ready_next = data->ready_next;
+  else
+    multi->readyp = data->ready_next;
+  if(data->ready_next)
+    data->ready_next->ready_prev = data->ready_prev;
+  else
+    multi->readylp = data->ready_prev;
+  data->ready_next = data->ready_prev = NULL;
+  data->ready_queued = FALSE;
+}
+
+/*
+ * Handles that can't get a connection because of max_host_connections or
+ * max_total_connections wait in FIFO queues: one per connection cache
+ * bundle, that is per host and port, for the first limit and
+ * multi->pending for the second. Whenever a connection is handed
+ * back or closed, Curl_multi_process_pending_handles() wakes up just one
+ * waiter, so a finished transfer doesn't send every waiting handle back to
+ * try (and fail) to connect.
+ */
+
+static void pendq_free(void *p)
+{
+  struct Curl_pendq *q = (struct Curl_pendq *)p;
+
+  free(q->key);
+  free(q);
+}
+
+/* find the wait queue for a bundle, and create it if 'create' is set */
+static struct Curl_pendq *pendq_find(struct Curl_multi *multi,
+                                     char *key, bool create)
+{
+  size_t len = strlen(key) + 1;
+  struct Curl_pendq *q = Curl_hash_pick(multi->pendhash, key, len);
+
+  if(q || !create)
+    return q;
+
+  q = calloc(1, sizeof(struct Curl_pendq));
+  if(!q)
+    return NULL;
+  q->key = strdup(key);
+  if(!q->key || !Curl_hash_add(multi->pendhash, key, len, q)) {
+    /* Curl_hash_add() doesn't free the entry when it fails */
+    pendq_free(q);
+    return NULL;
+  }
+  return q;
+}
+
+/* free a bundle's wait queue once nothing refers to it anymore */
+static void pendq_check(struct Curl_multi *multi, struct Curl_pendq *q)
+{
+  if(q->key && !q->head && !q->woken)
+    Curl_hash_delete(multi->pendhash, q->key, strlen(q->key) + 1);
+}
+
+/*
+ * multi_pend()
+ *
+ * Put a handle that failed to get a connection in the wait queue that
+ * matches the limit it hit. A handle that was woken up but still could not
+ * connect goes first, as it has waited the longest.
+ */
+static CURLcode multi_pend(struct Curl_multi *multi,
+                           struct SessionHandle *data)
+{
+  struct Curl_pendq *q = &multi->pending;
+  bool first = data->pend_woken;
+
+  /* give up the place the handle was woken from */
+  multi_unpend(multi, data);
+
+  if(data->state.connwait_key) {
+    q = pendq_find(multi, data->state.connwait_key, TRUE);
+    Curl_safefree(data->state.connwait_key);
+    if(!q)
+      return CURLE_OUT_OF_MEMORY;
+  }
+
+  if(first) {
+    data->pend_prev = NULL;
+    data->pend_next = q->head;
+    if(q->head)
+      q->head->pend_prev = data;
+    else
+      q->tail = data;
+    q->head = data;
+  }
+  else {
+    data->pend_next = NULL;
+    data->pend_prev = q->tail;
+    if(q->tail)
+      q->tail->pend_next = data;
+    else
+      q->head = data;
+    q->tail = data;
+  }
+  data->pendq = q;
+  multi->num_pending++;
+  return CURLE_OK;
+}
+
+/*
+ * multi_unpend()
+ *
+ * Take a handle out of the wait queue it is in, or forget about the queue it
+ * was woken from.
+ */
+static void multi_unpend(struct Curl_multi *multi,
+                         struct SessionHandle *data)
+{
+  struct Curl_pendq *q = data->pendq;
+
+  if(!q)
+    return;
+
+  if(data->pend_woken) {
+    q->woken--;
+    data->pend_woken = FALSE;
+  }
+  else {
+    if(data->pend_prev)
+      data->pend_prev->pend_next = data->pend_next;
+    else
+      q->head = data->pend_next;
+    if(data->pend_next)
+      data->pend_next->pend_prev = data->pend_prev;
+    else
+      q->tail = data->pend_prev;
+    data->pend_next = data->pend_prev = NULL;
+    multi->num_pending--;
+  }
+  data->pendq = NULL;
+  pendq_check(multi, q);
+}
+
+/* let the first handle in a wait queue try to connect again */
+static bool pendq_wake(struct Curl_multi *multi, struct Curl_pendq *q)
+{
+  struct SessionHandle *data = q->head;
+
+  if(!data)
+    return FALSE;
+
+  q->head = data->pend_next;
+  if(q->head)
+    q->head->pend_prev = NULL;
+  else
+    q->tail = NULL;
+  data->pend_next = NULL;
+  multi->num_pending--;
+
+  /* the handle keeps its reference to the queue until it has tried to
+     connect, to pass the wakeup on if it is removed before that */
+  data->pend_woken = TRUE;
+  q->woken++;
+
+  multistate(data, CURLM_STATE_CONNECT);
+
+  /* Make sure that the handle will be processed soonish. */
+  Curl_expire_latest(data, 1, EXPIRE_RUN_NOW);
+  multi_readyadd(multi, data);
+  return TRUE;
 }
 
 /*
  * multi_addmsg()
  *
- * Called when a transfer is completed. Adds the given msg pointer to
- * the list kept in the multi handle.
+ * Called when a transfer is completed. Appends the given msg, which lives in
+ * the easy handle, to the queue kept in the multi handle. Nothing needs to
+ * be allocated for this so it cannot fail.
  */
-static CURLMcode multi_addmsg(struct Curl_multi *multi,
-                              struct Curl_message *msg)
+static void multi_addmsg(struct Curl_multi *multi,
+                         struct Curl_message *msg)
 {
-  if(!Curl_llist_insert_next(multi->msglist, multi->msglist->tail, msg))
-    return CURLM_OUT_OF_MEMORY;
+  DEBUGASSERT(!msg->queued);
 
-  return CURLM_OK;
+  msg->next = NULL;
+  msg->prev = multi->msglp;
+  if(multi->msglp)
+    multi->msglp->next = msg;
+  else
+    multi->msgp = msg;
+  multi->msglp = msg;
+  msg->queued = TRUE;
+  multi->num_msgs++;
 }
 
 /*
- * multi_freeamsg()
+ * multi_delmsg()
  *
- * Callback used by the llist system when a single list entry is destroyed.
+ * Takes the given msg out of the queue, if it is in it.
  */
-static void multi_freeamsg(void *a, void *b)
+static void multi_delmsg(struct Curl_multi *multi,
+                         struct Curl_message *msg)
 {
-  (void)a;
-  (void)b;
+  if(!msg->queued)
+    return;
+
+  if(msg->prev)
+    msg->prev->next = msg->next;
+  else
+    multi->msgp = msg->next;
+  if(msg->next)
+    msg->next->prev = msg->prev;
+  else
+    multi->msglp = msg->prev;
+  msg->next = msg->prev = NULL;
+  msg->queued = FALSE;
+  multi->num_msgs--;
+}
+
+/*
+ * multi_prewarm_reap()
+ *
+ * Removes and closes the handles curl_multi_prewarm() added that are done.
+ */
+static void multi_prewarm_reap(struct Curl_multi *multi)
+{
+  while(multi->prewarm_done) {
+    struct SessionHandle *data = multi->prewarm_done;
+
+    multi->prewarm_done = data->prewarm_next;
+    (void)curl_multi_remove_handle((CURLM *)multi, data);
+    Curl_close(data);
+  }
+}
+
+/*
+ * multi_completions()
+ *
+ * Hands all queued messages to the completion callback, if one is set. This
+ * is done when a performing function is about to return rather than from
+ * within the state machine, so that the callback is free to remove and
+ * clean up the easy handle the message concerns or to add new ones.
+ */
+static void multi_completions(struct Curl_multi *multi)
+{
+  while(multi->completion_cb && multi->msgp) {
+    /* the callback may clean up the easy handle the message lives in */
+    struct CURLMsg extmsg = multi->msgp->extmsg;
+
+    multi_delmsg(multi, multi->msgp);
+    multi->completion_cb((CURLM *)multi, &extmsg, multi->completion_userp);
+  }
 }
 
 struct Curl_multi *Curl_multi_handle(int hashsize, /* socket hash */
@@ -302,20 +881,16 @@ struct Curl_multi *Curl_multi_handle(int hashsize, /* socket hash */
   if(!multi->hostcache)
     goto error;
 
-  multi->sockhash = sh_init(hashsize);
-  if(!multi->sockhash)
+  if(sh_init(&multi->sockhash, hashsize))
     goto error;
 
   multi->conn_cache = Curl_conncache_init(chashsize);
   if(!multi->conn_cache)
     goto error;
 
-  multi->msglist = Curl_llist_alloc(multi_freeamsg);
-  if(!multi->msglist)
-    goto error;
-
-  multi->pending = Curl_llist_alloc(multi_freeamsg);
-  if(!multi->pending)
+  multi->pendhash = Curl_hash_alloc(hashsize, Curl_hash_str,
+                                    Curl_str_key_compare, pendq_free);
+  if(!multi->pendhash)
     goto error;
 
   /* allocate a new easy handle to use when closing cached connections */
@@ -328,22 +903,32 @@ struct Curl_multi *Curl_multi_handle(int hashsize, /* socket hash */
 
   multi->max_pipeline_length = 5;
 
+  Curl_wheel_init(&multi->timers, Curl_tvnow());
+
+  multi->statbase = Curl_tvnow();
+
+#ifdef USE_EPOLL
+  /* failing to create the epoll descriptor is not fatal, curl_multi_wait()
+     then builds a poll set on each call like on other platforms */
+  multi->epollfd = epoll_create1(EPOLL_CLOEXEC);
+#endif
+
+  multi_wakeup_init(multi);
+
   /* -1 means it not set by user, use the default value */
   multi->maxconnects = -1;
   return (CURLM *) multi;
 
   error:
 
-  Curl_hash_destroy(multi->sockhash);
-  multi->sockhash = NULL;
-  Curl_hash_destroy(multi->hostcache);
+  sh_destroy(&multi->sockhash);
+  Curl_hostcache_destroy(multi->hostcache);
   multi->hostcache = NULL;
   Curl_conncache_destroy(multi->conn_cache);
   multi->conn_cache = NULL;
   Curl_close(multi->closure_handle);
   multi->closure_handle = NULL;
-  Curl_llist_destroy(multi->msglist, NULL);
-  Curl_llist_destroy(multi->pending, NULL);
+  Curl_hash_destroy(multi->pendhash);
 
   free(multi);
   return NULL;
@@ -355,10 +940,63 @@ CURLM *curl_multi_init(void)
                            CURL_CONNECTION_HASH_SIZE);
 }
 
+/*
+ * A share object with a connection cache that easy handles of this multi
+ * handle use. The multi handle prunes that cache along with its own while
+ * it has handles using it, see multi_prune().
+ */
+struct Curl_multi_share {
+  struct Curl_share *share;
+  unsigned int users; /* easy handles of the multi handle using it */
+  struct Curl_multi_share *next;
+};
+
+/* count one more easy handle using the connection cache of 'share' */
+static bool multi_share_use(struct Curl_multi *multi,
+                            struct Curl_share *share)
+{
+  struct Curl_multi_share *s;
+
+  for(s = multi->shares; s; s = s->next) {
+    if(s->share == share) {
+      s->users++;
+      return TRUE;
+    }
+  }
+
+  s = malloc(sizeof(struct Curl_multi_share));
+  if(!s)
+    return FALSE;
+  s->share = share;
+  s->users = 1;
+  s->next = multi->shares;
+  multi->shares = s;
+  return TRUE;
+}
+
+/* an easy handle no longer uses the shared connection cache 'connc' */
+static void multi_share_drop(struct Curl_multi *multi,
+                             struct conncache *connc)
+{
+  struct Curl_multi_share **sp;
+
+  for(sp = &multi->shares; *sp; sp = &(*sp)->next) {
+    struct Curl_multi_share *s = *sp;
+
+    if(s->share->conn_cache == connc) {
+      s->users--;
+      if(!s->users) {
+        *sp = s->next;
+        free(s);
+      }
+      return;
+    }
+  }
+}
+
 CURLMcode curl_multi_add_handle(CURLM *multi_handle,
                                 CURL *easy_handle)
 {
-  struct curl_llist *timeoutlist;
   struct Curl_multi *multi = (struct Curl_multi *)multi_handle;
   struct SessionHandle *data = (struct SessionHandle *)easy_handle;
 
@@ -375,29 +1013,26 @@ CURLMcode curl_multi_add_handle(CURLM *multi_handle,
   if(data->multi)
     return CURLM_ADDED_ALREADY;
 
-  /* Allocate and initialize timeout list for easy handle */
-  timeoutlist = Curl_llist_alloc(multi_freetimeout);
-  if(!timeoutlist)
+  /* a connection cache shared with other handles is pruned by this multi
+     handle while the easy handle uses it */
+  if(data->share && data->share->conn_cache &&
+     !multi_share_use(multi, data->share))
     return CURLM_OUT_OF_MEMORY;
 
   /*
    * No failure allowed in this function beyond this point. And no
    * modification of easy nor multi handle allowed before this except for
-   * potential multi's connection cache growing which won't be undone in this
-   * function no matter what.
+   * potential multi's connection cache growing and the count of users of a
+   * shared one, which won't be undone in this function no matter what.
    */
 
-  /* Make easy handle use timeout list initialized above */
-  data->state.timeoutlist = timeoutlist;
-  timeoutlist = NULL;
-
   /* set the easy handle */
   multistate(data, CURLM_STATE_INIT);
 
   if((data->set.global_dns_cache) &&
      (data->dns.hostcachetype != HCACHE_GLOBAL)) {
     /* global dns cache was requested but still isn't */
-    struct curl_hash *global = Curl_global_host_cache_init();
+    struct Curl_dnscache *global = Curl_global_host_cache_init();
     if(global) {
       /* only do this if the global cache init works */
       data->dns.hostcache = global;
@@ -412,8 +1047,12 @@ CURLMcode curl_multi_add_handle(CURLM *multi_handle,
     data->dns.hostcachetype = HCACHE_MULTI;
   }
 
-  /* Point to the multi's connection cache */
-  data->state.conn_cache = multi->conn_cache;
+  /* Point to the connection cache of the share object if it shares one,
+     the multi's otherwise */
+  if(data->share && data->share->conn_cache)
+    data->state.conn_cache = data->share->conn_cache;
+  else
+    data->state.conn_cache = multi->conn_cache;
 
   data->state.infilesize = data->set.filesize;
 
@@ -439,6 +1078,7 @@ CURLMcode curl_multi_add_handle(CURLM *multi_handle,
 
   /* make the SessionHandle refer back to this multi handle */
   data->multi = multi_handle;
+  multi_statenter(multi, data, multi_statnow(multi));
 
   /* Set the timeout for this handle to expire really soon so that it will
      be taken care of even when this handle is added in the midst of operation
@@ -446,7 +1086,8 @@ CURLMcode curl_multi_add_handle(CURLM *multi_handle,
      sockets that time-out or have actions will be dealt with. Since this
      handle has no action yet, we make sure it times out to get things to
      happen. */
-  Curl_expire(data, 1);
+  Curl_expire(data, 1, EXPIRE_RUN_NOW);
+  multi_readyadd(multi, data);
 
   /* increase the node-counter */
   multi->num_easy++;
@@ -473,7 +1114,7 @@ CURLMcode curl_multi_add_handle(CURLM *multi_handle,
 #if 0
 /* Debug-function, used like this:
  *
- * Curl_hash_print(multi->sockhash, debug_print_sock_hash);
+ * Curl_hash_print(multi->sockhash.hash, debug_print_sock_hash);
  *
  * Enable the hash print function first by editing hash.c
  */
@@ -494,7 +1135,6 @@ CURLMcode curl_multi_remove_handle(CURLM *multi_handle,
   struct SessionHandle *data = easy;
   bool premature;
   bool easy_owns_conn;
-  struct curl_llist_element *e;
 
   /* First, make some basic checks that the CURLM handle is a good handle */
   if(!GOOD_MULTI_HANDLE(multi))
@@ -534,15 +1174,25 @@ CURLMcode curl_multi_remove_handle(CURLM *multi_handle,
   }
 
   /* The timer must be shut down before data->multi is set to NULL,
-     else the timenode will remain in the splay tree after
+     else the timenode will remain in the timing wheel after
      curl_easy_cleanup is called. */
-  Curl_expire(data, 0);
+  Curl_expire_clear(data);
+
+  multi_readyremove(multi, data);
 
-  /* destroy the timeout list that is held in the easy handle */
-  if(data->state.timeoutlist) {
-    Curl_llist_destroy(data->state.timeoutlist, NULL);
-    data->state.timeoutlist = NULL;
+  if(data->pendq) {
+    /* a handle that was woken up but never tried to connect passes the
+       wakeup on to the next waiter */
+    if(data->pend_woken && !pendq_wake(multi, data->pendq))
+      (void)pendq_wake(multi, &multi->pending);
+    multi_unpend(multi, data);
   }
+  Curl_safefree(data->state.connwait_key);
+
+  if(data->set.str[STRING_DNS_CACHE_FILE])
+    /* save the cache while this handle still knows which one it used, if
+       names were resolved into it since it was last saved */
+    Curl_hostcache_save(data);
 
   if(data->dns.hostcachetype == HCACHE_MULTI) {
     /* stop using the multi handle's DNS cache */
@@ -552,6 +1202,9 @@ CURLMcode curl_multi_remove_handle(CURLM *multi_handle,
 
   if(data->easy_conn) {
 
+    /* the connection or its place in a pipeline frees up */
+    Curl_multi_process_pending_handles(multi, data->easy_conn);
+
     /* we must call Curl_done() here (if we still "own it") so that we don't
        leave a half-baked one around */
     if(easy_owns_conn) {
@@ -572,8 +1225,13 @@ CURLMcode curl_multi_remove_handle(CURLM *multi_handle,
 
   /* as this was using a shared connection cache we clear the pointer to that
      since we're not part of that multi handle anymore */
+  if(data->state.conn_cache != multi->conn_cache)
+    multi_share_drop(multi, data->state.conn_cache);
   data->state.conn_cache = NULL;
 
+  /* the handle's time in its last state ends here */
+  multi_statleave(multi, data, multi_statnow(multi));
+
   /* change state without using multistate(), only to make singlesocket() do
      what we want */
   data->mstate = CURLM_STATE_COMPLETED;
@@ -590,16 +1248,7 @@ CURLMcode curl_multi_remove_handle(CURLM *multi_handle,
 
   /* make sure there's no pending message in the queue sent from this easy
      handle */
-
-  for(e = multi->msglist->head; e; e = e->next) {
-    struct Curl_message *msg = e->ptr;
-
-    if(msg->extmsg.easy_handle == easy) {
-      Curl_llist_remove(multi->msglist, e, NULL);
-      /* there can only be one from this specific handle */
-      break;
-    }
-  }
+  multi_delmsg(multi, &data->msg);
 
   /* make the previous node point to our next */
   if(data->prev)
@@ -750,6 +1399,10 @@ CURLMcode curl_multi_fdset(CURLM *multi_handle,
   if(!GOOD_MULTI_HANDLE(multi))
     return CURLM_BAD_HANDLE;
 
+  /* the application waits for activity on its own, so the next
+     curl_multi_perform() cannot know which handles are ready */
+  multi->ready_valid = FALSE;
+
   data=multi->easyp;
   while(data) {
     bitmap = multi_getsock(data, sockbunch, MAX_SOCKSPEREASYHANDLE);
@@ -782,6 +1435,415 @@ CURLMcode curl_multi_fdset(CURLM *multi_handle,
   return CURLM_OK;
 }
 
+/*
+ * An idle connection has nothing to tell us, so when its socket becomes
+ * readable the server has most likely closed it. The multi handle of the
+ * transfer that leaves a connection idle keeps its socket in the sockhash,
+ * and with that in the epoll interest set and with the socket callback,
+ * until the connection is taken for re-use or closed. A dead connection is
+ * then noticed and closed right away instead of being left for the pruning.
+ *
+ * A connection in a cache shared with other multi handles can be taken or
+ * closed by a handle of one of those, which must not touch the sockhash of
+ * this one. It only clears 'conn' in the watch, with the cache locked, and
+ * this multi handle drops the watch when it sees activity on the socket or
+ * the socket number in use by something else. Such a watch counts as a
+ * user of the share object until it is freed.
+ */
+struct Curl_idle_watch {
+  struct Curl_multi *multi; /* the multi handle watching */
+  struct connectdata *conn; /* NULL when another multi handle has taken or
+                               closed the connection */
+  struct Curl_share *share; /* the share object holding the cache the
+                               connection is in, NULL for the multi handle's
+                               own cache */
+  curl_socket_t sock;
+  struct Curl_idle_watch *next; /* in 'idle_watches' or 'idle_stale' */
+  struct Curl_idle_watch *prev;
+};
+
+/* have the closure handle act on the connection cache of 'share', locked,
+   or on the multi handle's own cache if 'share' is NULL */
+static struct SessionHandle *closure_lock(struct Curl_multi *multi,
+                                       struct Curl_share *share)
+{
+  struct SessionHandle *closure = multi->closure_handle;
+
+  closure->share = share;
+  Curl_conncache_lock(closure);
+  if(share)
+    closure->state.conn_cache = share->conn_cache;
+  return closure;
+}
+
+static void closure_unlock(struct Curl_multi *multi)
+{
+  struct SessionHandle *closure = multi->closure_handle;
+
+  Curl_conncache_unlock(closure);
+  closure->share = NULL;
+  closure->state.conn_cache = multi->conn_cache;
+}
+
+/* take the socket of a watch out of the sockhash */
+static void idle_entry_remove(struct Curl_multi *multi,
+                              struct Curl_sh_entry *entry)
+{
+  if(multi->socket_cb)
+    multi->socket_cb(multi->closure_handle, entry->socket, CURL_POLL_REMOVE,
+                     multi->socket_userp, entry->socketp);
+  multi_epoll_update(multi, entry, 0);
+  sh_delentry(&multi->sockhash, entry->socket);
+}
+
+static void idle_watch_unlink(struct Curl_multi *multi,
+                              struct Curl_idle_watch *w)
+{
+  if(w->prev)
+    w->prev->next = w->next;
+  else
+    multi->idle_watches = w->next;
+  if(w->next)
+    w->next->prev = w->prev;
+}
+
+/* free a watch, the cache it was for must be locked */
+static void idle_watch_free(struct Curl_idle_watch *w)
+{
+  if(w->share)
+    w->share->idle_watches--;
+  free(w);
+}
+
+/*
+ * The sockhash entry of a watch is found in the way of a socket that is
+ * used again with the same number, so the connection that was watched is
+ * gone. Only the entry is removed here since the caller may not be able to
+ * lock the cache, idle_sweep() frees the watch later.
+ */
+static void idle_entry_stale(struct Curl_multi *multi,
+                             struct Curl_sh_entry *entry)
+{
+  struct Curl_idle_watch *w = entry->idle;
+
+  idle_entry_remove(multi, entry);
+  idle_watch_unlink(multi, w);
+  w->next = multi->idle_stale;
+  multi->idle_stale = w;
+}
+
+static void idle_sweep(struct Curl_multi *multi)
+{
+  while(multi->idle_stale) {
+    struct Curl_idle_watch *w = multi->idle_stale;
+
+    multi->idle_stale = w->next;
+    (void)closure_lock(multi, w->share);
+    if(w->conn)
+      w->conn->idle_watch = NULL;
+    idle_watch_free(w);
+    closure_unlock(multi);
+  }
+}
+
+void Curl_multi_idle_watch(struct SessionHandle *data,
+                           struct connectdata *conn)
+{
+  struct Curl_multi *multi = data->multi;
+  curl_socket_t s = conn->sock[FIRSTSOCKET];
+  struct Curl_sh_entry *entry;
+  struct Curl_idle_watch *w;
+
+  /* RTSP connections get data while idle, see Curl_rtsp_connisdead() */
+  if(!multi || conn->idle_watch || (s == CURL_SOCKET_BAD) ||
+     (conn->handler->protocol & CURLPROTO_RTSP))
+    return;
+
+  entry = sh_getentry(&multi->sockhash, s);
+  if(entry && entry->idle)
+    idle_entry_stale(multi, entry);
+
+  w = malloc(sizeof(struct Curl_idle_watch));
+  if(!w)
+    return; /* left for the pruning */
+  entry = sh_addentry(&multi->sockhash, s, NULL);
+  if(!entry) {
+    free(w);
+    return;
+  }
+
+  w->multi = multi;
+  w->conn = conn;
+  w->share = NULL;
+  if(data->share && (data->state.conn_cache == data->share->conn_cache)) {
+    w->share = data->share;
+    w->share->idle_watches++;
+  }
+  w->sock = s;
+  w->prev = NULL;
+  w->next = multi->idle_watches;
+  if(w->next)
+    w->next->prev = w;
+  multi->idle_watches = w;
+  conn->idle_watch = w;
+
+  /* the entry no longer belongs to the transfer that used the socket */
+  entry->easy = NULL;
+  entry->idle = w;
+  if(entry->action != CURL_POLL_IN) {
+    if(multi->socket_cb)
+      multi->socket_cb(multi->closure_handle, s, CURL_POLL_IN,
+                       multi->socket_userp, entry->socketp);
+    multi_epoll_update(multi, entry, CURL_POLL_IN);
+    entry->action = CURL_POLL_IN;
+  }
+}
+
+void Curl_multi_idle_unwatch(struct SessionHandle *data,
+                             struct connectdata *conn)
+{
+  struct Curl_idle_watch *w = conn->idle_watch;
+
+  if(!w)
+    return;
+  conn->idle_watch = NULL;
+
+  if(w->multi == data->multi) {
+    struct Curl_multi *multi = w->multi;
+    struct Curl_sh_entry *entry = sh_getentry(&multi->sockhash, w->sock);
+
+    if(entry && (entry->idle == w))
+      idle_entry_remove(multi, entry);
+    idle_watch_unlink(multi, w);
+    idle_watch_free(w);
+  }
+  else
+    /* the multi handle watching it finds out later */
+    w->conn = NULL;
+}
+
+/* there is activity on the socket of a watched idle connection */
+static void multi_idle_event(struct Curl_multi *multi,
+                             struct Curl_sh_entry *entry)
+{
+  struct Curl_idle_watch *w = entry->idle;
+  struct SessionHandle *closure = closure_lock(multi, w->share);
+
+  if(w->conn) {
+    SIGPIPE_VARIABLE(pipe_st);
+
+    /* closing the connection drops the watch */
+    sigpipe_ignore(closure, &pipe_st);
+    (void)Curl_disconnect_if_dead(w->conn, closure);
+    sigpipe_restore(&pipe_st);
+  }
+  else {
+    idle_entry_remove(multi, entry);
+    idle_watch_unlink(multi, w);
+    idle_watch_free(w);
+  }
+  closure_unlock(multi);
+}
+
+/* stop watching when the multi handle goes away, the connections still
+   watched are in caches shared with others and stay there */
+static void multi_idle_cleanup(struct Curl_multi *multi)
+{
+  idle_sweep(multi);
+  while(multi->idle_watches) {
+    struct Curl_idle_watch *w = multi->idle_watches;
+    struct Curl_sh_entry *entry = sh_getentry(&multi->sockhash, w->sock);
+
+    (void)closure_lock(multi, w->share);
+    if(w->conn)
+      w->conn->idle_watch = NULL;
+    if(entry && (entry->idle == w))
+      idle_entry_remove(multi, entry);
+    idle_watch_unlink(multi, w);
+    idle_watch_free(w);
+    closure_unlock(multi);
+  }
+}
+
+/* fill in pollfds for the watched idle sockets if 'ufds' is set, return how
+   many there are */
+static unsigned int multi_idle_fds(struct Curl_multi *multi,
+                                   struct pollfd *ufds)
+{
+  struct Curl_idle_watch *w;
+  unsigned int n = 0;
+
+  for(w = multi->idle_watches; w; w = w->next) {
+    if(ufds) {
+      ufds[n].fd = w->sock;
+      ufds[n].events = POLLIN;
+      ufds[n].revents = 0;
+    }
+    n++;
+  }
+  return n;
+}
+
+/* act on the 'n' watched idle sockets in 'ufds' that had activity, return
+   how many did */
+static unsigned int multi_idle_check(struct Curl_multi *multi,
+                                     struct pollfd *ufds, unsigned int n)
+{
+  unsigned int i;
+  unsigned int active = 0;
+
+  for(i = 0; i < n; i++) {
+    if(ufds[i].revents) {
+      struct Curl_sh_entry *entry = sh_getentry(&multi->sockhash,
+                                                ufds[i].fd);
+      if(entry && entry->idle)
+        multi_idle_event(multi, entry);
+      active++;
+    }
+  }
+  return active;
+}
+
+#ifdef USE_EPOLL
+/* number of pollfd structs kept on the stack before curl_multi_wait() needs
+   to allocate an array for the application's extra descriptors */
+#define NUM_POLLS_ON_STACK 10
+
+/*
+ * multi_epoll_wait() is the curl_multi_wait() backend used when the multi
+ * handle has an epoll interest set. Instead of asking every easy handle for
+ * its sockets, it polls on the single epoll descriptor together with the
+ * application's extra descriptors.
+ */
+static CURLMcode multi_epoll_wait(struct Curl_multi *multi,
+                                  struct curl_waitfd extra_fds[],
+                                  unsigned int extra_nfds,
+                                  int timeout_ms,
+                                  int *ret)
+{
+  struct pollfd a_few_on_stack[NUM_POLLS_ON_STACK];
+  struct pollfd *ufds = &a_few_on_stack[0];
+  unsigned int curlfds = multi->epoll_nfds ? 1 : 0;
+  unsigned int wakeup = (multi_wakeup_fd(multi) != -1) ? 1 : 0;
+  unsigned int nfds = curlfds + extra_nfds + wakeup;
+  unsigned int i;
+  int rc = 0;
+  bool readiness = TRUE;
+
+  if(nfds > NUM_POLLS_ON_STACK) {
+    ufds = malloc(nfds * sizeof(struct pollfd));
+    if(!ufds)
+      return CURLM_OUT_OF_MEMORY;
+  }
+
+  if(curlfds) {
+    ufds[0].fd = multi->epollfd;
+    ufds[0].events = POLLIN;
+    ufds[0].revents = 0;
+  }
+
+  /* Add external file descriptions from poll-like struct curl_waitfd */
+  for(i = 0; i < extra_nfds; i++) {
+    struct pollfd *p = &ufds[curlfds + i];
+    p->fd = extra_fds[i].fd;
+    p->events = 0;
+    p->revents = 0;
+    if(extra_fds[i].events & CURL_WAIT_POLLIN)
+      p->events |= POLLIN;
+    if(extra_fds[i].events & CURL_WAIT_POLLPRI)
+      p->events |= POLLPRI;
+    if(extra_fds[i].events & CURL_WAIT_POLLOUT)
+      p->events |= POLLOUT;
+  }
+
+  /* the wakeup descriptor goes last */
+  if(wakeup) {
+    ufds[nfds - 1].fd = multi_wakeup_fd(multi);
+    ufds[nfds - 1].events = POLLIN;
+    ufds[nfds - 1].revents = 0;
+  }
+
+  if(nfds)
+    rc = Curl_poll(ufds, nfds, timeout_ms);
+
+  if(rc > 0) {
+    if(wakeup && ufds[nfds - 1].revents) {
+      /* a wakeup is not an event to report */
+      multi_wakeup_drain(multi);
+      rc--;
+    }
+
+    if(multi->epoll_nfds && ufds[0].revents) {
+      /* the epoll descriptor counts as one, replace that with the number of
+         curl sockets that are actually ready and queue their handles */
+      struct epoll_event a_few_events[NUM_POLLS_ON_STACK];
+      struct epoll_event *events = &a_few_events[0];
+      int maxevents = NUM_POLLS_ON_STACK;
+      int n;
+
+      if(multi->epoll_nfds > NUM_POLLS_ON_STACK) {
+        events = malloc(multi->epoll_nfds * sizeof(struct epoll_event));
+        if(events)
+          maxevents = multi->epoll_nfds;
+        else {
+          /* without the full list we can't tell which handles to run */
+          events = &a_few_events[0];
+          readiness = FALSE;
+        }
+      }
+
+      n = epoll_wait(multi->epollfd, events, maxevents, 0);
+      if(n > 0) {
+        int e;
+        rc += n - 1;
+        for(e = 0; e < n; e++) {
+          curl_socket_t s = events[e].data.fd;
+          struct Curl_sh_entry *entry =
+            sh_getentry(&multi->sockhash, s);
+          if(entry && entry->idle) {
+            /* idle connections are not reported either */
+            multi_idle_event(multi, entry);
+            rc--;
+          }
+          else if(entry)
+            multi_readyadd(multi, entry->easy);
+        }
+      }
+
+      if(events != &a_few_events[0])
+        free(events);
+    }
+
+    /* copy revents results from the poll to the curl_multi_wait poll
+       struct, the bit values of the actual underlying poll() implementation
+       may not be the same as the ones in the public libcurl API! */
+    for(i = 0; i < extra_nfds; i++) {
+      unsigned short mask = 0;
+      unsigned r = ufds[curlfds + i].revents;
+
+      if(r & POLLIN)
+        mask |= CURL_WAIT_POLLIN;
+      if(r & POLLOUT)
+        mask |= CURL_WAIT_POLLOUT;
+      if(r & POLLPRI)
+        mask |= CURL_WAIT_POLLPRI;
+
+      extra_fds[i].revents = mask;
+    }
+  }
+
+  if(ufds != &a_few_on_stack[0])
+    free(ufds);
+
+  /* all socket activity is in the ready queue now */
+  multi->ready_valid = (rc >= 0) && readiness;
+
+  if(ret)
+    *ret = rc;
+  return CURLM_OK;
+}
+#endif
+
 CURLMcode curl_multi_wait(CURLM *multi_handle,
                           struct curl_waitfd extra_fds[],
                           unsigned int extra_nfds,
@@ -795,12 +1857,18 @@ CURLMcode curl_multi_wait(CURLM *multi_handle,
   unsigned int i;
   unsigned int nfds = 0;
   unsigned int curlfds;
+  unsigned int idlefds;
+  unsigned int wakeup = 0;
   struct pollfd *ufds = NULL;
+  struct SessionHandle **owners = NULL;
   long timeout_internal;
 
   if(!GOOD_MULTI_HANDLE(multi))
     return CURLM_BAD_HANDLE;
 
+  /* set again below once all socket activity has been collected */
+  multi->ready_valid = FALSE;
+
   /* If the internally desired timeout is actually shorter than requested from
      the outside, then use the shorter time! But only if the internal timer
      is actually larger than -1! */
@@ -808,6 +1876,17 @@ CURLMcode curl_multi_wait(CURLM *multi_handle,
   if((timeout_internal >= 0) && (timeout_internal < (long)timeout_ms))
     timeout_ms = (int)timeout_internal;
 
+  /* handles already in the ready queue need to run without delay */
+  if(multi->readyp)
+    timeout_ms = 0;
+
+#ifdef USE_EPOLL
+  /* a socket shared by several pipelined handles only has one action in the
+     sockhash, so pipelining keeps using a freshly built poll set */
+  if((multi->epollfd != -1) && !multi->pipelining_enabled)
+    return multi_epoll_wait(multi, extra_fds, extra_nfds, timeout_ms, ret);
+#endif
+
   /* Count up how many fds we have from the multi handle */
   data=multi->easyp;
   while(data) {
@@ -832,20 +1911,34 @@ CURLMcode curl_multi_wait(CURLM *multi_handle,
     data = data->next; /* check next handle */
   }
 
-  curlfds = nfds; /* number of internal file descriptors */
-  nfds += extra_nfds; /* add the externally provided ones */
+  idlefds = multi_idle_fds(multi, NULL);
+  curlfds = nfds + idlefds; /* number of internal file descriptors */
+  nfds = curlfds + extra_nfds; /* add the externally provided ones */
+  if(multi_wakeup_fd(multi) != -1) {
+    wakeup = 1;
+    nfds++;
+  }
 
-  if(nfds || extra_nfds) {
+  if(nfds) {
     ufds = malloc(nfds * sizeof(struct pollfd));
     if(!ufds)
       return CURLM_OUT_OF_MEMORY;
   }
+  if((curlfds > idlefds) && !multi->pipelining_enabled) {
+    /* remember which handle each descriptor belongs to, to know what to put
+       in the ready queue */
+    owners = malloc((curlfds - idlefds) * sizeof(struct SessionHandle *));
+    if(!owners) {
+      Curl_safefree(ufds);
+      return CURLM_OUT_OF_MEMORY;
+    }
+  }
   nfds = 0;
 
   /* only do the second loop if we found descriptors in the first stage run
      above */
 
-  if(curlfds) {
+  if(curlfds > idlefds) {
     /* Add the curl handles to our pollfds first */
     data=multi->easyp;
     while(data) {
@@ -857,12 +1950,16 @@ CURLMcode curl_multi_wait(CURLM *multi_handle,
         if(bitmap & GETSOCK_READSOCK(i)) {
           ufds[nfds].fd = sockbunch[i];
           ufds[nfds].events = POLLIN;
+          if(owners)
+            owners[nfds] = data;
           ++nfds;
           s = sockbunch[i];
         }
         if(bitmap & GETSOCK_WRITESOCK(i)) {
           ufds[nfds].fd = sockbunch[i];
           ufds[nfds].events = POLLOUT;
+          if(owners)
+            owners[nfds] = data;
           ++nfds;
           s = sockbunch[i];
         }
@@ -875,6 +1972,9 @@ CURLMcode curl_multi_wait(CURLM *multi_handle,
     }
   }
 
+  /* then the idle connections */
+  nfds += multi_idle_fds(multi, &ufds[nfds]);
+
   /* Add external file descriptions from poll-like struct curl_waitfd */
   for(i = 0; i < extra_nfds; i++) {
     ufds[nfds].fd = extra_fds[i].fd;
@@ -888,13 +1988,37 @@ CURLMcode curl_multi_wait(CURLM *multi_handle,
     ++nfds;
   }
 
+  /* the wakeup descriptor goes last */
+  if(wakeup) {
+    ufds[nfds].fd = multi_wakeup_fd(multi);
+    ufds[nfds].events = POLLIN;
+    ++nfds;
+  }
+
   if(nfds) {
     /* wait... */
     infof(data, "Curl_poll(%d ds, %d ms)\n", nfds, timeout_ms);
     i = Curl_poll(ufds, nfds, timeout_ms);
 
-    if(i) {
+    if((int)i > 0) {
       unsigned int j;
+
+      if(wakeup && ufds[nfds - 1].revents) {
+        /* a wakeup is not an event to report */
+        multi_wakeup_drain(multi);
+        i--;
+      }
+
+      if(idlefds)
+        /* idle connections are not reported either */
+        i -= multi_idle_check(multi, &ufds[curlfds - idlefds], idlefds);
+
+      if(owners) {
+        for(j = 0; j < curlfds - idlefds; j++)
+          if(ufds[j].revents)
+            multi_readyadd(multi, owners[j]);
+      }
+
       /* copy revents results from the poll to the curl_multi_wait poll
          struct, the bit values of the actual underlying poll() implementation
          may not be the same as the ones in the public libcurl API! */
@@ -913,13 +2037,101 @@ CURLMcode curl_multi_wait(CURLM *multi_handle,
       }
     }
   }
-  else
-    i = 0;
-
-  Curl_safefree(ufds);
-  if(ret)
-    *ret = i;
-  return CURLM_OK;
+  else
+    i = 0;
+
+  Curl_safefree(ufds);
+  Curl_safefree(owners);
+
+  /* with pipelining, several handles share a socket and the ready queue
+     can't tell which of them to run */
+  multi->ready_valid = ((int)i >= 0) && !multi->pipelining_enabled;
+
+  if(ret)
+    *ret = i;
+  return CURLM_OK;
+}
+
+/*
+ * curl_multi_prewarm() adds 'count' copies of the given easy handle that
+ * only connect, each to a new connection. Once connected, those handles are
+ * done and their connections are left in the connection cache for the
+ * transfers that come later, then the handles are removed and closed
+ * without any message.
+ */
+CURLMcode curl_multi_prewarm(CURLM *multi_handle, CURL *easy_handle,
+                             int count)
+{
+  struct Curl_multi *multi = (struct Curl_multi *)multi_handle;
+  struct SessionHandle *orig = (struct SessionHandle *)easy_handle;
+  int i;
+
+  if(!GOOD_MULTI_HANDLE(multi))
+    return CURLM_BAD_HANDLE;
+
+  if(!GOOD_EASY_HANDLE(easy_handle))
+    return CURLM_BAD_EASY_HANDLE;
+
+  for(i = 0; i < count; i++) {
+    CURLMcode result;
+    struct SessionHandle *data = curl_easy_duphandle(orig);
+
+    if(!data)
+      return CURLM_OUT_OF_MEMORY;
+
+    /* a copied handle doesn't use the share object, it needs to in order
+       to put the connection in a shared connection cache */
+    if(orig->share &&
+       curl_easy_setopt(data, CURLOPT_SHARE, orig->share)) {
+      Curl_close(data);
+      return CURLM_OUT_OF_MEMORY;
+    }
+
+    data->set.connect_only = TRUE;
+    data->set.reuse_fresh = TRUE; /* don't pick one made a moment ago */
+    data->prewarm = TRUE;
+
+    result = curl_multi_add_handle(multi_handle, data);
+    if(result) {
+      Curl_close(data);
+      return result;
+    }
+  }
+
+  return CURLM_OK;
+}
+
+CURLMcode curl_multi_wakeup(CURLM *multi_handle)
+{
+  /* this function is called from another thread than the one using the
+     multi handle, so it must not touch anything but the wakeup descriptor */
+  struct Curl_multi *multi=(struct Curl_multi *)multi_handle;
+
+  if(!GOOD_MULTI_HANDLE(multi))
+    return CURLM_BAD_HANDLE;
+
+#ifdef ENABLE_WAKEUP
+  if(multi->wakeup_fds[1] != -1) {
+    for(;;) {
+#ifdef HAVE_EVENTFD
+      if(!eventfd_write(multi->wakeup_fds[1], 1))
+        return CURLM_OK;
+#else
+      char c = 1;
+      if(write(multi->wakeup_fds[1], &c, 1) == 1)
+        return CURLM_OK;
+#endif
+      if(ERRNO == EINTR)
+        continue;
+      /* the descriptor is full of wakeups nobody has consumed yet, so the
+         next wait returns immediately anyway */
+      if((ERRNO == EAGAIN) || (ERRNO == EWOULDBLOCK))
+        return CURLM_OK;
+      break;
+    }
+  }
+#endif
+  return CURLM_WAKEUP_FAILURE;
 }
 
 static CURLMcode multi_runsingle(struct Curl_multi *multi,
@@ -1052,11 +2264,8 @@ static CURLMcode multi_runsingle(struct Curl_multi *multi,
            state and wait for an available connection. */
         multistate(data, CURLM_STATE_CONNECT_PEND);
 
-        /* add this handle to the list of connect-pending handles */
-        if(!Curl_llist_insert_next(multi->pending, multi->pending->tail, data))
-          result = CURLE_OUT_OF_MEMORY;
-        else
-          result = CURLE_OK;
+        /* add this handle to the queue of connect-pending handles */
+        result = multi_pend(multi, data);
         break;
       }
 
@@ -1096,6 +2305,7 @@ static CURLMcode multi_runsingle(struct Curl_multi *multi,
     {
       struct Curl_dns_entry *dns = NULL;
       struct connectdata *conn = data->easy_conn;
+      bool negative = FALSE;
 
       /* check if we have the name resolved by now */
       if(data->share)
@@ -1103,7 +2313,14 @@ static CURLMcode multi_runsingle(struct Curl_multi *multi,
 
       dns = Curl_fetch_addr(conn, conn->host.name, (int)conn->port);
 
-      if(dns) {
+      if(dns && !dns->addr) {
+        /* another transfer has found out that the name doesn't resolve */
+        failf(data, "Could not resolve host: %s (cached)", conn->host.name);
+        result = CURLE_COULDNT_RESOLVE_HOST;
+        negative = TRUE;
+        dns = NULL;
+      }
+      else if(dns) {
         dns->inuse++; /* we use it! */
 #ifdef CURLRES_ASYNCH
         conn->async.dns = dns;
@@ -1116,7 +2333,7 @@ static CURLMcode multi_runsingle(struct Curl_multi *multi,
       if(data->share)
         Curl_share_unlock(data, CURL_LOCK_DATA_DNS);
 
-      if(!dns)
+      if(!dns && !negative)
         result = Curl_resolver_is_resolved(data->easy_conn, &dns);
 
       /* Update sockets here, because the socket(s) may have been
@@ -1431,8 +2648,10 @@ static CURLMcode multi_runsingle(struct Curl_multi *multi,
     case CURLM_STATE_DO_DONE:
       /* Move ourselves from the send to recv pipeline */
       Curl_move_handle_from_send_to_recv_pipe(data, data->easy_conn);
-      /* Check if we can move pending requests to send pipe */
-      Curl_multi_process_pending_handles(multi);
+      /* Check if we can move pending requests to send pipe. Without
+         pipelining the connection is still busy, so there's no point. */
+      if(multi->pipelining_enabled)
+        Curl_multi_process_pending_handles(multi, data->easy_conn);
 
       /* Only perform the transfer if there's a good socket to work with.
          Having both BAD is a signal to skip immediately to DONE */
@@ -1497,7 +2716,7 @@ static CURLMcode multi_runsingle(struct Curl_multi *multi,
                            data->set.buffer_size : BUFSIZE);
         timeout_ms = Curl_sleep_time(data->set.max_send_speed,
                                      data->progress.ulspeed, buffersize);
-        Curl_expire_latest(data, timeout_ms);
+        Curl_expire_latest(data, timeout_ms, EXPIRE_TOOFAST);
         break;
       }
 
@@ -1513,7 +2732,7 @@ static CURLMcode multi_runsingle(struct Curl_multi *multi,
                            data->set.buffer_size : BUFSIZE);
         timeout_ms = Curl_sleep_time(data->set.max_recv_speed,
                                      data->progress.dlspeed, buffersize);
-        Curl_expire_latest(data, timeout_ms);
+        Curl_expire_latest(data, timeout_ms, EXPIRE_TOOFAST);
         break;
       }
 
@@ -1575,10 +2794,11 @@ static CURLMcode multi_runsingle(struct Curl_multi *multi,
 
         /* expire the new receiving pipeline head */
         if(data->easy_conn->recv_pipe->head)
-          Curl_expire_latest(data->easy_conn->recv_pipe->head->ptr, 1);
+          Curl_expire_latest(data->easy_conn->recv_pipe->head->ptr, 1,
+                             EXPIRE_RUN_NOW);
 
         /* Check if we can move pending requests to send pipe */
-        Curl_multi_process_pending_handles(multi);
+        Curl_multi_process_pending_handles(multi, data->easy_conn);
 
         /* When we follow redirects or is set to retry the connection, we must
            to go back to the CONNECT state */
@@ -1640,10 +2860,13 @@ static CURLMcode multi_runsingle(struct Curl_multi *multi,
       if(data->easy_conn) {
         CURLcode res;
 
-        /* Remove ourselves from the receive pipeline, if we are there. */
-        Curl_removeHandleFromPipeline(data, data->easy_conn->recv_pipe);
-        /* Check if we can move pending requests to send pipe */
-        Curl_multi_process_pending_handles(multi);
+        /* Remove ourselves from the receive pipeline, if we are there. A
+           handle that was still in a pipeline has not yet let a waiting
+           handle know that it is done with the connection. */
+        if(Curl_removeHandleFromPipeline(data, data->easy_conn->recv_pipe) ||
+           isHandleInPipeline(data, data->easy_conn->send_pipe))
+          /* Check if we can move pending requests to send pipe */
+          Curl_multi_process_pending_handles(multi, data->easy_conn);
 
         /* post-transfer command */
         res = Curl_done(&data->easy_conn, result, FALSE);
@@ -1686,7 +2909,7 @@ static CURLMcode multi_runsingle(struct Curl_multi *multi,
          that could be freed anytime */
       data->easy_conn = NULL;
 
-      Curl_expire(data, 0); /* stop all timers */
+      Curl_expire_clear(data); /* stop all timers */
       break;
 
     case CURLM_STATE_MSGSENT:
@@ -1711,13 +2934,18 @@ static CURLMcode multi_runsingle(struct Curl_multi *multi,
         data->state.pipe_broke = FALSE;
 
         if(data->easy_conn) {
+          int inpipe;
+
           /* if this has a connection, unsubscribe from the pipelines */
           data->easy_conn->writechannel_inuse = FALSE;
           data->easy_conn->readchannel_inuse = FALSE;
-          Curl_removeHandleFromPipeline(data, data->easy_conn->send_pipe);
-          Curl_removeHandleFromPipeline(data, data->easy_conn->recv_pipe);
-          /* Check if we can move pending requests to send pipe */
-          Curl_multi_process_pending_handles(multi);
+          inpipe = Curl_removeHandleFromPipeline(data,
+                                                 data->easy_conn->send_pipe);
+          inpipe += Curl_removeHandleFromPipeline(data,
+                                                  data->easy_conn->recv_pipe);
+          if(inpipe)
+            /* Check if we can move pending requests to send pipe */
+            Curl_multi_process_pending_handles(multi, data->easy_conn);
 
           if(disconnect_conn) {
             /* Don't attempt to send data over a connection that timed out */
@@ -1752,7 +2980,17 @@ static CURLMcode multi_runsingle(struct Curl_multi *multi,
       }
     }
 
-    if(CURLM_STATE_COMPLETED == data->mstate) {
+    if((CURLM_STATE_COMPLETED == data->mstate) && data->prewarm) {
+      /* nobody reads a message about a prewarming handle, the connection
+         is in the cache now (unless it failed) and the handle is closed
+         before returning to the application */
+      data->prewarm_next = multi->prewarm_done;
+      multi->prewarm_done = data;
+      rc = CURLM_OK;
+
+      multistate(data, CURLM_STATE_MSGSENT);
+    }
+    else if(CURLM_STATE_COMPLETED == data->mstate) {
       /* now fill in the Curl_message with this info */
       msg = &data->msg;
 
@@ -1760,7 +2998,8 @@ static CURLMcode multi_runsingle(struct Curl_multi *multi,
       msg->extmsg.easy_handle = data;
       msg->extmsg.data.result = result;
 
-      rc = multi_addmsg(multi, msg);
+      multi_addmsg(multi, msg);
+      rc = CURLM_OK;
 
       multistate(data, CURLM_STATE_MSGSENT);
     }
@@ -1773,64 +3012,140 @@ static CURLMcode multi_runsingle(struct Curl_multi *multi,
 }
 
 
+/*
+ * multi_perform_one() runs a single easy handle on behalf of
+ * curl_multi_perform().
+ */
+static CURLMcode multi_perform_one(struct Curl_multi *multi,
+                                   struct timeval now,
+                                   struct SessionHandle *data)
+{
+  CURLMcode result;
+  struct WildcardData *wc = &data->wildcard;
+  CURLMstate state = data->mstate;
+  SIGPIPE_VARIABLE(pipe_st);
+
+  if(data->set.wildcardmatch) {
+    if(!wc->filelist) {
+      CURLcode ret = Curl_wildcard_init(wc); /* init wildcard structures */
+      if(ret)
+        return CURLM_OUT_OF_MEMORY;
+    }
+  }
+
+  sigpipe_ignore(data, &pipe_st);
+  result = multi_runsingle(multi, now, data);
+  sigpipe_restore(&pipe_st);
+
+  if((data->mstate != state) && (data->mstate < CURLM_STATE_COMPLETED))
+    /* some state changes leave the handle waiting for neither a socket nor
+       a timer, so run it again when the state moved on */
+    multi_readyadd(multi, data);
+
+#ifdef USE_EPOLL
+  if(multi->epollfd != -1)
+    /* keep the epoll interest set current for curl_multi_wait() */
+    singlesocket(multi, data);
+#endif
+
+  if(data->set.wildcardmatch) {
+    /* destruct wildcard structures if it is needed */
+    if(wc->state == CURLWC_DONE || result)
+      Curl_wildcard_dtor(wc);
+  }
+
+  return result;
+}
+
 CURLMcode curl_multi_perform(CURLM *multi_handle, int *running_handles)
 {
   struct Curl_multi *multi=(struct Curl_multi *)multi_handle;
   struct SessionHandle *data;
   CURLMcode returncode=CURLM_OK;
-  struct Curl_tree *t;
+  struct Curl_wheel_node *t;
   struct timeval now = Curl_tvnow();
 
   if(!GOOD_MULTI_HANDLE(multi))
     return CURLM_BAD_HANDLE;
 
-  data=multi->easyp;
-  while(data) {
-    CURLMcode result;
-    struct WildcardData *wc = &data->wildcard;
-    SIGPIPE_VARIABLE(pipe_st);
-
-    if(data->set.wildcardmatch) {
-      if(!wc->filelist) {
-        CURLcode ret = Curl_wildcard_init(wc); /* init wildcard structures */
-        if(ret)
-          return CURLM_OUT_OF_MEMORY;
+  if(multi->ready_valid) {
+    /*
+     * curl_multi_wait() has put all handles with socket activity in the
+     * ready queue. Add the ones with expired timers and only run what is in
+     * the queue, so that idle handles cost nothing here.
+     */
+    do {
+      t = Curl_wheel_getbest(&multi->timers, now);
+      if(t) {
+        multi_readyadd(multi, t->payload);
+        /* the removed may have another timeout in queue */
+        (void)add_next_timeout(now, multi, t->payload);
       }
+    } while(t);
+
+    /* Run the queue from the front until it is empty or the first handle
+       has run in this call already. Each handle runs at most once per call:
+       one that is queued again goes to the back, and it and everything
+       queued after it, like pending handles that got a connection, are
+       left for the next call. curl_multi_wait() returns at once while the
+       queue isn't empty, so they don't wait for socket activity. */
+    multi->perform_round++;
+    while(multi->readyp) {
+      CURLMcode result;
+
+      data = multi->readyp;
+      if(data->ready_round == multi->perform_round)
+        break;
+      multi_readyremove(multi, data);
+      data->ready_round = multi->perform_round;
+
+      result = multi_perform_one(multi, now, data);
+      if(result)
+        returncode = result;
     }
+  }
+  else {
+    /* every handle gets run below so the queue is taken care of too */
+    while(multi->readyp)
+      multi_readyremove(multi, multi->readyp);
 
-    sigpipe_ignore(data, &pipe_st);
-    result = multi_runsingle(multi, now, data);
-    sigpipe_restore(&pipe_st);
+    data=multi->easyp;
+    while(data) {
+      CURLMcode result = multi_perform_one(multi, now, data);
+      if(result)
+        returncode = result;
 
-    if(data->set.wildcardmatch) {
-      /* destruct wildcard structures if it is needed */
-      if(wc->state == CURLWC_DONE || result)
-        Curl_wildcard_dtor(wc);
+      data = data->next; /* operate on next handle */
     }
 
-    if(result)
-      returncode = result;
-
-    data = data->next; /* operate on next handle */
+    /*
+     * Simply remove all expired timers from the wheel since handles are
+     * dealt with unconditionally by this function and curl_multi_timeout()
+     * requires that already passed/handled expire times are removed from
+     * the wheel.
+     *
+     * It is important that the 'now' value is set at the entry of this
+     * function and not for the current time as it may have ticked a little
+     * while since then and then we risk this loop to remove timers that
+     * actually have not been handled!
+     */
+    do {
+      t = Curl_wheel_getbest(&multi->timers, now);
+      if(t)
+        /* the removed may have another timeout in queue */
+        (void)add_next_timeout(now, multi, t->payload);
+
+    } while(t);
   }
 
-  /*
-   * Simply remove all expired timers from the splay since handles are dealt
-   * with unconditionally by this function and curl_multi_timeout() requires
-   * that already passed/handled expire times are removed from the splay.
-   *
-   * It is important that the 'now' value is set at the entry of this function
-   * and not for the current time as it may have ticked a little while since
-   * then and then we risk this loop to remove timers that actually have not
-   * been handled!
-   */
-  do {
-    multi->timetree = Curl_splaygetbest(now, multi->timetree, &t);
-    if(t)
-      /* the removed may have another timeout in queue */
-      (void)add_next_timeout(now, multi, t->payload);
+  /* the socket activity curl_multi_wait() found has now been acted on */
+  multi->ready_valid = FALSE;
 
-  } while(t);
+  multi_prune(multi);
+  multi_dns_refresh(multi);
+
+  multi_prewarm_reap(multi);
+  multi_completions(multi);
 
   *running_handles = multi->num_alive;
 
@@ -1840,24 +3155,6 @@ CURLMcode curl_multi_perform(CURLM *multi_handle, int *running_handles)
   return returncode;
 }
 
-static void close_all_connections(struct Curl_multi *multi)
-{
-  struct connectdata *conn;
-
-  conn = Curl_conncache_find_first_connection(multi->conn_cache);
-  while(conn) {
-    SIGPIPE_VARIABLE(pipe_st);
-    conn->data = multi->closure_handle;
-
-    sigpipe_ignore(conn->data, &pipe_st);
-    /* This will remove the connection from the cache */
-    (void)Curl_disconnect(conn, FALSE);
-    sigpipe_restore(&pipe_st);
-
-    conn = Curl_conncache_find_first_connection(multi->conn_cache);
-  }
-}
-
 CURLMcode curl_multi_cleanup(CURLM *multi_handle)
 {
   struct Curl_multi *multi=(struct Curl_multi *)multi_handle;
@@ -1870,8 +3167,17 @@ CURLMcode curl_multi_cleanup(CURLM *multi_handle)
 
     multi->type = 0; /* not good anymore */
 
+    /* stop the background resolves */
+    while(multi->dns_refresh) {
+      struct Curl_dns_refresh *refresh = multi->dns_refresh;
+      multi->dns_refresh = refresh->next;
+      Curl_dns_refresh_free(refresh);
+    }
+
     /* Close all the connections in the connection cache */
-    close_all_connections(multi);
+    Curl_conncache_close_all_connections(multi->conn_cache,
+                                         multi->closure_handle);
+    multi_idle_cleanup(multi);
 
     if(multi->closure_handle) {
       sigpipe_ignore(multi->closure_handle, &pipe_st);
@@ -1884,15 +3190,22 @@ CURLMcode curl_multi_cleanup(CURLM *multi_handle)
       Curl_close(multi->closure_handle);
     }
 
-    Curl_hash_destroy(multi->sockhash);
+    sh_destroy(&multi->sockhash);
+#ifdef USE_EPOLL
+    if(multi->epollfd != -1)
+      close(multi->epollfd);
+#endif
+    multi_wakeup_cleanup(multi);
     Curl_conncache_destroy(multi->conn_cache);
-    Curl_llist_destroy(multi->msglist, NULL);
-    Curl_llist_destroy(multi->pending, NULL);
+    Curl_hash_destroy(multi->pendhash);
+    Curl_resolver_multi_cleanup(multi->resolver);
 
     /* remove all easy handles */
     data = multi->easyp;
     while(data) {
       nextdata=data->next;
+      if(data->set.str[STRING_DNS_CACHE_FILE])
+        Curl_hostcache_save(data);
       if(data->dns.hostcachetype == HCACHE_MULTI) {
         /* clear out the usage of the shared DNS cache */
         Curl_hostcache_clean(data, data->dns.hostcache);
@@ -1904,10 +3217,30 @@ CURLMcode curl_multi_cleanup(CURLM *multi_handle)
       data->state.conn_cache = NULL;
       data->multi = NULL; /* clear the association */
 
+      /* the message queue and the wait queues are gone */
+      data->msg.queued = FALSE;
+      data->msg.next = data->msg.prev = NULL;
+      data->pendq = NULL;
+      data->pend_woken = FALSE;
+      data->pend_next = data->pend_prev = NULL;
+
+      if(data->prewarm)
+        /* the application doesn't know about these */
+        Curl_close(data);
+
       data = nextdata;
     }
 
-    Curl_hash_destroy(multi->hostcache);
+    while(multi->shares) {
+      struct Curl_multi_share *s = multi->shares;
+      multi->shares = s->next;
+      free(s);
+    }
+
+    Curl_hostcache_destroy(multi->hostcache);
+
+    /* all connections are closed, the structs they used can go */
+    Curl_free_conn_pool(multi);
 
     /* Free the blacklists by setting them to NULL */
     Curl_pipeline_set_site_blacklist(NULL, &multi->pipelining_site_bl);
@@ -1940,19 +3273,12 @@ CURLMsg *curl_multi_info_read(CURLM *multi_handle, int *msgs_in_queue)
 
   *msgs_in_queue = 0; /* default to none */
 
-  if(GOOD_MULTI_HANDLE(multi) && Curl_llist_count(multi->msglist)) {
-    /* there is one or more messages in the list */
-    struct curl_llist_element *e;
-
-    /* extract the head of the list to return */
-    e = multi->msglist->head;
-
-    msg = e->ptr;
+  if(GOOD_MULTI_HANDLE(multi) && multi->msgp) {
+    /* extract the head of the queue to return */
+    msg = multi->msgp;
+    multi_delmsg(multi, msg);
 
-    /* remove the extracted entry */
-    Curl_llist_remove(multi->msglist, e, NULL);
-
-    *msgs_in_queue = curlx_uztosi(Curl_llist_count(multi->msglist));
+    *msgs_in_queue = multi->num_msgs;
 
     return &msg->extmsg;
   }
@@ -1960,6 +3286,36 @@ CURLMsg *curl_multi_info_read(CURLM *multi_handle, int *msgs_in_queue)
     return NULL;
 }
 
+/*
+ * curl_multi_info_read_batch()
+ *
+ * Like curl_multi_info_read() but extracts up to 'max_msgs' messages in one
+ * call, copied into the array provided by the caller.
+ */
+
+int curl_multi_info_read_batch(CURLM *multi_handle, CURLMsg *msgs,
+                               int max_msgs, int *msgs_in_queue)
+{
+  struct Curl_multi *multi=(struct Curl_multi *)multi_handle;
+  int count = 0;
+
+  *msgs_in_queue = 0; /* default to none */
+
+  if(!GOOD_MULTI_HANDLE(multi) || !msgs)
+    return 0;
+
+  while((count < max_msgs) && multi->msgp) {
+    struct Curl_message *msg = multi->msgp;
+
+    multi_delmsg(multi, msg);
+    msgs[count++] = msg->extmsg;
+  }
+
+  *msgs_in_queue = multi->num_msgs;
+
+  return count;
+}
+
 /*
  * singlesocket() checks what sockets we deal with and their "action state"
  * and if we have a different state in any of those sockets from last time we
@@ -1996,7 +3352,14 @@ static void singlesocket(struct Curl_multi *multi,
     s = socks[i];
 
     /* get it from the hash */
-    entry = Curl_hash_pick(multi->sockhash, (char *)&s, sizeof(s));
+    entry = sh_getentry(&multi->sockhash, s);
+
+    if(entry && entry->idle) {
+      /* the socket number was last used by a connection that was watched
+         while idle and has been closed since */
+      idle_entry_stale(multi, entry);
+      entry = NULL;
+    }
 
     if(curraction & GETSOCK_READSOCK(i))
       action |= CURL_POLL_IN;
@@ -2011,7 +3374,7 @@ static void singlesocket(struct Curl_multi *multi,
     }
     else {
       /* this is a socket we didn't have before, add it! */
-      entry = sh_addentry(multi->sockhash, s, data);
+      entry = sh_addentry(&multi->sockhash, s, data);
       if(!entry)
         /* fatal */
         return;
@@ -2025,6 +3388,8 @@ static void singlesocket(struct Curl_multi *multi,
                        multi->socket_userp,
                        entry->socketp);
 
+    multi_epoll_update(multi, entry, action);
+
     entry->action = action; /* store the current action state */
   }
 
@@ -2047,8 +3412,11 @@ static void singlesocket(struct Curl_multi *multi,
       /* this socket has been removed. Tell the app to remove it */
       remove_sock_from_hash = TRUE;
 
-      entry = Curl_hash_pick(multi->sockhash, (char *)&s, sizeof(s));
-      if(entry) {
+      entry = sh_getentry(&multi->sockhash, s);
+      if(entry && entry->idle)
+        /* the connection is idle now and its socket is watched as such */
+        remove_sock_from_hash = FALSE;
+      else if(entry) {
         /* check if the socket to be removed serves a connection which has
            other easy-s in a pipeline. In this case the socket should not be
            removed. */
@@ -2102,7 +3470,8 @@ static void singlesocket(struct Curl_multi *multi,
                            CURL_POLL_REMOVE,
                            multi->socket_userp,
                            entry->socketp);
-        sh_delentry(multi->sockhash, s);
+        multi_epoll_update(multi, entry, 0);
+        sh_delentry(&multi->sockhash, s);
       }
 
     }
@@ -2129,16 +3498,23 @@ void Curl_multi_closed(struct connectdata *conn, curl_socket_t s)
     /* this is set if this connection is part of a handle that is added to
        a multi handle, and only then this is necessary */
     struct Curl_sh_entry *entry =
-      Curl_hash_pick(multi->sockhash, (char *)&s, sizeof(s));
+      sh_getentry(&multi->sockhash, s);
 
-    if(entry) {
+    if(entry && entry->idle)
+      /* an idle connection that used the same socket number is gone, its
+         own socket was unwatched before it was closed */
+      idle_entry_stale(multi, entry);
+    else if(entry) {
       if(multi->socket_cb)
         multi->socket_cb(conn->data, s, CURL_POLL_REMOVE,
                          multi->socket_userp,
                          entry->socketp);
 
+      /* the socket must leave the epoll set before it gets closed */
+      multi_epoll_update(multi, entry, 0);
+
       /* now remove it from the socket hash */
-      sh_delentry(multi->sockhash, s);
+      sh_delentry(&multi->sockhash, s);
     }
   }
 }
@@ -2149,53 +3525,41 @@ void Curl_multi_closed(struct connectdata *conn, curl_socket_t s)
  * add_next_timeout()
  *
  * Each SessionHandle has a list of timeouts. The add_next_timeout() is called
- * when it has just been removed from the splay tree because the timeout has
- * expired. This function is then to advance in the list to pick the next
+ * when it has just been removed from the timing wheel because the timeout
+ * has expired. This function is then to advance in the list to pick the next
  * timeout to use (skip the already expired ones) and add this node back to
- * the splay tree again.
+ * the wheel again.
  *
- * The splay tree only has each sessionhandle as a single node and the nearest
- * timeout is used to sort it on.
+ * The wheel only has each sessionhandle as a single node and the nearest
+ * timeout is used as its expire time.
  */
 static CURLMcode add_next_timeout(struct timeval now,
                                   struct Curl_multi *multi,
                                   struct SessionHandle *d)
 {
   struct timeval *tv = &d->state.expiretime;
-  struct curl_llist *list = d->state.timeoutlist;
-  struct curl_llist_element *e;
+  struct time_node *node;
 
   /* move over the timeout list for this specific handle and remove all
-     timeouts that are now passed tense and store the next pending
-     timeout in *tv */
-  for(e = list->head; e; ) {
-    struct curl_llist_element *n = e->next;
-    long diff = curlx_tvdiff(*(struct timeval *)e->ptr, now);
-    if(diff <= 0)
-      /* remove outdated entry */
-      Curl_llist_remove(list, e, NULL);
-    else
-      /* the list is sorted so get out on the first mismatch */
-      break;
-    e = n;
+     timeouts that are now passed tense */
+  while((node = d->state.timeoutlist) != NULL && !TV_LATER(node->time, now)) {
+    d->state.timeoutlist = node->next;
+    node->next = NULL;
+    memset(&node->time, 0, sizeof(node->time));
   }
-  e = list->head;
-  if(!e) {
+
+  if(!node) {
     /* clear the expire times within the handles that we remove from the
-       splay tree */
+       wheel */
     tv->tv_sec = 0;
     tv->tv_usec = 0;
   }
   else {
-    /* copy the first entry to 'tv' */
-    memcpy(tv, e->ptr, sizeof(*tv));
-
-    /* remove first entry from list */
-    Curl_llist_remove(list, e, NULL);
+    /* the first pending entry is the next time to act on */
+    *tv = node->time;
 
-    /* insert this node again into the splay */
-    multi->timetree = Curl_splayinsert(*tv, multi->timetree,
-                                       &d->state.timenode);
+    /* insert this node again into the wheel */
+    Curl_wheel_insert(&multi->timers, &d->state.timenode, *tv);
   }
   return CURLM_OK;
 }
@@ -2208,7 +3572,7 @@ static CURLMcode multi_socket(struct Curl_multi *multi,
 {
   CURLMcode result = CURLM_OK;
   struct SessionHandle *data = NULL;
-  struct Curl_tree *t;
+  struct Curl_wheel_node *t;
   struct timeval now = Curl_tvnow();
 
   if(checkall) {
@@ -2231,7 +3595,7 @@ static CURLMcode multi_socket(struct Curl_multi *multi,
   else if(s != CURL_SOCKET_TIMEOUT) {
 
     struct Curl_sh_entry *entry =
-      Curl_hash_pick(multi->sockhash, (char *)&s, sizeof(s));
+      sh_getentry(&multi->sockhash, s);
 
     if(!entry)
       /* Unmatched socket, we can't act on it but we ignore this fact.  In
@@ -2240,6 +3604,9 @@ static CURLMcode multi_socket(struct Curl_multi *multi,
          asked to get removed, so thus we better survive stray socket actions
          and just move on. */
       ;
+    else if(entry->idle)
+      /* the socket of an idle connection, not of any transfer */
+      multi_idle_event(multi, entry);
     else {
       SIGPIPE_VARIABLE(pipe_st);
 
@@ -2302,7 +3669,7 @@ static CURLMcode multi_socket(struct Curl_multi *multi,
 
   /*
    * The loop following here will go on as long as there are expire-times left
-   * to process in the splay and 'data' will be re-assigned for every expired
+   * to process in the wheel and 'data' will be re-assigned for every expired
    * handle we deal with.
    */
   do {
@@ -2323,7 +3690,7 @@ static CURLMcode multi_socket(struct Curl_multi *multi,
     /* Check if there's one (more) expired timer to deal with! This function
        extracts a matching node if there is one */
 
-    multi->timetree = Curl_splaygetbest(now, multi->timetree, &t);
+    t = Curl_wheel_getbest(&multi->timers, now);
     if(t) {
       data = t->payload; /* assign this for next loop */
       (void)add_next_timeout(now, multi, t->payload);
@@ -2331,6 +3698,12 @@ static CURLMcode multi_socket(struct Curl_multi *multi,
 
   } while(t);
 
+  multi_prune(multi);
+  multi_dns_refresh(multi);
+
+  multi_prewarm_reap(multi);
+  multi_completions(multi);
+
   *running_handles = multi->num_alive;
   return result;
 }
@@ -2390,6 +3763,15 @@ CURLMcode curl_multi_setopt(CURLM *multi_handle,
   case CURLMOPT_MAX_TOTAL_CONNECTIONS:
     multi->max_total_connections = va_arg(param, long);
     break;
+  case CURLMOPT_COMPLETIONFUNCTION:
+    multi->completion_cb = va_arg(param, curl_multi_completion_callback);
+    break;
+  case CURLMOPT_COMPLETIONDATA:
+    multi->completion_userp = va_arg(param, void *);
+    break;
+  case CURLMOPT_MAX_RESOLVER_THREADS:
+    multi->max_resolver_threads = va_arg(param, long);
+    break;
   default:
     res = CURLM_UNKNOWN_OPTION;
     break;
@@ -2398,6 +3780,85 @@ CURLMcode curl_multi_setopt(CURLM *multi_handle,
   return res;
 }
 
+CURLMcode curl_multi_getinfo(CURLM *multi_handle, CURLMINFO info, ...)
+{
+  struct Curl_multi *multi=(struct Curl_multi *)multi_handle;
+  CURLMcode res = CURLM_OK;
+  va_list arg;
+  long *param_longp;
+  double *param_doublep;
+  struct Curl_multi_share *s;
+  curl_off_t now;
+  int i;
+
+  if(!GOOD_MULTI_HANDLE(multi))
+    return CURLM_BAD_HANDLE;
+
+  /* the public state list must match the internal one */
+  DEBUGASSERT((int)CURLMSTATE_LAST == (int)CURLM_STATE_LAST);
+
+  va_start(arg, info);
+
+  switch(info) {
+  case CURLMINFO_NUM_EASY:
+    param_longp = va_arg(arg, long *);
+    *param_longp = multi->num_easy;
+    break;
+  case CURLMINFO_RUNNING:
+    param_longp = va_arg(arg, long *);
+    *param_longp = multi->num_alive;
+    break;
+  case CURLMINFO_CONNCACHE_SIZE:
+    param_longp = va_arg(arg, long *);
+    *param_longp = (long)multi->conn_cache->num_connections;
+    for(s = multi->shares; s; s = s->next) {
+      (void)closure_lock(multi, s->share);
+      *param_longp += (long)s->share->conn_cache->num_connections;
+      closure_unlock(multi);
+    }
+    break;
+  case CURLMINFO_PENDING:
+    param_longp = va_arg(arg, long *);
+    *param_longp = multi->num_pending;
+    break;
+  case CURLMINFO_TIMERS:
+    param_longp = va_arg(arg, long *);
+    *param_longp = (long)multi->timers.count;
+    break;
+  case CURLMINFO_STATE_COUNTS:
+    param_longp = va_arg(arg, long *);
+    for(i = 0; i < CURLM_STATE_LAST; i++)
+      param_longp[i] = multi->state_count[i];
+    break;
+  case CURLMINFO_STATE_TIMES:
+    param_doublep = va_arg(arg, double *);
+    now = multi_statnow(multi);
+    for(i = 0; i < CURLM_STATE_LAST; i++) {
+      /* add the time of the handles that are still in the state */
+      curl_off_t usecs = multi->state_time[i] +
+        multi->state_count[i] * now - multi->state_entered[i];
+      param_doublep[i] = (double)usecs / 1000000.0;
+    }
+    break;
+  case CURLMINFO_EVICTIONS:
+    param_longp = va_arg(arg, long *);
+    for(i = 0; i < CURLEVICT_LAST; i++)
+      param_longp[i] = multi->conn_cache->evictions[i];
+    for(s = multi->shares; s; s = s->next) {
+      (void)closure_lock(multi, s->share);
+      for(i = 0; i < CURLEVICT_LAST; i++)
+        param_longp[i] += s->share->conn_cache->evictions[i];
+      closure_unlock(multi);
+    }
+    break;
+  default:
+    res = CURLM_UNKNOWN_OPTION;
+    break;
+  }
+  va_end(arg);
+  return res;
+}
+
 /* we define curl_multi_socket() in the public multi.h header */
 #undef curl_multi_socket
 
@@ -2431,21 +3892,169 @@ CURLMcode curl_multi_socket_all(CURLM *multi_handle, int *running_handles)
   return result;
 }
 
+/*
+ * Dead connections in the cache are pruned a few at a time by
+ * multi_prune(), run from curl_multi_perform() and the socket API. While
+ * transfers are running, its next step is one more timer for the
+ * application to wait for: CONNCACHE_PRUNE_INTERVAL milliseconds after the
+ * previous batch while a pruning round is in progress and a second after
+ * the last round otherwise.
+ */
+static bool cache_prune_expire(struct conncache *connc,
+                               struct timeval *expire)
+{
+  if(!connc->idle->size)
+    return FALSE;
+
+  if(connc->prune_next) {
+    *expire = connc->last_prune;
+    expire->tv_usec += CONNCACHE_PRUNE_INTERVAL * 1000;
+    if(expire->tv_usec >= 1000000) {
+      expire->tv_sec++;
+      expire->tv_usec -= 1000000;
+    }
+  }
+  else {
+    *expire = connc->last_cleanup;
+    expire->tv_sec++;
+  }
+  return TRUE;
+}
+
+/* the next pruning step of the multi handle's own cache or of a shared one
+   its easy handles use, whichever is first */
+static bool multi_prune_expire(struct Curl_multi *multi,
+                               struct timeval *expire)
+{
+  struct Curl_multi_share *s;
+  bool found;
+
+  if(!multi->num_alive)
+    return FALSE;
+
+  found = cache_prune_expire(multi->conn_cache, expire);
+  for(s = multi->shares; s; s = s->next) {
+    struct timeval next;
+
+    (void)closure_lock(multi, s->share);
+    if(cache_prune_expire(s->share->conn_cache, &next) &&
+       (!found || TV_LATER(*expire, next))) {
+      *expire = next;
+      found = TRUE;
+    }
+    closure_unlock(multi);
+  }
+  return found;
+}
+
+/* the nearest time anything in the multi handle expires */
+static bool multi_next_expire(struct Curl_multi *multi,
+                              struct timeval *expire)
+{
+  struct timeval prune;
+  bool found = Curl_wheel_next(&multi->timers, expire);
+
+  if(multi_prune_expire(multi, &prune) &&
+     (!found || TV_LATER(*expire, prune))) {
+    *expire = prune;
+    found = TRUE;
+  }
+  if(multi->dns_refresh &&
+     (!found || TV_LATER(*expire, multi->dns_refresh_next))) {
+    *expire = multi->dns_refresh_next;
+    found = TRUE;
+  }
+  return found;
+}
+
+/* prune the multi handle's own cache and the shared ones its easy handles
+   use, with the closure handle */
+static void multi_prune(struct Curl_multi *multi)
+{
+  struct Curl_multi_share *s;
+  SIGPIPE_VARIABLE(pipe_st);
+
+  idle_sweep(multi);
+
+  if(!multi->conn_cache->idle->size && !multi->shares)
+    return;
+
+  sigpipe_ignore(multi->closure_handle, &pipe_st);
+  if(multi->conn_cache->idle->size)
+    Curl_prune_dead_connections(multi->closure_handle);
+  for(s = multi->shares; s; s = s->next) {
+    struct SessionHandle *closure = closure_lock(multi, s->share);
+
+    if(s->share->conn_cache->idle->size)
+      Curl_prune_dead_connections(closure);
+    closure_unlock(multi);
+  }
+  sigpipe_restore(&pipe_st);
+}
+
+/*
+ * Background resolves of names in the DNS cache are not tied to any easy
+ * handle of the multi handle, so they are checked on by the multi handle
+ * itself this often until they are done.
+ */
+#define DNS_REFRESH_INTERVAL 50 /* milliseconds */
+
+static void dns_refresh_schedule(struct Curl_multi *multi,
+                                 struct timeval now)
+{
+  now.tv_usec += DNS_REFRESH_INTERVAL * 1000;
+  if(now.tv_usec >= 1000000) {
+    now.tv_sec++;
+    now.tv_usec -= 1000000;
+  }
+  multi->dns_refresh_next = now;
+}
+
+void Curl_multi_add_dns_refresh(struct Curl_multi *multi,
+                                struct Curl_dns_refresh *refresh)
+{
+  if(!multi->dns_refresh)
+    dns_refresh_schedule(multi, Curl_tvnow());
+  refresh->next = multi->dns_refresh;
+  multi->dns_refresh = refresh;
+}
+
+static void multi_dns_refresh(struct Curl_multi *multi)
+{
+  struct Curl_dns_refresh **refp = &multi->dns_refresh;
+  struct timeval now;
+
+  if(!multi->dns_refresh)
+    return;
+
+  now = Curl_tvnow();
+  if(TV_LATER(multi->dns_refresh_next, now))
+    return;
+
+  while(*refp) {
+    struct Curl_dns_refresh *refresh = *refp;
+    if(Curl_dns_refresh_done(refresh)) {
+      *refp = refresh->next;
+      Curl_dns_refresh_free(refresh);
+    }
+    else
+      refp = &refresh->next;
+  }
+  dns_refresh_schedule(multi, now);
+}
+
 static CURLMcode multi_timeout(struct Curl_multi *multi,
                                long *timeout_ms)
 {
-  static struct timeval tv_zero = {0,0};
+  struct timeval expire;
 
-  if(multi->timetree) {
-    /* we have a tree of expire times */
+  if(multi_next_expire(multi, &expire)) {
+    /* we have expire times */
     struct timeval now = Curl_tvnow();
 
-    /* splay the lowest to the bottom */
-    multi->timetree = Curl_splay(tv_zero, multi->timetree);
-
-    if(Curl_splaycomparekeys(multi->timetree->key, now) > 0) {
+    if(TV_LATER(expire, now)) {
       /* some time left before expiration */
-      *timeout_ms = curlx_tvdiff(multi->timetree->key, now);
+      *timeout_ms = curlx_tvdiff(expire, now);
       if(!*timeout_ms)
         /*
          * Since we only provide millisecond resolution on the returned value
@@ -2485,6 +4094,7 @@ CURLMcode curl_multi_timeout(CURLM *multi_handle,
 static int update_timer(struct Curl_multi *multi)
 {
   long timeout_ms;
+  struct timeval expire;
 
   if(!multi->timer_cb)
     return 0;
@@ -2493,7 +4103,7 @@ static int update_timer(struct Curl_multi *multi)
   }
   if(timeout_ms < 0) {
     static const struct timeval none={0,0};
-    if(Curl_splaycomparekeys(none, multi->timer_lastcall)) {
+    if(!TV_EQUAL(none, multi->timer_lastcall)) {
       multi->timer_lastcall = none;
       /* there's no timeout now but there was one previously, tell the app to
          disable it */
@@ -2502,14 +4112,14 @@ static int update_timer(struct Curl_multi *multi)
     return 0;
   }
 
-  /* When multi_timeout() is done, multi->timetree points to the node with the
-   * timeout we got the (relative) time-out time for. We can thus easily check
-   * if this is the same (fixed) time as we got in a previous call and then
-   * avoid calling the callback again. */
-  if(Curl_splaycomparekeys(multi->timetree->key, multi->timer_lastcall) == 0)
+  /* The wheel tells the (fixed) time we got the relative time-out time for.
+   * We can thus easily check if this is the same time as we got in a
+   * previous call and then avoid calling the callback again. */
+  (void)multi_next_expire(multi, &expire);
+  if(TV_EQUAL(expire, multi->timer_lastcall))
     return 0;
 
-  multi->timer_lastcall = multi->timetree->key;
+  multi->timer_lastcall = expire;
 
   return multi->timer_cb((CURLM*)multi, timeout_ms, multi->timer_userp);
 }
@@ -2524,62 +4134,64 @@ static bool isHandleAtHead(struct SessionHandle *handle,
   return FALSE;
 }
 
+static bool isHandleInPipeline(struct SessionHandle *handle,
+                               struct curl_llist *pipeline)
+{
+  struct curl_llist_element *curr;
+
+  for(curr = pipeline->head; curr; curr = curr->next)
+    if(curr->ptr == handle)
+      return TRUE;
+
+  return FALSE;
+}
+
 /*
- * multi_freetimeout()
+ * multi_deltimeout()
  *
- * Callback used by the llist system when a single timeout list entry is
- * destroyed.
+ * Remove the pending timeout with the given id from the handle's list of
+ * timeouts, if there is one.
  */
-static void multi_freetimeout(void *user, void *entryptr)
+static void multi_deltimeout(struct SessionHandle *data, expire_id id)
 {
-  (void)user;
+  struct time_node *node = &data->state.expires[id];
+  struct time_node **prevp = &data->state.timeoutlist;
+
+  if(!node->time.tv_sec && !node->time.tv_usec)
+    return;
 
-  /* the entry was plain malloc()'ed */
-  free(entryptr);
+  while(*prevp) {
+    if(*prevp == node) {
+      *prevp = node->next;
+      break;
+    }
+    prevp = &(*prevp)->next;
+  }
+  node->next = NULL;
+  memset(&node->time, 0, sizeof(node->time));
 }
 
 /*
  * multi_addtimeout()
  *
  * Add a timestamp to the list of timeouts. Keep the list sorted so that head
- * of list is always the timeout nearest in time.
+ * of list is always the timeout nearest in time. The node for each id is
+ * part of the handle, so this never allocates memory.
  *
  */
-static CURLMcode
-multi_addtimeout(struct curl_llist *timeoutlist,
-                 struct timeval *stamp)
+static void multi_addtimeout(struct SessionHandle *data, expire_id id,
+                             struct timeval *stamp)
 {
-  struct curl_llist_element *e;
-  struct timeval *timedup;
-  struct curl_llist_element *prev = NULL;
-
-  timedup = malloc(sizeof(*timedup));
-  if(!timedup)
-    return CURLM_OUT_OF_MEMORY;
-
-  /* copy the timestamp */
-  memcpy(timedup, stamp, sizeof(*timedup));
-
-  if(Curl_llist_count(timeoutlist)) {
-    /* find the correct spot in the list */
-    for(e = timeoutlist->head; e; e = e->next) {
-      struct timeval *checktime = e->ptr;
-      long diff = curlx_tvdiff(*checktime, *timedup);
-      if(diff > 0)
-        break;
-      prev = e;
-    }
+  struct time_node *node = &data->state.expires[id];
+  struct time_node **prevp = &data->state.timeoutlist;
 
-  }
-  /* else
-     this is the first timeout on the list */
-
-  if(!Curl_llist_insert_next(timeoutlist, prev, timedup)) {
-    free(timedup);
-    return CURLM_OUT_OF_MEMORY;
-  }
+  /* find the correct spot in the list */
+  while(*prevp && !TV_LATER((*prevp)->time, *stamp))
+    prevp = &(*prevp)->next;
 
-  return CURLM_OK;
+  node->time = *stamp;
+  node->next = *prevp;
+  *prevp = node;
 }
 
 /*
@@ -2588,108 +4200,101 @@ multi_addtimeout(struct curl_llist *timeoutlist,
  * given a number of milliseconds from now to use to set the 'act before
  * this'-time for the transfer, to be extracted by curl_multi_timeout()
  *
- * Note that the timeout will be added to a queue of timeouts if it defines a
- * moment in time that is later than the current head of queue.
- *
- * Pass zero to clear all timeout values for this handle.
-*/
-void Curl_expire(struct SessionHandle *data, long milli)
+ * Each handle has one timeout per id, setting a new time replaces the
+ * previous one with the same id. The nearest of them is the one kept in the
+ * multi handle's timing wheel.
+ */
+void Curl_expire(struct SessionHandle *data, long milli, expire_id id)
 {
   struct Curl_multi *multi = data->multi;
   struct timeval *nowp = &data->state.expiretime;
-  int rc;
+  struct timeval *first;
+  struct timeval set;
 
   /* this is only interesting while there is still an associated multi struct
      remaining! */
   if(!multi)
     return;
 
-  if(!milli) {
-    /* No timeout, clear the time data. */
-    if(nowp->tv_sec || nowp->tv_usec) {
-      /* Since this is an cleared time, we must remove the previous entry from
-         the splay tree */
-      struct curl_llist *list = data->state.timeoutlist;
-
-      rc = Curl_splayremovebyaddr(multi->timetree,
-                                  &data->state.timenode,
-                                  &multi->timetree);
-      if(rc)
-        infof(data, "Internal error clearing splay node = %d\n", rc);
+  DEBUGASSERT(id < EXPIRE_LAST);
 
-      /* flush the timeout list too */
-      while(list->size > 0)
-        Curl_llist_remove(list, list->tail, NULL);
+  set = Curl_tvnow();
+  set.tv_sec += milli/1000;
+  set.tv_usec += (milli%1000)*1000;
 
-#ifdef DEBUGBUILD
-      infof(data, "Expire cleared\n");
-#endif
-      nowp->tv_sec = 0;
-      nowp->tv_usec = 0;
-    }
+  if(set.tv_usec >= 1000000) {
+    set.tv_sec++;
+    set.tv_usec -= 1000000;
   }
-  else {
-    struct timeval set;
 
-    set = Curl_tvnow();
-    set.tv_sec += milli/1000;
-    set.tv_usec += (milli%1000)*1000;
+  multi_deltimeout(data, id);
+  multi_addtimeout(data, id, &set);
 
-    if(set.tv_usec >= 1000000) {
-      set.tv_sec++;
-      set.tv_usec -= 1000000;
-    }
+  /* only when the nearest time changed does the wheel need to know */
+  first = &data->state.timeoutlist->time;
+  if(TV_EQUAL(*first, *nowp))
+    return;
 
-    if(nowp->tv_sec || nowp->tv_usec) {
-      /* This means that the struct is added as a node in the splay tree.
-         Compare if the new time is earlier, and only remove-old/add-new if it
-         is. */
-      long diff = curlx_tvdiff(set, *nowp);
-      if(diff > 0) {
-        /* the new expire time was later so just add it to the queue
-           and get out */
-        multi_addtimeout(data->state.timeoutlist, &set);
-        return;
-      }
+  /* This is an updated time, the node must be removed from the wheel
+     first and then re-added with the new value */
+  Curl_wheel_remove(&multi->timers, &data->state.timenode);
+
+  *nowp = *first;
+  data->state.timenode.payload = data;
+  Curl_wheel_insert(&multi->timers, &data->state.timenode, *nowp);
+}
+
+/*
+ * Curl_expire_clear()
+ *
+ * Clear all timeout values for this handle.
+ */
+void Curl_expire_clear(struct SessionHandle *data)
+{
+  struct Curl_multi *multi = data->multi;
+  struct timeval *nowp = &data->state.expiretime;
+
+  /* this is only interesting while there is still an associated multi struct
+     remaining! */
+  if(!multi)
+    return;
 
-      /* the new time is newer than the presently set one, so add the current
-         to the queue and update the head */
-      multi_addtimeout(data->state.timeoutlist, nowp);
-
-      /* Since this is an updated time, we must remove the previous entry from
-         the splay tree first and then re-add the new value */
-      rc = Curl_splayremovebyaddr(multi->timetree,
-                                  &data->state.timenode,
-                                  &multi->timetree);
-      if(rc)
-        infof(data, "Internal error removing splay node = %d\n", rc);
+  if(nowp->tv_sec || nowp->tv_usec) {
+    /* Since this is an cleared time, we must remove the previous entry from
+       the timing wheel */
+    Curl_wheel_remove(&multi->timers, &data->state.timenode);
+
+    /* flush the timeout list too */
+    while(data->state.timeoutlist) {
+      struct time_node *node = data->state.timeoutlist;
+      data->state.timeoutlist = node->next;
+      node->next = NULL;
+      memset(&node->time, 0, sizeof(node->time));
     }
 
-    *nowp = set;
-    data->state.timenode.payload = data;
-    multi->timetree = Curl_splayinsert(*nowp,
-                                       multi->timetree,
-                                       &data->state.timenode);
-  }
-#if 0
-  Curl_splayprint(multi->timetree, 0, TRUE);
+#ifdef DEBUGBUILD
+    infof(data, "Expire cleared\n");
 #endif
+    nowp->tv_sec = 0;
+    nowp->tv_usec = 0;
+  }
 }
 
 /*
  * Curl_expire_latest()
  *
- * This is like Curl_expire() but will only add a timeout node to the list of
- * timers if there is no timeout that will expire before the given time.
+ * This is like Curl_expire() but will only set the timeout for the given id
+ * if there is no timeout with that id that will expire before the given
+ * time.
  *
  * Use this function if the code logic risks calling this function many times
  * or if there's no particular conditional wait in the code for this specific
  * time-out period to expire.
  *
  */
-void Curl_expire_latest(struct SessionHandle *data, long milli)
+void Curl_expire_latest(struct SessionHandle *data, long milli, expire_id id)
 {
-  struct timeval *expire = &data->state.expiretime;
+  struct timeval *expire = &data->state.expires[id].time;
 
   struct timeval set;
 
@@ -2703,17 +4308,16 @@ void Curl_expire_latest(struct SessionHandle *data, long milli)
   }
 
   if(expire->tv_sec || expire->tv_usec) {
-    /* This means that the struct is added as a node in the splay tree.
-       Compare if the new time is earlier, and only remove-old/add-new if it
-         is. */
-    long diff = curlx_tvdiff(set, *expire);
-    if(diff > 0)
-      /* the new expire time was later than the top time, so just skip this */
+    /* This means that a timeout with this id is pending. Compare if the new
+       time is earlier, and only replace the old one if it is. */
+    if(TV_LATER(set, *expire))
+      /* the new expire time was later than the pending one, so just skip
+         this */
       return;
   }
 
   /* Just add the timeout like normal */
-  Curl_expire(data, milli);
+  Curl_expire(data, milli, id);
 }
 
 CURLMcode curl_multi_assign(CURLM *multi_handle,
@@ -2723,7 +4327,7 @@ CURLMcode curl_multi_assign(CURLM *multi_handle,
   struct Curl_multi *multi = (struct Curl_multi *)multi_handle;
 
   if(s != CURL_SOCKET_BAD)
-    there = Curl_hash_pick(multi->sockhash, (char *)&s, sizeof(curl_socket_t));
+    there = sh_getentry(&multi->sockhash, s);
 
   if(!there)
     return CURLM_BAD_SOCKET;
@@ -2768,26 +4372,23 @@ struct curl_llist *Curl_multi_pipelining_server_bl(struct Curl_multi *multi)
   return multi->pipelining_server_bl;
 }
 
-void Curl_multi_process_pending_handles(struct Curl_multi *multi)
+/*
+ * Curl_multi_process_pending_handles()
+ *
+ * 'conn' is handed back or closed, or has room in its pipeline again. Wake
+ * up the first handle waiting for a connection in the same bundle, or if
+ * there is none, the first handle waiting for any connection.
+ */
+void Curl_multi_process_pending_handles(struct Curl_multi *multi,
+                                        struct connectdata *conn)
 {
-  struct curl_llist_element *e = multi->pending->head;
-
-  while(e) {
-    struct SessionHandle *data = e->ptr;
-    struct curl_llist_element *next = e->next;
+  struct Curl_pendq *q = NULL;
 
-    if(data->mstate == CURLM_STATE_CONNECT_PEND) {
-      multistate(data, CURLM_STATE_CONNECT);
+  if(conn && conn->bundle_key)
+    q = pendq_find(multi, conn->bundle_key, FALSE);
 
-      /* Remove this node from the list */
-      Curl_llist_remove(multi->pending, e, NULL);
-
-      /* Make sure that the handle will be processed soonish. */
-      Curl_expire_latest(data, 1);
-    }
-
-    e = next; /* operate on next handle */
-  }
+  if(!q || !pendq_wake(multi, q))
+    (void)pendq_wake(multi, &multi->pending);
 }
 
 #ifdef DEBUGBUILD
@@ -2807,7 +4408,7 @@ void Curl_multi_dump(const struct Curl_multi *multi_handle)
       for(i=0; i < data->numsocks; i++) {
         curl_socket_t s = data->sockets[i];
         struct Curl_sh_entry *entry =
-          Curl_hash_pick(multi->sockhash, (char *)&s, sizeof(s));
+          sh_getentry(&multi->sockhash, s);
 
         fprintf(stderr, "%d ", (int)s);
         if(!entry) {
@@ -22,13 +22,35 @@
  *
  ***************************************************************************/
 
+/* curl_multi_wakeup() needs a descriptor it can signal from another thread
+   and that curl_multi_wait() can poll on */
+#if (defined(HAVE_EVENTFD) || defined(HAVE_PIPE)) && !defined(USE_WINSOCK)
+#define ENABLE_WAKEUP
+#endif
+
+/* a FIFO queue of handles in CONNECT_PEND state, waiting for a connection */
+struct Curl_pendq {
+  struct SessionHandle *head;
+  struct SessionHandle *tail;
+  size_t woken; /* handles taken off this queue that have not tried to
+                   connect again yet */
+  char *key;    /* the bundle key, also the key in the multi handle's
+                   'pendhash', NULL for the queue of handles waiting for any
+                   connection */
+};
+
 struct Curl_message {
   /* the 'CURLMsg' is the part that is visible to the external user */
   struct CURLMsg extmsg;
+  /* links for the multi handle's message queue, the message lives in the
+     easy handle so queueing it needs no allocation */
+  struct Curl_message *next;
+  struct Curl_message *prev;
+  bool queued;
 };
 
 /* NOTE: if you add a state here, add the name to the statename[] array as
-   well!
+   well, and to the public curl_mstate list in include/curl/multi.h!
 */
 typedef enum {
   CURLM_STATE_INIT,         /* 0 - start in this state */
@@ -59,6 +81,27 @@ typedef enum {
 #define GETSOCK_READABLE (0x00ff)
 #define GETSOCK_WRITABLE (0xff00)
 
+/* Sockets are small non-negative integers everywhere but on Windows, so the
+   socket lookup is a table indexed by the socket. Windows sockets are looked
+   up in a hash instead. */
+#ifndef USE_WINSOCK
+#define USE_SOCKET_TABLE
+#endif
+
+struct Curl_sh_entry;
+struct Curl_idle_watch;
+
+struct Curl_sockhash {
+#ifdef USE_SOCKET_TABLE
+  /* the entries are kept in fixed size pages that never move once they are
+     allocated, so entry pointers stay valid while the table grows */
+  struct Curl_sh_entry **pages;
+  size_t npages; /* number of page pointers in 'pages' */
+#else
+  struct curl_hash *hash;
+#endif
+};
+
 /* This is the struct known as CURLM on the outside */
 struct Curl_multi {
   /* First a simple identifier to easier detect if a user mix up
@@ -73,26 +116,55 @@ struct Curl_multi {
   int num_alive; /* amount of easy handles that are added but have not yet
                     reached COMPLETE state */
 
-  struct curl_llist *msglist; /* a list of messages from completed transfers */
+  /* statistics for curl_multi_getinfo(). The times are in microseconds
+     since 'statbase'. The time spent in a state by the handles that are in
+     it right now is the number of them times the current time, minus the
+     sum of the times they entered it, so nothing needs to be walked to get
+     it. */
+  struct timeval statbase;
+  long state_count[CURLM_STATE_LAST];  /* handles in each state */
+  curl_off_t state_time[CURLM_STATE_LAST]; /* time spent in each state by
+                                              handles that have left it */
+  curl_off_t state_entered[CURLM_STATE_LAST]; /* sum of the times the
+                                                 handles in each state
+                                                 entered it */
+  long num_pending; /* handles in the queues waiting for a connection */
+
+  /* the queue of messages from completed transfers */
+  struct Curl_message *msgp;
+  struct Curl_message *msglp; /* last node */
+  int num_msgs; /* amount of messages in the queue */
+
+  /* SessionHandles in the CURLM_STATE_CONNECT_PEND state. Those that hit
+     the limit of connections to their host wait in that host's queue in
+     'pendhash', those that hit the total limit wait in 'pending'. */
+  struct Curl_pendq pending;
+  struct curl_hash *pendhash;
 
-  struct curl_llist *pending; /* SessionHandles that are in the
-                                 CURLM_STATE_CONNECT_PEND state */
+  /* The ready queue: handles that had socket activity, an expired timer or
+     a state change and need to be run. It is only trusted to be complete
+     when curl_multi_wait() has collected all socket activity since the last
+     curl_multi_perform(), which is what 'ready_valid' tells. */
+  struct SessionHandle *readyp;
+  struct SessionHandle *readylp; /* last node */
+  bool ready_valid;
+  unsigned int perform_round; /* increased by each curl_multi_perform() */
 
   /* callback function and user data pointer for the *socket() API */
   curl_socket_callback socket_cb;
   void *socket_userp;
 
   /* Hostname cache */
-  struct curl_hash *hostcache;
+  struct Curl_dnscache *hostcache;
 
-  /* timetree points to the splay-tree of time nodes to figure out expire
-     times of all currently set timers */
-  struct Curl_tree *timetree;
+  /* the timing wheel holding the nearest expire time of every handle that
+     has a timer set */
+  struct Curl_wheel timers;
 
-  /* 'sockhash' is the lookup hash for socket descriptor => easy handles (note
-     the pluralis form, there can be more than one easy handle waiting on the
-     same actual socket) */
-  struct curl_hash *sockhash;
+  /* 'sockhash' is the lookup table for socket descriptor => easy handles
+     (note the pluralis form, there can be more than one easy handle waiting
+     on the same actual socket) */
+  struct Curl_sockhash sockhash;
 
   /* Whether pipelining is enabled for this multi handle */
   bool pipelining_enabled;
@@ -104,6 +176,21 @@ struct Curl_multi {
      curl_multi_cleanup() */
   struct SessionHandle *closure_handle;
 
+  /* the sockets of idle connections that this multi handle watches, and the
+     watches found to be left behind by connections that another multi
+     handle took or closed, to be freed. See Curl_multi_idle_watch(). */
+  struct Curl_idle_watch *idle_watches;
+  struct Curl_idle_watch *idle_stale;
+
+  /* the share objects whose connection caches easy handles of this multi
+     handle use, pruned along with 'conn_cache' */
+  struct Curl_multi_share *shares;
+
+  /* connectdata structs that were freed, kept to be handed out again by
+     allocate_conn() in url.c. Linked with their 'poolnext' pointers. */
+  struct connectdata *connpool;
+  size_t connpool_size;
+
   long maxconnects; /* if >0, a fixed limit of the maximum number of entries
                        we're allowed to grow the connection cache to */
 
@@ -116,6 +203,15 @@ struct Curl_multi {
   long max_pipeline_length; /* if >0, maximum number of requests in a
                                pipeline */
 
+  long max_resolver_threads; /* if >0, the maximum number of threads the
+                                threaded resolver runs at once */
+  void *resolver; /* resolver state shared by all easy handles, owned by the
+                     resolver backend */
+
+  struct Curl_dns_refresh *dns_refresh; /* background resolves of names in
+                                           the DNS cache, see hostip.c */
+  struct timeval dns_refresh_next; /* when to check on them next */
+
   long content_length_penalty_size; /* a connection with a
                                        content-length bigger than
                                        this is not considered
@@ -134,8 +230,31 @@ struct Curl_multi {
   /* timer callback and user data pointer for the *socket() API */
   curl_multi_timer_callback timer_cb;
   void *timer_userp;
+
+  /* completion callback and user data pointer, when set it is handed the
+     messages instead of curl_multi_info_read() */
+  curl_multi_completion_callback completion_cb;
+  void *completion_userp;
+
+  /* handles added by curl_multi_prewarm() that are done, to be removed and
+     closed before the performing function returns. Linked with their
+     'prewarm_next' pointers. */
+  struct SessionHandle *prewarm_done;
   struct timeval timer_lastcall; /* the fixed time for the timeout for the
                                     previous callback */
+
+#ifdef USE_EPOLL
+  int epollfd; /* the persistent interest set curl_multi_wait() waits on, it
+                  is kept in sync with the sockhash by singlesocket() */
+  int epoll_nfds; /* number of sockets in the interest set */
+#endif
+
+#ifdef ENABLE_WAKEUP
+  /* curl_multi_wakeup() writes to wakeup_fds[1] and curl_multi_wait() polls
+     wakeup_fds[0]. With eventfd, both are the same descriptor. -1 when the
+     descriptors could not be created. */
+  int wakeup_fds[2];
+#endif
 };
 
 #endif /* HEADER_CURL_MULTIHANDLE_H */
@@ -25,8 +25,10 @@
 /*
  * Prototypes for library-wide functions provided by multi.c
  */
-void Curl_expire(struct SessionHandle *data, long milli);
-void Curl_expire_latest(struct SessionHandle *data, long milli);
+void Curl_expire(struct SessionHandle *data, long milli, expire_id id);
+void Curl_expire_clear(struct SessionHandle *data);
+void Curl_expire_latest(struct SessionHandle *data, long milli,
+                        expire_id id);
 
 bool Curl_multi_pipeline_enabled(const struct Curl_multi* multi);
 void Curl_multi_handlePipeBreak(struct SessionHandle *data);
@@ -55,7 +57,8 @@ struct Curl_multi *Curl_multi_handle(int hashsize, int chashsize);
 void Curl_multi_dump(const struct Curl_multi *multi_handle);
 #endif
 
-void Curl_multi_process_pending_handles(struct Curl_multi *multi);
+void Curl_multi_process_pending_handles(struct Curl_multi *multi,
+                                        struct connectdata *conn);
 
 /* Return the value of the CURLMOPT_MAX_HOST_CONNECTIONS option */
 size_t Curl_multi_max_host_connections(struct Curl_multi *multi);
@@ -78,6 +81,11 @@ struct curl_llist *Curl_multi_pipelining_server_bl(struct Curl_multi *multi);
 /* Return the value of the CURLMOPT_MAX_TOTAL_CONNECTIONS option */
 size_t Curl_multi_max_total_connections(struct Curl_multi *multi);
 
+/* hand a background DNS resolve to the multi handle to finish */
+struct Curl_dns_refresh;
+void Curl_multi_add_dns_refresh(struct Curl_multi *multi,
+                                struct Curl_dns_refresh *refresh);
+
 /*
  * Curl_multi_closed()
  *
@@ -90,4 +98,17 @@ size_t Curl_multi_max_total_connections(struct Curl_multi *multi);
 
 void Curl_multi_closed(struct connectdata *conn, curl_socket_t s);
 
+/*
+ * Curl_multi_idle_watch() and Curl_multi_idle_unwatch()
+ *
+ * Called with the connection cache locked when 'conn' is handed back to the
+ * cache by 'data' and when it leaves the idle state again, taken for re-use
+ * or closed by 'data'. The multi handle of the handle that left it idle
+ * watches its socket in the meantime.
+ */
+void Curl_multi_idle_watch(struct SessionHandle *data,
+                           struct connectdata *conn);
+void Curl_multi_idle_unwatch(struct SessionHandle *data,
+                             struct connectdata *conn);
+
 #endif /* HEADER_CURL_MULTIIF_H */
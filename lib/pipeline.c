@@ -108,7 +108,7 @@ CURLcode Curl_add_handle_to_pipeline(struct SessionHandle *handle,
   if(pipeline == conn->send_pipe && sendhead != conn->send_pipe->head) {
     /* this is a new one as head, expire it */
     conn->writechannel_inuse = FALSE; /* not in use yet */
-    Curl_expire(conn->send_pipe->head->ptr, 1);
+    Curl_expire(conn->send_pipe->head->ptr, 1, EXPIRE_RUN_NOW);
   }
 
 #if 0 /* enable for pipeline debugging */
@@ -143,7 +143,7 @@ void Curl_move_handle_from_send_to_recv_pipe(struct SessionHandle *handle,
         infof(conn->data, "%p is at send pipe head B!\n",
               (void *)conn->send_pipe->head->ptr);
 #endif
-        Curl_expire(conn->send_pipe->head->ptr, 1);
+        Curl_expire(conn->send_pipe->head->ptr, 1, EXPIRE_RUN_NOW);
       }
 
       /* The receiver's list is not really interesting here since either this
@@ -26,11 +26,27 @@
 #include "urldata.h"
 #include "share.h"
 #include "vtls/vtls.h"
+#include "url.h"
+#include "conncache.h"
 #include "curl_memory.h"
 
 /* The last #include file should be: */
 #include "memdebug.h"
 
+/* close the connections in the shared connection cache and free it */
+static void share_conncache_cleanup(struct Curl_share *share)
+{
+  if(!share->conn_cache)
+    return;
+
+  Curl_conncache_close_all_connections(share->conn_cache,
+                                       share->closure_handle);
+  Curl_close(share->closure_handle);
+  share->closure_handle = NULL;
+  Curl_conncache_destroy(share->conn_cache);
+  share->conn_cache = NULL;
+}
+
 CURLSH *
 curl_share_init(void)
 {
@@ -101,7 +117,21 @@ curl_share_setopt(CURLSH *sh, CURLSHoption option, ...)
 #endif
       break;
 
-    case CURL_LOCK_DATA_CONNECT:     /* not supported (yet) */
+    case CURL_LOCK_DATA_CONNECT:
+      if(!share->conn_cache) {
+        share->conn_cache = Curl_conncache_init(CURL_CONNECTION_HASH_SIZE);
+        if(share->conn_cache) {
+          share->closure_handle = curl_easy_init();
+          if(share->closure_handle)
+            share->closure_handle->state.conn_cache = share->conn_cache;
+          else {
+            Curl_conncache_destroy(share->conn_cache);
+            share->conn_cache = NULL;
+          }
+        }
+        if(!share->conn_cache)
+          res = CURLSHE_NOMEM;
+      }
       break;
 
     default:
@@ -116,7 +146,7 @@ curl_share_setopt(CURLSH *sh, CURLSHoption option, ...)
     switch( type ) {
     case CURL_LOCK_DATA_DNS:
       if(share->hostcache) {
-        Curl_hash_destroy(share->hostcache);
+        Curl_hostcache_destroy(share->hostcache);
         share->hostcache = NULL;
       }
       break;
@@ -141,6 +171,7 @@ curl_share_setopt(CURLSH *sh, CURLSHoption option, ...)
       break;
 
     case CURL_LOCK_DATA_CONNECT:
+      share_conncache_cleanup(share);
       break;
 
     default:
@@ -186,17 +217,21 @@ curl_share_cleanup(CURLSH *sh)
     share->lockfunc(NULL, CURL_LOCK_DATA_SHARE, CURL_LOCK_ACCESS_SINGLE,
                     share->clientdata);
 
-  if(share->dirty) {
+  /* a multi handle that watches idle connections of the cache uses the
+     share as well */
+  if(share->dirty || share->idle_watches) {
     if(share->unlockfunc)
       share->unlockfunc(NULL, CURL_LOCK_DATA_SHARE, share->clientdata);
     return CURLSHE_IN_USE;
   }
 
   if(share->hostcache) {
-    Curl_hash_destroy(share->hostcache);
+    Curl_hostcache_destroy(share->hostcache);
     share->hostcache = NULL;
   }
 
+  share_conncache_cleanup(share);
+
 #if !defined(CURL_DISABLE_HTTP) && !defined(CURL_DISABLE_COOKIES)
   if(share->cookies)
     Curl_cookie_cleanup(share->cookies);
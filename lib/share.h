@@ -44,7 +44,7 @@ struct Curl_share {
   curl_unlock_function unlockfunc;
   void *clientdata;
 
-  struct curl_hash *hostcache;
+  struct Curl_dnscache *hostcache;
 #if !defined(CURL_DISABLE_HTTP) && !defined(CURL_DISABLE_COOKIES)
   struct CookieInfo *cookies;
 #endif
@@ -52,6 +52,12 @@ struct Curl_share {
   struct curl_ssl_session *sslsession;
   size_t max_ssl_sessions;
   long sessionage;
+
+  struct conncache *conn_cache;
+  struct SessionHandle *closure_handle; /* closes the connections left in
+                                           'conn_cache' when it goes away */
+  unsigned int idle_watches; /* multi handles watching idle connections of
+                                'conn_cache', changed with that locked */
 };
 
 CURLSHcode Curl_share_lock (struct SessionHandle *, curl_lock_data,
@@ -57,7 +57,7 @@ CURLcode Curl_speedcheck(struct SessionHandle *data,
     }
     else {
       /* wait complete low_speed_time */
-      Curl_expire_latest(data, nextcheck);
+      Curl_expire_latest(data, nextcheck, EXPIRE_SPEEDCHECK);
     }
   }
   else {
@@ -68,7 +68,8 @@ CURLcode Curl_speedcheck(struct SessionHandle *data,
       /* if there is a low speed limit enabled, we set the expire timer to
          make this connection's speed get checked again no later than when
          this time is up */
-      Curl_expire_latest(data, data->set.low_speed_time*1000);
+      Curl_expire_latest(data, data->set.low_speed_time*1000,
+                         EXPIRE_SPEEDCHECK);
   }
   return CURLE_OK;
 }
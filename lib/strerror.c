@@ -369,6 +369,9 @@ curl_multi_strerror(CURLMcode error)
   case CURLM_ADDED_ALREADY:
     return "The easy handle is already added to a multi handle";
 
+  case CURLM_WAKEUP_FAILURE:
+    return "Failed to wake up the multi handle";
+
   case CURLM_LAST:
     break;
   }
@@ -0,0 +1,356 @@
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 1997 - 2015, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at http://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+
+#include "curl_setup.h"
+
+#include "timewheel.h"
+
+/*
+ * The wheel keeps this invariant for every node it holds in level L: the
+ * node's expire tick has the same digits as the current tick above digit L,
+ * and a larger digit L. All nodes in level L therefore expire before all
+ * nodes in level L+1, and within a level the slot order is the expire order.
+ * When the current tick moves forward, only the slots the new tick passed
+ * need to be expired or redistributed ("cascaded") to lower levels, so each
+ * node is touched at most once per level during its lifetime.
+ */
+
+#define SLOTMASK (CURL_WHEEL_SLOTS - 1)
+#define DIGIT(tick, level) \
+  ((int)(((tick) >> ((level) * CURL_WHEEL_BITS)) & SLOTMASK))
+
+/* convert a time to a tick, rounding up so that nodes never expire early */
+static curl_off_t wheel_tick(const struct Curl_wheel *wheel,
+                             struct timeval tv, bool roundup)
+{
+  curl_off_t usec = (curl_off_t)(tv.tv_sec - wheel->base.tv_sec) * 1000000 +
+    (tv.tv_usec - wheel->base.tv_usec);
+
+  if(usec <= 0)
+    return 0;
+  return (usec + (roundup ? 999 : 0)) / 1000;
+}
+
+static struct timeval wheel_time(const struct Curl_wheel *wheel,
+                                 curl_off_t tick)
+{
+  struct timeval tv = wheel->base;
+
+  tv.tv_sec += (long)(tick / 1000);
+  tv.tv_usec += (long)(tick % 1000) * 1000;
+  if(tv.tv_usec >= 1000000) {
+    tv.tv_sec++;
+    tv.tv_usec -= 1000000;
+  }
+  return tv;
+}
+
+static void wheel_link(struct Curl_wheel *wheel, struct Curl_wheel_node *node,
+                       int list)
+{
+  struct Curl_wheel_list *l = &wheel->lists[list];
+
+  node->next = NULL;
+  node->prev = l->tail;
+  if(l->tail)
+    l->tail->next = node;
+  else
+    l->head = node;
+  l->tail = node;
+  node->list = list + 1;
+
+  if(list < CURL_WHEEL_OVERFLOW)
+    wheel->occupied[list / CURL_WHEEL_SLOTS][(list & SLOTMASK) / 32] |=
+      1U << (list & 31);
+}
+
+static void wheel_unlink(struct Curl_wheel *wheel,
+                         struct Curl_wheel_node *node)
+{
+  int list = node->list - 1;
+  struct Curl_wheel_list *l = &wheel->lists[list];
+
+  if(node->prev)
+    node->prev->next = node->next;
+  else
+    l->head = node->next;
+  if(node->next)
+    node->next->prev = node->prev;
+  else
+    l->tail = node->prev;
+  node->next = node->prev = NULL;
+  node->list = 0;
+
+  if(!l->head && (list < CURL_WHEEL_OVERFLOW))
+    wheel->occupied[list / CURL_WHEEL_SLOTS][(list & SLOTMASK) / 32] &=
+      ~(1U << (list & 31));
+}
+
+/* link a node in the list its tick belongs to relative to the current tick */
+static void wheel_place(struct Curl_wheel *wheel,
+                        struct Curl_wheel_node *node)
+{
+  curl_off_t diff;
+  int level = 0;
+
+  if(node->tick <= wheel->now) {
+    wheel_link(wheel, node, CURL_WHEEL_DUE);
+    return;
+  }
+
+  /* find the highest digit in which the tick differs from the current */
+  diff = node->tick ^ wheel->now;
+  while((diff >>= CURL_WHEEL_BITS) != 0)
+    level++;
+
+  if(level >= CURL_WHEEL_LEVELS)
+    wheel_link(wheel, node, CURL_WHEEL_OVERFLOW);
+  else
+    wheel_link(wheel, node, level * CURL_WHEEL_SLOTS +
+               DIGIT(node->tick, level));
+}
+
+/* find the first occupied slot at or after 'slot' in the given level, or -1 */
+static int wheel_firstslot(const struct Curl_wheel *wheel, int level,
+                           int slot)
+{
+  while(slot < CURL_WHEEL_SLOTS) {
+    unsigned int bits = wheel->occupied[level][slot / 32] >> (slot & 31);
+    if(bits) {
+      while(!(bits & 1)) {
+        bits >>= 1;
+        slot++;
+      }
+      return slot;
+    }
+    slot = (slot | 31) + 1;
+  }
+  return -1;
+}
+
+/* move all nodes in the given list to the list of expired nodes */
+static void wheel_expire(struct Curl_wheel *wheel, int list)
+{
+  struct Curl_wheel_list *l = &wheel->lists[list];
+  struct Curl_wheel_list *due = &wheel->lists[CURL_WHEEL_DUE];
+  struct Curl_wheel_node *node;
+
+  if(!l->head)
+    return;
+
+  for(node = l->head; node; node = node->next)
+    node->list = CURL_WHEEL_DUE + 1;
+
+  /* splice the whole list onto the end of the due list */
+  l->head->prev = due->tail;
+  if(due->tail)
+    due->tail->next = l->head;
+  else
+    due->head = l->head;
+  due->tail = l->tail;
+  l->head = l->tail = NULL;
+
+  wheel->occupied[list / CURL_WHEEL_SLOTS][(list & SLOTMASK) / 32] &=
+    ~(1U << (list & 31));
+}
+
+/* re-place all nodes of a list, used when the current tick has moved */
+static void wheel_cascade(struct Curl_wheel *wheel, int list)
+{
+  struct Curl_wheel_node *node = wheel->lists[list].head;
+
+  /* detach the list first as overflow nodes may end up in it again */
+  wheel->lists[list].head = wheel->lists[list].tail = NULL;
+  if(list < CURL_WHEEL_OVERFLOW)
+    wheel->occupied[list / CURL_WHEEL_SLOTS][(list & SLOTMASK) / 32] &=
+      ~(1U << (list & 31));
+
+  while(node) {
+    struct Curl_wheel_node *next = node->next;
+    wheel_place(wheel, node);
+    node = next;
+  }
+}
+
+/* move the current tick forward, expiring and cascading nodes as needed */
+static void wheel_advance(struct Curl_wheel *wheel, curl_off_t tick)
+{
+  curl_off_t diff;
+  int level = 0;
+  int top;
+  int l;
+  int slot;
+
+  if(tick <= wheel->now)
+    return;
+
+  diff = tick ^ wheel->now;
+  while((diff >> CURL_WHEEL_BITS) != 0) {
+    diff >>= CURL_WHEEL_BITS;
+    level++;
+  }
+
+  /* every level below 'top' only holds nodes that are now expired */
+  top = (level < CURL_WHEEL_LEVELS) ? level : CURL_WHEEL_LEVELS;
+  for(l = 0; l < top; l++) {
+    for(slot = wheel_firstslot(wheel, l, 0); slot != -1;
+        slot = wheel_firstslot(wheel, l, slot + 1))
+      wheel_expire(wheel, l * CURL_WHEEL_SLOTS + slot);
+  }
+
+  if(level < CURL_WHEEL_LEVELS) {
+    /* in the top changed level, the slots that were passed have expired and
+       the slot the new tick is in must be sorted out against the new tick */
+    int newslot = DIGIT(tick, level);
+
+    for(slot = wheel_firstslot(wheel, level, 0);
+        (slot != -1) && (slot < newslot);
+        slot = wheel_firstslot(wheel, level, slot + 1))
+      wheel_expire(wheel, level * CURL_WHEEL_SLOTS + slot);
+
+    wheel->now = tick;
+    wheel_cascade(wheel, level * CURL_WHEEL_SLOTS + newslot);
+  }
+  else {
+    /* the overflow nodes may fit in the wheel now */
+    wheel->now = tick;
+    wheel_cascade(wheel, CURL_WHEEL_OVERFLOW);
+  }
+}
+
+/*
+ * Curl_wheel_init()
+ *
+ * Prepare an empty wheel. 'now' is the time of tick zero.
+ */
+void Curl_wheel_init(struct Curl_wheel *wheel, struct timeval now)
+{
+  memset(wheel, 0, sizeof(*wheel));
+  wheel->base = now;
+}
+
+/*
+ * Curl_wheel_insert()
+ *
+ * Add a node that expires at 'key' to the wheel. The node must not already
+ * be in the wheel.
+ */
+void Curl_wheel_insert(struct Curl_wheel *wheel,
+                       struct Curl_wheel_node *node,
+                       struct timeval key)
+{
+  DEBUGASSERT(!Curl_wheel_queued(node));
+
+  node->key = key;
+  node->tick = wheel_tick(wheel, key, TRUE);
+  wheel_place(wheel, node);
+  wheel->count++;
+}
+
+/*
+ * Curl_wheel_remove()
+ *
+ * Take a node out of the wheel. Removing a node that is not in the wheel is
+ * fine and does nothing.
+ */
+void Curl_wheel_remove(struct Curl_wheel *wheel,
+                       struct Curl_wheel_node *node)
+{
+  if(!Curl_wheel_queued(node))
+    return;
+
+  wheel_unlink(wheel, node);
+  wheel->count--;
+}
+
+/*
+ * Curl_wheel_getbest()
+ *
+ * Extract and return one node that has expired at time 'now', or NULL if
+ * there is none. Nodes that expired in the first level are returned in
+ * millisecond order. When the wheel was not advanced for a while, nodes that
+ * expired straight from a higher level come in the order of that level's
+ * slots.
+ */
+struct Curl_wheel_node *Curl_wheel_getbest(struct Curl_wheel *wheel,
+                                           struct timeval now)
+{
+  struct Curl_wheel_node *node;
+
+  wheel_advance(wheel, wheel_tick(wheel, now, FALSE));
+
+  node = wheel->lists[CURL_WHEEL_DUE].head;
+  if(node) {
+    wheel_unlink(wheel, node);
+    wheel->count--;
+  }
+  return node;
+}
+
+/*
+ * Curl_wheel_next()
+ *
+ * Store the time when the next node expires in 'expire' and return TRUE, or
+ * return FALSE if the wheel is empty. The returned time is that of the tick
+ * the node expires at. For nodes further ahead than the first level, the
+ * start of their slot is returned instead, which is never later than the
+ * actual expire time.
+ */
+bool Curl_wheel_next(struct Curl_wheel *wheel, struct timeval *expire)
+{
+  struct Curl_wheel_node *node;
+  curl_off_t tick;
+  int level;
+
+  if(!wheel->count)
+    return FALSE;
+
+  node = wheel->lists[CURL_WHEEL_DUE].head;
+  if(node) {
+    *expire = node->key;
+    return TRUE;
+  }
+
+  for(level = 0; level < CURL_WHEEL_LEVELS; level++) {
+    int slot = wheel_firstslot(wheel, level, 0);
+    if(slot != -1) {
+      /* the tick this slot starts at: the current tick's higher digits, this
+         slot's digit and all lower digits zero */
+      curl_off_t mask = ((curl_off_t)1 << ((level + 1) * CURL_WHEEL_BITS)) -
+        1;
+      tick = (wheel->now & ~mask) |
+        ((curl_off_t)slot << (level * CURL_WHEEL_BITS));
+
+      *expire = wheel_time(wheel, tick);
+      return TRUE;
+    }
+  }
+
+  /* only the overflow list has nodes, it is not sorted */
+  node = wheel->lists[CURL_WHEEL_OVERFLOW].head;
+  tick = node->tick;
+  for(node = node->next; node; node = node->next)
+    if(node->tick < tick)
+      tick = node->tick;
+  *expire = wheel_time(wheel, tick);
+  return TRUE;
+}
@@ -0,0 +1,82 @@
+#ifndef HEADER_CURL_TIMEWHEEL_H
+#define HEADER_CURL_TIMEWHEEL_H
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 1997 - 2015, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at http://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include "curl_setup.h"
+
+/*
+ * A hierarchical timing wheel with millisecond ticks. Each level has
+ * CURL_WHEEL_SLOTS slots and covers CURL_WHEEL_BITS more bits of the expire
+ * tick than the level below it. Nodes are embedded in the structs they time
+ * so inserting and removing never allocates memory.
+ */
+#define CURL_WHEEL_BITS   6
+#define CURL_WHEEL_SLOTS  (1 << CURL_WHEEL_BITS)
+#define CURL_WHEEL_LEVELS 6 /* 36 bits of milliseconds, a little over two
+                               years ahead */
+
+/* list index for nodes too far ahead for the wheel */
+#define CURL_WHEEL_OVERFLOW (CURL_WHEEL_LEVELS * CURL_WHEEL_SLOTS)
+/* list index for nodes that have expired but are not yet extracted */
+#define CURL_WHEEL_DUE      (CURL_WHEEL_OVERFLOW + 1)
+#define CURL_WHEEL_LISTS    (CURL_WHEEL_DUE + 1)
+
+struct Curl_wheel_node {
+  struct Curl_wheel_node *next;
+  struct Curl_wheel_node *prev;
+  struct timeval key;  /* the exact expire time */
+  curl_off_t tick;     /* the expire time in wheel ticks */
+  int list;            /* index of the list this node is linked in plus
+                          one, zero when it is not in the wheel */
+  void *payload;       /* data the wheel code doesn't care about */
+};
+
+struct Curl_wheel_list {
+  struct Curl_wheel_node *head;
+  struct Curl_wheel_node *tail;
+};
+
+struct Curl_wheel {
+  struct timeval base; /* the time of tick zero */
+  curl_off_t now;      /* the tick the wheel has been advanced to */
+  size_t count;        /* number of nodes in the wheel */
+  unsigned int occupied[CURL_WHEEL_LEVELS][CURL_WHEEL_SLOTS/32];
+  struct Curl_wheel_list lists[CURL_WHEEL_LISTS];
+};
+
+void Curl_wheel_init(struct Curl_wheel *wheel, struct timeval now);
+
+void Curl_wheel_insert(struct Curl_wheel *wheel,
+                       struct Curl_wheel_node *node,
+                       struct timeval key);
+
+void Curl_wheel_remove(struct Curl_wheel *wheel,
+                       struct Curl_wheel_node *node);
+
+struct Curl_wheel_node *Curl_wheel_getbest(struct Curl_wheel *wheel,
+                                           struct timeval now);
+
+bool Curl_wheel_next(struct Curl_wheel *wheel, struct timeval *expire);
+
+#define Curl_wheel_queued(n) ((n)->list != 0)
+
+#endif /* HEADER_CURL_TIMEWHEEL_H */
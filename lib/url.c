@@ -408,7 +408,7 @@ CURLcode Curl_close(struct SessionHandle *data)
   if(!data)
     return CURLE_OK;
 
-  Curl_expire(data, 0); /* shut off timers */
+  Curl_expire_clear(data); /* shut off timers */
 
   m = data->multi;
 
@@ -422,14 +422,6 @@ CURLcode Curl_close(struct SessionHandle *data)
        use and this is the one */
     curl_multi_cleanup(data->multi_easy);
 
-  /* Destroy the timeout list that is held in the easy handle. It is
-     /normally/ done by curl_multi_remove_handle() but this is "just in
-     case" */
-  if(data->state.timeoutlist) {
-    Curl_llist_destroy(data->state.timeoutlist, NULL);
-    data->state.timeoutlist = NULL;
-  }
-
   data->magic = 0; /* force a clear AFTER the possibly enforced removal from
                       the multi handle, since that function uses the magic
                       field! */
@@ -443,10 +435,12 @@ CURLcode Curl_close(struct SessionHandle *data)
 
   /* freed here just in case DONE wasn't called */
   Curl_free_request_state(data);
+  Curl_arena_destroy(&data->state.arena);
 
   /* Close down all open SSL info and sessions */
   Curl_ssl_close_all(data);
   Curl_safefree(data->state.first_host);
+  Curl_safefree(data->state.connwait_key);
   Curl_safefree(data->state.scratch);
   Curl_ssl_free_certinfo(data);
 
@@ -692,6 +686,43 @@ CURLcode Curl_setopt(struct SessionHandle *data, CURLoption option,
   case CURLOPT_DNS_CACHE_TIMEOUT:
     data->set.dns_cache_timeout = va_arg(param, long);
     break;
+  case CURLOPT_DNS_NEGATIVE_CACHE_TIMEOUT:
+    /*
+     * Names that failed to resolve are remembered for this many seconds.
+     */
+    arg = va_arg(param, long);
+    if(arg < 0)
+      return CURLE_BAD_FUNCTION_ARGUMENT;
+    data->set.dns_negative_timeout = arg;
+    break;
+  case CURLOPT_DNS_SERVE_STALE:
+    /*
+     * Expired names are used for this many seconds more while they are
+     * resolved again in the background.
+     */
+    arg = va_arg(param, long);
+    if(arg < 0)
+      return CURLE_BAD_FUNCTION_ARGUMENT;
+    data->set.dns_serve_stale = arg;
+    break;
+  case CURLOPT_DNS_PREFETCH:
+    /*
+     * Names used this many seconds before they expire are resolved again in
+     * the background.
+     */
+    arg = va_arg(param, long);
+    if(arg < 0)
+      return CURLE_BAD_FUNCTION_ARGUMENT;
+    data->set.dns_prefetch = arg;
+    break;
+  case CURLOPT_DNS_CACHE_FILE:
+    /*
+     * The file to fill the DNS cache from and to save it to.
+     */
+    result = setstropt(&data->set.str[STRING_DNS_CACHE_FILE],
+                       va_arg(param, char *));
+    data->state.dns_file_loaded = FALSE;
+    break;
   case CURLOPT_DNS_USE_GLOBAL_CACHE:
     /* remember we want this enabled */
     arg = va_arg(param, long);
@@ -739,6 +770,26 @@ CURLcode Curl_setopt(struct SessionHandle *data, CURLoption option,
      */
     data->set.reuse_fresh = (0 != va_arg(param, long))?TRUE:FALSE;
     break;
+  case CURLOPT_MAXAGE_CONN:
+    /*
+     * A connection that has been idle for longer than this many seconds is
+     * closed instead of re-used.
+     */
+    arg = va_arg(param, long);
+    if(arg < 0)
+      return CURLE_BAD_FUNCTION_ARGUMENT;
+    data->set.maxage_conn = arg;
+    break;
+  case CURLOPT_MAXLIFETIME_CONN:
+    /*
+     * A connection made longer than this many seconds ago is closed instead
+     * of re-used.
+     */
+    arg = va_arg(param, long);
+    if(arg < 0)
+      return CURLE_BAD_FUNCTION_ARGUMENT;
+    data->set.maxlifetime_conn = arg;
+    break;
   case CURLOPT_VERBOSE:
     /*
      * Verbose means infof() calls that give a lot of information about
@@ -2602,6 +2653,79 @@ CURLcode Curl_setopt(struct SessionHandle *data, CURLoption option,
   return result;
 }
 
+/* the most unused connectdata structs a multi handle keeps around */
+#define CONNPOOL_MAX 16
+
+/*
+ * Get a zeroed connectdata struct, from the multi handle's pool if it has
+ * one. The pipeline lists and master buffer of a pooled struct are kept, so
+ * they need not be allocated again.
+ */
+static struct connectdata *conn_take(struct Curl_multi *multi)
+{
+  struct connectdata *conn = multi ? multi->connpool : NULL;
+  struct curl_llist *send_pipe;
+  struct curl_llist *recv_pipe;
+  char *master_buffer;
+
+  if(!conn)
+    return calloc(1, sizeof(struct connectdata));
+
+  multi->connpool = conn->poolnext;
+  multi->connpool_size--;
+
+  send_pipe = conn->send_pipe;
+  recv_pipe = conn->recv_pipe;
+  master_buffer = conn->master_buffer;
+  memset(conn, 0, sizeof(struct connectdata));
+  conn->send_pipe = send_pipe;
+  conn->recv_pipe = recv_pipe;
+  conn->master_buffer = master_buffer;
+  return conn;
+}
+
+/*
+ * Hand a connectdata struct that is done with back to the multi handle's
+ * pool, or free it if there is no room. Its pipelines must be empty.
+ */
+static void conn_release(struct Curl_multi *multi, struct connectdata *conn)
+{
+  if(multi && (multi->connpool_size < CONNPOOL_MAX)) {
+    conn->poolnext = multi->connpool;
+    multi->connpool = conn;
+    multi->connpool_size++;
+    return;
+  }
+
+  Curl_llist_destroy(conn->send_pipe, NULL);
+  Curl_llist_destroy(conn->recv_pipe, NULL);
+  Curl_safefree(conn->master_buffer);
+  free(conn);
+}
+
+/*
+ * Curl_free_conn_pool() frees the connectdata structs a multi handle keeps
+ * for reuse.
+ */
+void Curl_free_conn_pool(struct Curl_multi *multi)
+{
+  while(multi->connpool) {
+    struct connectdata *conn = multi->connpool;
+    multi->connpool = conn->poolnext;
+    multi->connpool_size--;
+    conn_release(NULL, conn);
+  }
+}
+
+/* take all handles out of a pipeline, leaving the list empty */
+static void pipe_empty(struct curl_llist *pipeline)
+{
+  if(pipeline) {
+    while(pipeline->head)
+      Curl_llist_remove(pipeline, pipeline->head, NULL);
+  }
+}
+
 static void conn_free(struct connectdata *conn)
 {
   if(!conn)
@@ -2639,28 +2763,19 @@ static void conn_free(struct connectdata *conn)
   Curl_safefree(conn->allocptr.proxyuserpwd);
   Curl_safefree(conn->allocptr.uagent);
   Curl_safefree(conn->allocptr.userpwd);
-  Curl_safefree(conn->allocptr.accept_encoding);
-  Curl_safefree(conn->allocptr.te);
-  Curl_safefree(conn->allocptr.rangeline);
-  Curl_safefree(conn->allocptr.ref);
-  Curl_safefree(conn->allocptr.host);
-  Curl_safefree(conn->allocptr.cookiehost);
-  Curl_safefree(conn->allocptr.rtsp_transport);
   Curl_safefree(conn->trailer);
   Curl_safefree(conn->host.rawalloc); /* host name buffer */
   Curl_safefree(conn->proxy.rawalloc); /* proxy name buffer */
-  Curl_safefree(conn->master_buffer);
 
-  Curl_llist_destroy(conn->send_pipe, NULL);
-  Curl_llist_destroy(conn->recv_pipe, NULL);
-
-  conn->send_pipe = NULL;
-  conn->recv_pipe = NULL;
+  pipe_empty(conn->send_pipe);
+  pipe_empty(conn->recv_pipe);
 
   Curl_safefree(conn->localdev);
+  Curl_safefree(conn->bundle_key);
   Curl_free_ssl_config(&conn->ssl_config);
 
-  free(conn); /* free all the connection oriented data */
+  /* done with all the connection oriented data */
+  conn_release(conn->data ? conn->data->multi : NULL, conn);
 }
 
 /*
@@ -2697,13 +2812,23 @@ CURLcode Curl_disconnect(struct connectdata *conn, bool dead_connection)
   Curl_http_ntlm_cleanup(conn);
 #endif
 
+  if(conn->idle_watch) {
+    /* stop watching the socket before anything is sent on it or it gets
+       closed */
+    Curl_conncache_lock(data);
+    Curl_multi_idle_unwatch(data, conn);
+    Curl_conncache_unlock(data);
+  }
+
   if(conn->handler->disconnect)
     /* This is set if protocol-specific cleanups should be made */
     conn->handler->disconnect(conn, dead_connection);
 
     /* unlink ourselves! */
   infof(data, "Closing connection %ld\n", conn->connection_id);
+  Curl_conncache_lock(data);
   Curl_conncache_remove_conn(data->state.conn_cache, conn);
+  Curl_conncache_unlock(data);
 
 #if defined(USE_LIBIDN)
   if(conn->host.encalloc)
@@ -2776,8 +2901,9 @@ bool Curl_isPipeliningEnabled(const struct SessionHandle *handle)
 CURLcode Curl_addHandleToPipeline(struct SessionHandle *data,
                                   struct curl_llist *pipeline)
 {
-  if(!Curl_llist_insert_next(pipeline, pipeline->tail, data))
-    return CURLE_OUT_OF_MEMORY;
+  /* the handle's element can only be in one pipeline */
+  DEBUGASSERT(!data->pipe_node.ptr);
+  Curl_llist_insert_node(pipeline, pipeline->tail, data, &data->pipe_node);
   return CURLE_OK;
 }
 
@@ -2876,46 +3002,8 @@ static void signalPipeClose(struct curl_llist *pipeline, bool pipe_broke)
 static struct connectdata *
 find_oldest_idle_connection(struct SessionHandle *data)
 {
-  struct conncache *bc = data->state.conn_cache;
-  struct curl_hash_iterator iter;
-  struct curl_llist_element *curr;
-  struct curl_hash_element *he;
-  long highscore=-1;
-  long score;
-  struct timeval now;
-  struct connectdata *conn_candidate = NULL;
-  struct connectbundle *bundle;
-
-  now = Curl_tvnow();
-
-  Curl_hash_start_iterate(bc->hash, &iter);
-
-  he = Curl_hash_next_element(&iter);
-  while(he) {
-    struct connectdata *conn;
-
-    bundle = he->ptr;
-
-    curr = bundle->conn_list->head;
-    while(curr) {
-      conn = curr->ptr;
-
-      if(!conn->inuse) {
-        /* Set higher score for the age passed since the connection was used */
-        score = Curl_tvdiff(now, conn->now);
-
-        if(score > highscore) {
-          highscore = score;
-          conn_candidate = conn;
-        }
-      }
-      curr = curr->next;
-    }
-
-    he = Curl_hash_next_element(&iter);
-  }
-
-  return conn_candidate;
+  /* the cache keeps its idle connections in the order they were left */
+  return Curl_conncache_oldest_idle(data->state.conn_cache);
 }
 
 /*
@@ -2929,44 +3017,60 @@ static struct connectdata *
 find_oldest_idle_connection_in_bundle(struct SessionHandle *data,
                                       struct connectbundle *bundle)
 {
-  struct curl_llist_element *curr;
-  long highscore=-1;
-  long score;
-  struct timeval now;
-  struct connectdata *conn_candidate = NULL;
-  struct connectdata *conn;
-
   (void)data;
 
-  now = Curl_tvnow();
+  return Curl_bundle_oldest_idle(bundle);
+}
 
-  curr = bundle->conn_list->head;
-  while(curr) {
-    conn = curr->ptr;
+/* the smaller of two limits where 0 means no limit */
+static long min_limit(long a, long b)
+{
+  if(!a)
+    return b;
+  if(!b)
+    return a;
+  return (a < b) ? a : b;
+}
 
-    if(!conn->inuse) {
-      /* Set higher score for the age passed since the connection was used */
-      score = Curl_tvdiff(now, conn->now);
+/*
+ * Check if an idle connection has been idle for too long or lives for too
+ * long to be re-used, by the limits of the handle that made it or of the
+ * given handle, whichever is smaller.
+ *
+ * Returns TRUE if so and sets the reason to count its eviction under.
+ */
+static bool conn_expired(struct connectdata *conn,
+                         struct SessionHandle *data,
+                         curl_evict *reason)
+{
+  long maxage = min_limit(conn->maxage, data->set.maxage_conn);
+  long maxlifetime = min_limit(conn->maxlifetime,
+                               data->set.maxlifetime_conn);
+  struct timeval now;
 
-      if(score > highscore) {
-        highscore = score;
-        conn_candidate = conn;
-      }
-    }
-    curr = curr->next;
-  }
+  if(!maxage && !maxlifetime)
+    return FALSE;
 
-  return conn_candidate;
+  now = Curl_tvnow();
+  if(maxlifetime && (Curl_tvdiff(now, conn->created) / 1000 >= maxlifetime)) {
+    *reason = CURLEVICT_MAXLIFETIME;
+    return TRUE;
+  }
+  if(maxage && (Curl_tvdiff(now, conn->lastused) / 1000 >= maxage)) {
+    *reason = CURLEVICT_MAXAGE;
+    return TRUE;
+  }
+  return FALSE;
 }
 
 /*
- * This function checks if given connection is dead and disconnects if so.
- * (That also removes it from the connection cache.)
+ * This function checks if given connection is dead or too old to be re-used
+ * and disconnects if so. (That also removes it from the connection cache.)
  *
- * Returns TRUE if the connection actually was dead and disconnected.
+ * Returns TRUE if the connection actually was disconnected.
  */
-static bool disconnect_if_dead(struct connectdata *conn,
-                               struct SessionHandle *data)
+bool Curl_disconnect_if_dead(struct connectdata *conn,
+                             struct SessionHandle *data)
 {
   size_t pipeLen = conn->send_pipe->size + conn->recv_pipe->size;
   if(!pipeLen && !conn->inuse) {
@@ -2974,7 +3078,11 @@ static bool disconnect_if_dead(struct connectdata *conn,
        handles in pipeline and the connection isn't already marked in
        use */
     bool dead;
-    if(conn->handler->protocol & CURLPROTO_RTSP)
+    curl_evict reason = CURLEVICT_DEAD;
+
+    if(conn_expired(conn, data, &reason))
+      dead = TRUE;
+    else if(conn->handler->protocol & CURLPROTO_RTSP)
       /* RTSP is a special case due to RTP interleaving */
       dead = Curl_rtsp_connisdead(conn);
     else
@@ -2982,10 +3090,17 @@ static bool disconnect_if_dead(struct connectdata *conn,
 
     if(dead) {
       conn->data = data;
-      infof(data, "Connection %ld seems to be dead!\n", conn->connection_id);
+      if(reason == CURLEVICT_DEAD)
+        infof(data, "Connection %ld seems to be dead!\n",
+              conn->connection_id);
+      else
+        infof(data, "Connection %ld is too old to re-use, closing it\n",
+              conn->connection_id);
+      data->state.conn_cache->evictions[reason]++;
 
       /* disconnect resources */
-      Curl_disconnect(conn, /* dead_connection */TRUE);
+      Curl_disconnect(conn, /* dead_connection */
+                      (reason == CURLEVICT_DEAD) ? TRUE : FALSE);
       return TRUE;
     }
   }
@@ -2993,33 +3108,44 @@ static bool disconnect_if_dead(struct connectdata *conn,
 }
 
 /*
- * Wrapper to use disconnect_if_dead() function in Curl_conncache_foreach()
+ * Curl_prune_dead_connections()
  *
- * Returns always 0.
- */
-static int call_disconnect_if_dead(struct connectdata *conn,
-                                      void *param)
-{
-  struct SessionHandle* data = (struct SessionHandle*)param;
-  disconnect_if_dead(conn, data);
-  return 0; /* continue iteration */
-}
-
-/*
- * This function scans the connection cache for half-open/dead connections,
- * closes and removes them.
- * The cleanup is done at most once per second.
+ * Check a few of the idle connections in the cache and close the ones that
+ * are dead or have been idle or alive for longer than the limits set by the
+ * handles that made them. A round starts with the connection that has been
+ * idle the longest and every call continues where the previous one stopped,
+ * so that no single call has to check the entire cache. The batches of a
+ * round are at least CONNCACHE_PRUNE_INTERVAL milliseconds apart and a new
+ * round is started at most once per second.
  */
-static void prune_dead_connections(struct SessionHandle *data)
+void Curl_prune_dead_connections(struct SessionHandle *data)
 {
+  struct conncache *connc = data->state.conn_cache;
+  struct connectdata *conn = connc->prune_next;
+  int checks = CONNCACHE_PRUNE_BATCH;
   struct timeval now = Curl_tvnow();
-  long elapsed = Curl_tvdiff(now, data->state.conn_cache->last_cleanup);
 
-  if(elapsed >= 1000L) {
-    Curl_conncache_foreach(data->state.conn_cache, data,
-                           call_disconnect_if_dead);
-    data->state.conn_cache->last_cleanup = now;
+  if(!conn) {
+    if(Curl_tvdiff(now, connc->last_cleanup) < 1000L)
+      return;
+    conn = Curl_conncache_oldest_idle(connc);
+  }
+  else if(Curl_tvdiff(now, connc->last_prune) < CONNCACHE_PRUNE_INTERVAL)
+    return;
+  connc->last_prune = now;
+
+  while(conn && checks--) {
+    struct connectdata *next =
+      conn->lru_node.next ? conn->lru_node.next->ptr : NULL;
+
+    (void)Curl_disconnect_if_dead(conn, data);
+    conn = next;
   }
+
+  connc->prune_next = conn;
+  if(!conn)
+    /* this round is complete */
+    connc->last_cleanup = Curl_tvnow();
 }
 
 /*
@@ -3058,7 +3184,7 @@ ConnectionExists(struct SessionHandle *data,
   /* Look up the bundle with all the connections to this
      particular host */
   bundle = Curl_conncache_find_bundle(data->state.conn_cache,
-                                      needle->host.name);
+                                      needle->bundle_key);
   if(bundle) {
     size_t max_pipe_len = Curl_multi_max_pipeline_length(data->multi);
     size_t best_pipe_len = max_pipe_len;
@@ -3073,9 +3199,11 @@ ConnectionExists(struct SessionHandle *data,
       canPipeline = FALSE;
     }
 
-    curr = bundle->conn_list->head;
+    /* Without pipelining only a connection nobody uses can be picked, and
+       those are kept in their own list with the most recently used first,
+       which is the one most likely to still be alive */
+    curr = canPipeline ? bundle->conn_list->head : bundle->idle_list->head;
     while(curr) {
-      bool match = FALSE;
 #if defined(USE_NTLM)
       bool credentialsMatch = FALSE;
 #endif
@@ -3088,7 +3216,7 @@ ConnectionExists(struct SessionHandle *data,
       check = curr->ptr;
       curr = curr->next;
 
-      if(disconnect_if_dead(check, data))
+      if(Curl_disconnect_if_dead(check, data))
         continue;
 
       pipeLen = check->send_pipe->size + check->recv_pipe->size;
@@ -3141,45 +3269,19 @@ ConnectionExists(struct SessionHandle *data,
         }
       }
 
-      if((needle->handler->flags&PROTOPT_SSL) !=
-         (check->handler->flags&PROTOPT_SSL))
-        /* don't do mixed SSL and non-SSL connections */
-        if(!(needle->handler->protocol & check->handler->protocol))
-          /* except protocols that have been upgraded via TLS */
-          continue;
-
-      if(needle->handler->flags&PROTOPT_SSL) {
-        if((data->set.ssl.verifypeer != check->verifypeer) ||
-           (data->set.ssl.verifyhost != check->verifyhost))
-          continue;
-      }
-
-      if(needle->bits.proxy != check->bits.proxy)
-        /* don't do mixed proxy and non-proxy connections */
-        continue;
-
       if(!canPipeline && check->inuse)
         /* this request can't be pipelined but the checked connection is
            already in use so we skip it */
         continue;
 
-      if(needle->localdev || needle->localport) {
-        /* If we are bound to a specific local end (IP+port), we must not
-           re-use a random other one, although if we didn't ask for a
-           particular one we can reuse one that was bound.
-
-           This comparison is a bit rough and too strict. Since the input
-           parameters can be specified in numerous ways and still end up the
-           same it would take a lot of processing to make it really accurate.
-           Instead, this matching will assume that re-uses of bound connections
-           will most likely also re-use the exact same binding parameters and
-           missing out a few edge cases shouldn't hurt anyone very much.
-        */
-        if((check->localport != needle->localport) ||
-           (check->localportrange != needle->localportrange) ||
-           !check->localdev ||
-           !needle->localdev ||
-           strcmp(check->localdev, needle->localdev))
+      /* All connections in the bundle go to the same host and port with the
+         same protocol, through the same proxy and from the same local end,
+         so only what can differ between them is checked here. See
+         conn_bundle_key(). */
+
+      if(needle->handler->flags&PROTOPT_SSL) {
+        if((data->set.ssl.verifypeer != check->verifypeer) ||
+           (data->set.ssl.verifyhost != check->verifyhost))
           continue;
       }
 
@@ -3197,109 +3299,79 @@ ConnectionExists(struct SessionHandle *data,
 #endif
       }
 
-      if(!needle->bits.httpproxy || needle->handler->flags&PROTOPT_SSL ||
-         (needle->bits.httpproxy && check->bits.httpproxy &&
-          needle->bits.tunnel_proxy && check->bits.tunnel_proxy &&
-          Curl_raw_equal(needle->proxy.name, check->proxy.name) &&
-          (needle->port == check->port))) {
-        /* The requested connection does not use a HTTP proxy or it uses SSL or
-           it is a non-SSL protocol tunneled over the same http proxy name and
-           port number or it is a non-SSL protocol which is allowed to be
-           upgraded via TLS */
-
-        if((Curl_raw_equal(needle->handler->scheme, check->handler->scheme) ||
-            needle->handler->protocol & check->handler->protocol) &&
-           Curl_raw_equal(needle->host.name, check->host.name) &&
-           needle->remote_port == check->remote_port) {
-          if(needle->handler->flags & PROTOPT_SSL) {
-            /* This is a SSL connection so verify that we're using the same
-               SSL options as well */
-            if(!Curl_ssl_config_matches(&needle->ssl_config,
-                                        &check->ssl_config)) {
-              DEBUGF(infof(data,
-                           "Connection #%ld has different SSL parameters, "
-                           "can't reuse\n",
-                           check->connection_id));
-              continue;
-            }
-            else if(check->ssl[FIRSTSOCKET].state != ssl_connection_complete) {
-              DEBUGF(infof(data,
-                           "Connection #%ld has not started SSL connect, "
-                           "can't reuse\n",
-                           check->connection_id));
-              continue;
-            }
-          }
-          match = TRUE;
+      if(needle->handler->flags & PROTOPT_SSL) {
+        /* This is a SSL connection so verify that we're using the same
+           SSL options as well */
+        if(!Curl_ssl_config_matches(&needle->ssl_config,
+                                    &check->ssl_config)) {
+          DEBUGF(infof(data,
+                       "Connection #%ld has different SSL parameters, "
+                       "can't reuse\n",
+                       check->connection_id));
+          continue;
         }
-      }
-      else { /* The requested needle connection is using a proxy,
-                is the checked one using the same host, port and type? */
-        if(check->bits.proxy &&
-           (needle->proxytype == check->proxytype) &&
-           (needle->bits.tunnel_proxy == check->bits.tunnel_proxy) &&
-           Curl_raw_equal(needle->proxy.name, check->proxy.name) &&
-           needle->port == check->port) {
-          /* This is the same proxy connection, use it! */
-          match = TRUE;
+        else if(check->ssl[FIRSTSOCKET].state != ssl_connection_complete) {
+          DEBUGF(infof(data,
+                       "Connection #%ld has not started SSL connect, "
+                       "can't reuse\n",
+                       check->connection_id));
+          continue;
         }
       }
 
-      if(match) {
 #if defined(USE_NTLM)
-        /* If we are looking for an HTTP+NTLM connection, check if this is
-           already authenticating with the right credentials. If not, keep
-           looking so that we can reuse NTLM connections if
-           possible. (Especially we must not reuse the same connection if
-           partway through a handshake!) */
-        if(wantNTLMhttp) {
-          if(credentialsMatch && check->ntlm.state != NTLMSTATE_NONE) {
-            chosen = check;
-
-            /* We must use this connection, no other */
-            *force_reuse = TRUE;
-            break;
-          }
-          else if(credentialsMatch)
-            /* this is a backup choice */
-            chosen = check;
-          continue;
+      /* If we are looking for an HTTP+NTLM connection, check if this is
+         already authenticating with the right credentials. If not, keep
+         looking so that we can reuse NTLM connections if
+         possible. (Especially we must not reuse the same connection if
+         partway through a handshake!) */
+      if(wantNTLMhttp) {
+        if(credentialsMatch && check->ntlm.state != NTLMSTATE_NONE) {
+          chosen = check;
+
+          /* We must use this connection, no other */
+          *force_reuse = TRUE;
+          break;
         }
+        else if(credentialsMatch)
+          /* this is a backup choice */
+          chosen = check;
+        continue;
+      }
 #endif
 
-        if(canPipeline) {
-          /* We can pipeline if we want to. Let's continue looking for
-             the optimal connection to use, i.e the shortest pipe that is not
-             blacklisted. */
+      if(canPipeline) {
+        /* We can pipeline if we want to. Let's continue looking for
+           the optimal connection to use, i.e the shortest pipe that is not
+           blacklisted. */
 
-          if(pipeLen == 0) {
-            /* We have the optimal connection. Let's stop looking. */
-            chosen = check;
-            break;
-          }
+        if(pipeLen == 0) {
+          /* We have the optimal connection. Let's stop looking. */
+          chosen = check;
+          break;
+        }
 
-          /* We can't use the connection if the pipe is full */
-          if(pipeLen >= max_pipe_len)
-            continue;
+        /* We can't use the connection if the pipe is full */
+        if(pipeLen >= max_pipe_len)
+          continue;
 
-          /* We can't use the connection if the pipe is penalized */
-          if(Curl_pipeline_penalized(data, check))
-            continue;
+        /* We can't use the connection if the pipe is penalized */
+        if(Curl_pipeline_penalized(data, check))
+          continue;
 
-          if(pipeLen < best_pipe_len) {
-            /* This connection has a shorter pipe so far. We'll pick this
-               and continue searching */
-            chosen = check;
-            best_pipe_len = pipeLen;
-            continue;
-          }
-        }
-        else {
-          /* We have found a connection. Let's stop searching. */
+        if(pipeLen < best_pipe_len) {
+          /* This connection has a shorter pipe so far. We'll pick this
+             and continue searching */
           chosen = check;
-          break;
+          best_pipe_len = pipeLen;
+          continue;
         }
       }
+      else {
+        /* We have found a connection. Let's stop searching. */
+        chosen = check;
+        break;
+      }
     }
   }
 
@@ -3322,8 +3394,11 @@ ConnectionDone(struct SessionHandle *data, struct connectdata *conn)
     data->multi->maxconnects;
   struct connectdata *conn_candidate = NULL;
 
+  Curl_conncache_lock(data);
+
   /* Mark the current connection as 'unused' */
   conn->inuse = FALSE;
+  Curl_conncache_conn_idle(data->state.conn_cache, conn);
 
   if(maxconnects > 0 &&
      data->state.conn_cache->num_connections > maxconnects) {
@@ -3336,10 +3411,17 @@ ConnectionDone(struct SessionHandle *data, struct connectdata *conn)
       conn_candidate->data = data;
 
       /* the winner gets the honour of being disconnected */
+      data->state.conn_cache->evictions[CURLEVICT_MAXCONNECTS]++;
       (void)Curl_disconnect(conn_candidate, /* dead_connection */ FALSE);
     }
   }
 
+  if(conn_candidate != conn)
+    /* have the multi handle notice if the server closes it */
+    Curl_multi_idle_watch(data, conn);
+
+  Curl_conncache_unlock(data);
+
   return (conn_candidate == conn) ? FALSE : TRUE;
 }
 
@@ -3662,7 +3744,7 @@ static void llist_dtor(void *user, void *element)
  */
 static struct connectdata *allocate_conn(struct SessionHandle *data)
 {
-  struct connectdata *conn = calloc(1, sizeof(struct connectdata));
+  struct connectdata *conn = conn_take(data->multi);
   if(!conn)
     return NULL;
 
@@ -3687,6 +3769,8 @@ static struct connectdata *allocate_conn(struct SessionHandle *data)
 
   /* Store creation time to help future close decision making */
   conn->created = Curl_tvnow();
+  conn->maxage = data->set.maxage_conn;
+  conn->maxlifetime = data->set.maxlifetime_conn;
 
   conn->data = data; /* Setup the association between this connection
                         and the SessionHandle */
@@ -3740,9 +3824,13 @@ static struct connectdata *allocate_conn(struct SessionHandle *data)
       goto error;
   }
 
-  /* Initialize the pipeline lists */
-  conn->send_pipe = Curl_llist_alloc((curl_llist_dtor) llist_dtor);
-  conn->recv_pipe = Curl_llist_alloc((curl_llist_dtor) llist_dtor);
+  /* Initialize the pipeline lists, unless they came along from the pool */
+  if(!conn->send_pipe)
+    conn->send_pipe =
+      Curl_llist_alloc_embedded((curl_llist_dtor) llist_dtor);
+  if(!conn->recv_pipe)
+    conn->recv_pipe =
+      Curl_llist_alloc_embedded((curl_llist_dtor) llist_dtor);
   if(!conn->send_pipe || !conn->recv_pipe)
     goto error;
 
@@ -4258,6 +4346,10 @@ void Curl_free_request_state(struct SessionHandle *data)
 {
   Curl_safefree(data->req.protop);
   Curl_safefree(data->req.newurl);
+
+  /* the request headers all live in the arena */
+  memset(&data->state.aptr, 0, sizeof(data->state.aptr));
+  Curl_arena_reset(&data->state.arena);
 }
 
 
@@ -5169,6 +5261,40 @@ static CURLcode resolve_server(struct SessionHandle *data,
   return result;
 }
 
+/*
+ * conn_bundle_key() makes the key of the connection cache bundle the
+ * connection belongs to, once the protocol, host, port and proxy of the
+ * connection are known. Connections that ConnectionExists() could pick for
+ * one another get the same key: those to the same host and port with the
+ * same protocol, through the same proxy and bound to the same local end.
+ * Connections to a HTTP proxy that is not tunneled through can be used for
+ * any host, so their key is made from the proxy alone. Host names compare
+ * case insensitively and are therefore upper-cased in the key.
+ */
+static CURLcode conn_bundle_key(struct connectdata *conn)
+{
+  bool anyhost = conn->bits.httpproxy && !conn->bits.tunnel_proxy;
+  char *key;
+
+  key = aprintf("%x/%s/%d/%s/%d/%ld/%d/%s/%hu/%d",
+                anyhost ? 0 : conn->handler->protocol,
+                anyhost ? "" : conn->host.name,
+                anyhost ? 0 : conn->remote_port,
+                conn->bits.proxy ? conn->proxy.name : "",
+                conn->bits.proxy ? (int)conn->proxytype : -1,
+                conn->bits.proxy ? conn->port : 0L,
+                conn->bits.tunnel_proxy ? 1 : 0,
+                conn->localdev ? conn->localdev : "",
+                conn->localport, conn->localportrange);
+  if(!key)
+    return CURLE_OUT_OF_MEMORY;
+
+  Curl_strntoupper(key, key, strlen(key));
+  Curl_safefree(conn->bundle_key);
+  conn->bundle_key = key;
+  return CURLE_OK;
+}
+
 /*
  * Cleanup the connection just allocated before we can move along and use the
  * previously existing one.  All relevant data is copied over and old_conn is
@@ -5226,14 +5352,7 @@ static void reuse_conn(struct connectdata *old_conn,
   Curl_safefree(old_conn->proxyuser);
   Curl_safefree(old_conn->proxypasswd);
   Curl_safefree(old_conn->localdev);
-
-  Curl_llist_destroy(old_conn->send_pipe, NULL);
-  Curl_llist_destroy(old_conn->recv_pipe, NULL);
-
-  old_conn->send_pipe = NULL;
-  old_conn->recv_pipe = NULL;
-
-  Curl_safefree(old_conn->master_buffer);
+  Curl_safefree(old_conn->bundle_key);
 }
 
 /**
@@ -5284,8 +5403,10 @@ static CURLcode create_conn(struct SessionHandle *data,
 
   /* First, split up the current URL in parts so that we can use the
      parts for checking against the already present connections. In order
-     to not have to modify everything at once, we allocate a temporary
-     connection data struct and fill in for comparison purposes. */
+     to not have to modify everything at once, we take a temporary
+     connection data struct and fill in for comparison purposes. It comes
+     from the multi handle's pool when it has one and goes back there if an
+     existing connection is re-used. */
   conn = allocate_conn(data);
 
   if(!conn) {
@@ -5522,6 +5643,11 @@ static CURLcode create_conn(struct SessionHandle *data,
   if(result)
     goto out;
 
+  /* the protocol, host, port and proxy are set now */
+  result = conn_bundle_key(conn);
+  if(result)
+    goto out;
+
   conn->recv[FIRSTSOCKET] = Curl_recv_plain;
   conn->send[FIRSTSOCKET] = Curl_send_plain;
   conn->recv[SECONDARYSOCKET] = Curl_recv_plain;
@@ -5543,7 +5669,9 @@ static CURLcode create_conn(struct SessionHandle *data,
       conn->data = data;
       conn->bits.tcpconnect[FIRSTSOCKET] = TRUE; /* we are "connected */
 
+      Curl_conncache_lock(data);
       ConnectionStore(data, conn);
+      Curl_conncache_unlock(data);
 
       /*
        * Setup whatever necessary for a resumed transfer
@@ -5593,14 +5721,16 @@ static CURLcode create_conn(struct SessionHandle *data,
     goto out;
   }
 
-  prune_dead_connections(data);
-
   /*************************************************************
    * Check the current list of connections to see if we can
    * re-use an already existing one or if we have to create a
    * new one.
    *************************************************************/
 
+  /* A cache shared with other handles is locked from the search for a
+     connection to re-use until the one picked or added is marked in use */
+  Curl_conncache_lock(data);
+
   /* reuse_fresh is TRUE if we are told to use a new connection by force, but
      we only acknowledge this option if this is not a re-used connection
      already (which happens due to follow-location or during a HTTP
@@ -5637,8 +5767,10 @@ static CURLcode create_conn(struct SessionHandle *data,
      */
     conn_temp->inuse = TRUE; /* mark this as being in use so that no other
                                 handle in a multi stack may nick it */
+    Curl_conncache_conn_busy(data->state.conn_cache, conn_temp);
+    Curl_multi_idle_unwatch(data, conn_temp);
     reuse_conn(conn, conn_temp);
-    free(conn);          /* we don't need this anymore */
+    conn_release(data->multi, conn); /* we don't need this anymore */
     conn = conn_temp;
     *in_connect = conn;
 
@@ -5656,7 +5788,7 @@ static CURLcode create_conn(struct SessionHandle *data,
     struct connectbundle *bundle;
 
     bundle = Curl_conncache_find_bundle(data->state.conn_cache,
-                                        conn->host.name);
+                                        conn->bundle_key);
     if(max_host_connections > 0 && bundle &&
        (bundle->num_connections >= max_host_connections)) {
       struct connectdata *conn_candidate;
@@ -5669,8 +5801,20 @@ static CURLcode create_conn(struct SessionHandle *data,
         conn_candidate->data = data;
         (void)Curl_disconnect(conn_candidate, /* dead_connection */ FALSE);
       }
-      else
+      else {
         no_connections_available = TRUE;
+
+        /* tell the multi handle which bundle to wait for */
+        Curl_safefree(data->state.connwait_key);
+        data->state.connwait_key = strdup(conn->bundle_key);
+        if(!data->state.connwait_key) {
+          Curl_conncache_unlock(data);
+          conn_free(conn);
+          *in_connect = NULL;
+          result = CURLE_OUT_OF_MEMORY;
+          goto out;
+        }
+      }
     }
 
     if(max_total_connections > 0 &&
@@ -5693,6 +5837,7 @@ static CURLcode create_conn(struct SessionHandle *data,
     if(no_connections_available) {
       infof(data, "No connections available.\n");
 
+      Curl_conncache_unlock(data);
       conn_free(conn);
       *in_connect = NULL;
 
@@ -5727,6 +5872,7 @@ static CURLcode create_conn(struct SessionHandle *data,
 
   /* Mark the connection as used */
   conn->inuse = TRUE;
+  Curl_conncache_unlock(data);
 
   /* Setup and init stuff before DO starts, in preparing for the transfer. */
   do_init(conn);
@@ -40,12 +40,16 @@ CURLcode Curl_do(struct connectdata **, bool *done);
 CURLcode Curl_do_more(struct connectdata *, int *completed);
 CURLcode Curl_done(struct connectdata **, CURLcode, bool premature);
 CURLcode Curl_disconnect(struct connectdata *, bool dead_connection);
+bool Curl_disconnect_if_dead(struct connectdata *conn,
+                             struct SessionHandle *data);
+void Curl_prune_dead_connections(struct SessionHandle *data);
 CURLcode Curl_protocol_connect(struct connectdata *conn, bool *done);
 CURLcode Curl_protocol_connecting(struct connectdata *conn, bool *done);
 CURLcode Curl_protocol_doing(struct connectdata *conn, bool *done);
 CURLcode Curl_setup_conn(struct connectdata *conn,
                          bool *protocol_done);
 void Curl_free_request_state(struct SessionHandle *data);
+void Curl_free_conn_pool(struct Curl_multi *multi);
 
 int Curl_protocol_getsock(struct connectdata *conn,
                           curl_socket_t *socks,
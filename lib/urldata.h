@@ -184,7 +184,8 @@
 #include "http_chunks.h" /* for the structs and enum stuff */
 #include "hostip.h"
 #include "hash.h"
-#include "splay.h"
+#include "timewheel.h"
+#include "arena.h"
 
 #include "imap.h"
 #include "pop3.h"
@@ -850,6 +851,8 @@ typedef ssize_t (Curl_recv)(struct connectdata *conn, /* connection data */
                             size_t len,               /* max amount to read */
                             CURLcode *err);           /* error to return */
 
+struct Curl_idle_watch; /* declared and used only in multi.c */
+
 /*
  * The connectdata struct contains all fields and variables that should be
  * unique for an entire connection.
@@ -936,6 +939,10 @@ struct connectdata {
 
   struct timeval now;     /* "current" time */
   struct timeval created; /* creation time */
+  struct timeval lastused; /* when it last went idle in the cache */
+  char *bundle_key; /* the key of the connection cache bundle it is in */
+  long maxage;      /* the CURLOPT_MAXAGE_CONN of the handle that made it */
+  long maxlifetime; /* the CURLOPT_MAXLIFETIME_CONN of the same */
   curl_socket_t sock[2]; /* two sockets, the second is used for the data
                             transfer when doing FTP */
   curl_socket_t tempsock[2]; /* temporary sockets for happy eyeballs */
@@ -975,14 +982,7 @@ struct connectdata {
   struct dynamically_allocated_data {
     char *proxyuserpwd;
     char *uagent;
-    char *accept_encoding;
     char *userpwd;
-    char *rangeline;
-    char *ref;
-    char *host;
-    char *cookiehost;
-    char *rtsp_transport;
-    char *te; /* TE: request header */
   } allocptr;
 
 #ifdef HAVE_GSSAPI
@@ -1094,6 +1094,17 @@ struct connectdata {
     TUNNEL_COMPLETE /* CONNECT response received completely */
   } tunnel_state[2]; /* two separate ones to allow FTP */
   struct connectbundle *bundle; /* The bundle we are member of */
+  struct curl_llist_element bundle_node; /* the element in the bundle's
+                                            connection list */
+  struct curl_llist_element idle_node; /* in the bundle's list of idle
+                                          connections, while not in use */
+  struct curl_llist_element lru_node; /* in the connection cache's list of
+                                         idle connections */
+  struct Curl_idle_watch *idle_watch; /* set while a multi handle watches
+                                         the socket of this connection for
+                                         being closed while idle */
+  struct connectdata *poolnext; /* next unused struct in the multi handle's
+                                   pool */
 
   enum negotiatenpn negnpn;
 };
@@ -1230,10 +1241,34 @@ struct auth {
                    be RFC compliant */
 };
 
+/* The different timers a handle can have pending at the same time. Setting
+   a timer again replaces the previous time for the same id. */
+typedef enum {
+  EXPIRE_100_TIMEOUT,
+  EXPIRE_ASYNC_NAME,
+  EXPIRE_CONNECTTIMEOUT,
+  EXPIRE_DNS_PER_NAME,
+  EXPIRE_FTP_ACCEPT,
+  EXPIRE_HAPPY_EYEBALLS,
+  EXPIRE_RUN_NOW,
+  EXPIRE_SPEEDCHECK,
+  EXPIRE_TIMEOUT,
+  EXPIRE_TOOFAST,
+  EXPIRE_LAST /* not an actual timer, used as a marker only */
+} expire_id;
+
+struct time_node {
+  struct time_node *next; /* next pending timeout of the same handle */
+  struct timeval time;    /* expire time, zero when not pending */
+};
+
 struct UrlState {
 
   /* Points to the connection cache */
   struct conncache *conn_cache;
+  unsigned int conncache_locked; /* times this handle has locked the
+                                    connection cache it shares with others,
+                                    see Curl_conncache_lock() */
 
   /* when curl_easy_perform() is called, the multi handle is "owned" by
      the easy handle so curl_easy_cleanup() on such an easy handle will
@@ -1293,12 +1328,22 @@ struct UrlState {
   void *resolver; /* resolver state, if it is used in the URL state -
                      ares_channel f.e. */
 
+  bool dns_file_loaded; /* the CURLOPT_DNS_CACHE_FILE has been read */
+  unsigned long dns_file_changes; /* the DNS cache's 'changes' when the
+                                     CURLOPT_DNS_CACHE_FILE was last read or
+                                     written */
+
 #if defined(USE_SSLEAY) && defined(HAVE_OPENSSL_ENGINE_H)
   ENGINE *engine;
 #endif /* USE_SSLEAY */
   struct timeval expiretime; /* set this with Curl_expire() only */
-  struct Curl_tree timenode; /* for the splay stuff */
-  struct curl_llist *timeoutlist; /* list of pending timeouts */
+  struct Curl_wheel_node timenode; /* for the timing wheel */
+  struct time_node expires[EXPIRE_LAST]; /* one pending timeout per id */
+  struct time_node *timeoutlist; /* the pending timeouts, sorted by time */
+
+  char *connwait_key; /* set when the connection limit for this host made
+                         the connect fail with CURLE_NO_CONNECTION_AVAILABLE,
+                         the key of the bundle to wait for a connection in */
 
   /* a place to store the most recently set FTP entrypath */
   char *most_recent_ftp_entrypath;
@@ -1341,6 +1386,19 @@ struct UrlState {
 
   curl_off_t infilesize; /* size of file to upload, -1 means unknown.
                             Copied from set.filesize at start of operation */
+
+  /* the request headers built for this request only, allocated from 'arena'
+     which Curl_free_request_state() resets */
+  struct Curl_arena arena;
+  struct {
+    char *accept_encoding;
+    char *rangeline;
+    char *ref;
+    char *host;
+    char *cookiehost;
+    char *rtsp_transport;
+    char *te; /* TE: request header */
+  } aptr;
 };
 
 
@@ -1430,6 +1488,7 @@ enum dupstring {
   STRING_TLSAUTH_PASSWORD,      /* TLS auth <password> */
 #endif
   STRING_BEARER,                /* <bearer>, if used */
+  STRING_DNS_CACHE_FILE,        /* DNS cache to load and save */
 #ifdef USE_UNIX_SOCKETS
   STRING_UNIX_SOCKET_PATH,      /* path to Unix socket, if used */
 #endif
@@ -1544,6 +1603,12 @@ struct UserDefined {
   struct ssl_config_data ssl;  /* user defined SSL stuff */
   curl_proxytype proxytype; /* what kind of proxy that is in use */
   long dns_cache_timeout; /* DNS cache timeout */
+  long dns_negative_timeout; /* DNS cache timeout for names that failed to
+                                resolve, 0 means they are not cached */
+  long dns_serve_stale; /* seconds past the DNS cache timeout a name may be
+                           used while it is resolved again */
+  long dns_prefetch; /* seconds before the DNS cache timeout a name that is
+                        used gets resolved again */
   long buffer_size;      /* size of receive buffer to use */
   void *private_data; /* application-private data */
 
@@ -1646,6 +1711,10 @@ struct UserDefined {
   long tcp_keepintvl;    /* seconds between TCP keepalive probes */
 
   size_t maxconnects;  /* Max idle connections in the connection cache */
+  long maxage_conn;      /* seconds a connection may be idle and still be
+                            re-used, 0 for no limit */
+  long maxlifetime_conn; /* seconds a connection may live and still be
+                            re-used, 0 for no limit */
 
   bool ssl_enable_npn;  /* TLS NPN extension? */
   bool ssl_enable_alpn; /* TLS ALPN extension? */
@@ -1654,7 +1723,7 @@ struct UserDefined {
 };
 
 struct Names {
-  struct curl_hash *hostcache;
+  struct Curl_dnscache *hostcache;
   enum {
     HCACHE_NONE,    /* not pointing to anything */
     HCACHE_GLOBAL,  /* points to the (shrug) global one */
@@ -1678,13 +1747,39 @@ struct SessionHandle {
   struct SessionHandle *next;
   struct SessionHandle *prev;
 
+  /* links for the multi handle's queue of handles to run, see
+     curl_multi_perform() */
+  struct SessionHandle *ready_next;
+  struct SessionHandle *ready_prev;
+  bool ready_queued;         /* TRUE while in the ready queue */
+  unsigned int ready_round;  /* the perform round this was last run in */
+
+  /* links for the wait queue of handles in CONNECT_PEND state, see
+     Curl_multi_process_pending_handles() */
+  struct SessionHandle *pend_next;
+  struct SessionHandle *pend_prev;
+  struct Curl_pendq *pendq;  /* the queue this waits in or was woken from */
+  bool pend_woken;           /* TRUE from being woken until it has tried to
+                                connect again */
+
+  /* TRUE for a handle that curl_multi_prewarm() made to open a connection,
+     the multi handle closes it itself once it is done */
+  bool prewarm;
+  struct SessionHandle *prewarm_next; /* see Curl_multi.prewarm_done */
+
   struct connectdata *easy_conn;     /* the "unit's" connection */
 
   CURLMstate mstate;  /* the handle's state */
+  curl_off_t mstate_entered; /* when the handle entered 'mstate', see the
+                                statistics in struct Curl_multi */
   CURLcode result;   /* previous result */
 
   struct Curl_message msg; /* A single posted message. */
 
+  /* the element in the send or receive pipeline of the connection this
+     handle uses, it is in at most one of them at a time */
+  struct curl_llist_element pipe_node;
+
   /* Array with the plain socket numbers this handle takes care of, in no
      particular order. Note that all sockets are added to the sockhash, where
      the state etc are also kept. This array is mostly used to detect when a
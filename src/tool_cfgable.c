@@ -73,6 +73,7 @@ static void free_config_fields(struct OperationConfig *config)
   Curl_safefree(config->dns_ipv4_addr);
   Curl_safefree(config->dns_interface);
   Curl_safefree(config->dns_servers);
+  Curl_safefree(config->dns_cache_file);
 
   Curl_safefree(config->noproxy);
 
@@ -72,6 +72,7 @@ struct OperationConfig {
   char *dns_interface; /* interface name */
   char *dns_ipv4_addr; /* dot notation */
   char *dns_ipv6_addr; /* dot notation */
+  char *dns_cache_file; /* resolved names to load and save */
   char *userpwd;
   char *login_options;
   char *tls_username;
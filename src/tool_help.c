@@ -71,6 +71,7 @@ static const char *const helptext[] = {
   "     --digest        Use HTTP Digest Authentication (H)",
   "     --disable-eprt  Inhibit using EPRT or LPRT (F)",
   "     --disable-epsv  Inhibit using EPSV (F)",
+  "     --dns-cache-file FILE  Load and save resolved names in FILE",
   "     --dns-servers   DNS server addrs to use: 1.1.1.1;2.2.2.2",
   "     --dns-interface  Interface to use for DNS requests",
   "     --dns-ipv4-addr  IPv4 address to use for DNS requests, dot notation",
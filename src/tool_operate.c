@@ -1336,6 +1336,10 @@ static CURLcode operate_do(struct GlobalConfig *global,
           my_setopt_str(curl, CURLOPT_UNIX_SOCKET_PATH,
                         config->unix_socket_path);
 
+        /* new in 7.41.0 */
+        if(config->dns_cache_file)
+          my_setopt_str(curl, CURLOPT_DNS_CACHE_FILE, config->dns_cache_file);
+
         /* initialize retry vars for loop below */
         retry_sleep_default = (config->retry_delay) ?
           config->retry_delay*1000L : RETRY_SLEEP_DEFAULT; /* ms */
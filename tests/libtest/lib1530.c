@@ -0,0 +1,95 @@
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 1998 - 2015, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at http://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include "test.h"
+
+#include "testutil.h"
+#include "warnless.h"
+#include "memdebug.h"
+
+/* a wait this long must not happen when the multi handle was woken up */
+#define WAIT_LONG 10000
+#define WAIT_SHORT 200
+
+int test(char *URL)
+{
+  int res = 0;
+  CURLM *m = NULL;
+  CURLMcode mc;
+  struct timeval before;
+  long elapsed;
+  int numfds = -1;
+
+  (void)URL;
+
+  global_init(CURL_GLOBAL_ALL);
+
+  multi_init(m);
+
+  /* two wakeups before the wait are merged into one */
+  mc = curl_multi_wakeup(m);
+  if(mc == CURLM_WAKEUP_FAILURE)
+    /* this build has no wakeup support */
+    goto test_cleanup;
+  if(mc != CURLM_OK) {
+    fprintf(stderr, "curl_multi_wakeup() returned %d\n", (int)mc);
+    res = TEST_ERR_MAJOR_BAD;
+    goto test_cleanup;
+  }
+  curl_multi_wakeup(m);
+
+  before = tutil_tvnow();
+  mc = curl_multi_wait(m, NULL, 0, WAIT_LONG, &numfds);
+  elapsed = tutil_tvdiff(tutil_tvnow(), before);
+  if(mc != CURLM_OK) {
+    fprintf(stderr, "curl_multi_wait() returned %d\n", (int)mc);
+    res = TEST_ERR_MAJOR_BAD;
+    goto test_cleanup;
+  }
+  if(elapsed >= WAIT_LONG / 2) {
+    fprintf(stderr, "curl_multi_wait() was not woken up\n");
+    res = TEST_ERR_MAJOR_BAD;
+    goto test_cleanup;
+  }
+  if(numfds != 0) {
+    fprintf(stderr, "a wakeup was counted as %d events\n", numfds);
+    res = TEST_ERR_MAJOR_BAD;
+    goto test_cleanup;
+  }
+
+  /* the wakeups were consumed, so this wait runs until its timeout */
+  before = tutil_tvnow();
+  curl_multi_wait(m, NULL, 0, WAIT_SHORT, &numfds);
+  elapsed = tutil_tvdiff(tutil_tvnow(), before);
+  if(elapsed < WAIT_SHORT / 2) {
+    fprintf(stderr, "curl_multi_wait() returned after %ld ms\n", elapsed);
+    res = TEST_ERR_MAJOR_BAD;
+  }
+
+test_cleanup:
+
+  curl_multi_cleanup(m);
+  curl_global_cleanup();
+
+  printf("We are done\n");
+
+  return res;
+}
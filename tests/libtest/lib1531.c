@@ -0,0 +1,127 @@
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 1998 - 2015, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at http://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include "test.h"
+
+#include "testutil.h"
+#include "warnless.h"
+#include "memdebug.h"
+
+#define TEST_HANG_TIMEOUT 60 * 1000
+
+/* more handles than the connection limit allows to run at once, so that
+   most of them have to wait for a connection */
+#define NUM_HANDLES 5
+
+static size_t discard(char *ptr, size_t size, size_t nmemb, void *userp)
+{
+  (void)ptr;
+  (void)userp;
+  return size * nmemb;
+}
+
+/* run NUM_HANDLES transfers with the given connection limits and return how
+   many of them succeeded, or a negative value on failure */
+static int run(char *URL, long max_host, long max_total)
+{
+  CURL *curls[NUM_HANDLES];
+  CURLM *multi = NULL;
+  int still_running;
+  int res = 0;
+  int done = 0;
+  int i;
+  CURLMsg *msg;
+
+  for(i = 0; i < NUM_HANDLES; i++)
+    curls[i] = NULL;
+
+  multi_init(multi);
+
+  multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS, max_host);
+  multi_setopt(multi, CURLMOPT_MAX_TOTAL_CONNECTIONS, max_total);
+
+  for(i = 0; i < NUM_HANDLES; i++) {
+    easy_init(curls[i]);
+    easy_setopt(curls[i], CURLOPT_URL, URL);
+    easy_setopt(curls[i], CURLOPT_WRITEFUNCTION, discard);
+    multi_add_handle(multi, curls[i]);
+  }
+
+  multi_perform(multi, &still_running);
+
+  abort_on_test_timeout();
+
+  while(still_running) {
+    int num;
+    res = curl_multi_wait(multi, NULL, 0, TEST_HANG_TIMEOUT, &num);
+    if(res != CURLM_OK) {
+      printf("curl_multi_wait() returned %d\n", res);
+      res = TEST_ERR_MAJOR_BAD;
+      goto test_cleanup;
+    }
+
+    abort_on_test_timeout();
+
+    multi_perform(multi, &still_running);
+
+    abort_on_test_timeout();
+  }
+
+  while((msg = curl_multi_info_read(multi, &still_running)) != NULL) {
+    if((msg->msg == CURLMSG_DONE) && (msg->data.result == CURLE_OK))
+      done++;
+  }
+
+test_cleanup:
+
+  for(i = 0; i < NUM_HANDLES; i++) {
+    curl_multi_remove_handle(multi, curls[i]);
+    curl_easy_cleanup(curls[i]);
+  }
+  curl_multi_cleanup(multi);
+
+  return res ? -res : done;
+}
+
+int test(char *URL)
+{
+  int res = 0;
+  int done;
+
+  start_test_timing();
+
+  global_init(CURL_GLOBAL_ALL);
+
+  /* first hit the limit per host, then the total limit */
+  done = run(URL, 1L, 0L);
+  if(done >= 0) {
+    printf("host limit: %d of %d done\n", done, NUM_HANDLES);
+    done = run(URL, 0L, 1L);
+  }
+  if(done >= 0)
+    printf("total limit: %d of %d done\n", done, NUM_HANDLES);
+  else
+    res = -done;
+
+  curl_global_cleanup();
+
+  return res;
+}
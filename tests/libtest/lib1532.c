@@ -0,0 +1,160 @@
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 1998 - 2015, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at http://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include "test.h"
+
+#include "testutil.h"
+#include "warnless.h"
+#include "memdebug.h"
+
+#define TEST_HANG_TIMEOUT 60 * 1000
+
+#define NUM_HANDLES 4
+
+static CURL *curls[NUM_HANDLES];
+static int completed;
+
+static size_t discard(char *ptr, size_t size, size_t nmemb, void *userp)
+{
+  (void)ptr;
+  (void)userp;
+  return size * nmemb;
+}
+
+/* the completion callback takes the handle out and cleans it up at once */
+static void completion_cb(CURLM *multi, CURLMsg *msg, void *userp)
+{
+  int *count = userp;
+  int i;
+
+  if((msg->msg == CURLMSG_DONE) && (msg->data.result == CURLE_OK))
+    (*count)++;
+
+  for(i = 0; i < NUM_HANDLES; i++) {
+    if(curls[i] == msg->easy_handle) {
+      curl_multi_remove_handle(multi, curls[i]);
+      curl_easy_cleanup(curls[i]);
+      curls[i] = NULL;
+    }
+  }
+}
+
+/* drive all transfers to completion */
+static int run(CURLM *multi)
+{
+  int still_running;
+  int res = 0;
+
+  multi_perform(multi, &still_running);
+
+  abort_on_test_timeout();
+
+  while(still_running) {
+    int num;
+    res = curl_multi_wait(multi, NULL, 0, TEST_HANG_TIMEOUT, &num);
+    if(res != CURLM_OK) {
+      printf("curl_multi_wait() returned %d\n", res);
+      res = TEST_ERR_MAJOR_BAD;
+      goto test_cleanup;
+    }
+
+    abort_on_test_timeout();
+
+    multi_perform(multi, &still_running);
+
+    abort_on_test_timeout();
+  }
+
+test_cleanup:
+
+  return res;
+}
+
+int test(char *URL)
+{
+  CURLM *multi = NULL;
+  CURLMsg msgs[NUM_HANDLES];
+  int res = 0;
+  int left;
+  int got;
+  int i;
+
+  for(i = 0; i < NUM_HANDLES; i++)
+    curls[i] = NULL;
+
+  start_test_timing();
+
+  global_init(CURL_GLOBAL_ALL);
+
+  multi_init(multi);
+
+  /* first read the messages in batches */
+  for(i = 0; i < NUM_HANDLES; i++) {
+    easy_init(curls[i]);
+    easy_setopt(curls[i], CURLOPT_URL, URL);
+    easy_setopt(curls[i], CURLOPT_WRITEFUNCTION, discard);
+    multi_add_handle(multi, curls[i]);
+  }
+
+  res = run(multi);
+  if(res)
+    goto test_cleanup;
+
+  got = curl_multi_info_read_batch(multi, msgs, NUM_HANDLES - 1, &left);
+  printf("first batch: %d, %d left\n", got, left);
+  got = curl_multi_info_read_batch(multi, msgs, NUM_HANDLES - 1, &left);
+  printf("second batch: %d, %d left\n", got, left);
+
+  for(i = 0; i < NUM_HANDLES; i++) {
+    curl_multi_remove_handle(multi, curls[i]);
+    curl_easy_cleanup(curls[i]);
+    curls[i] = NULL;
+  }
+
+  /* then get them passed to a callback instead */
+  multi_setopt(multi, CURLMOPT_COMPLETIONFUNCTION, completion_cb);
+  multi_setopt(multi, CURLMOPT_COMPLETIONDATA, &completed);
+
+  for(i = 0; i < NUM_HANDLES; i++) {
+    easy_init(curls[i]);
+    easy_setopt(curls[i], CURLOPT_URL, URL);
+    easy_setopt(curls[i], CURLOPT_WRITEFUNCTION, discard);
+    multi_add_handle(multi, curls[i]);
+  }
+
+  res = run(multi);
+  if(res)
+    goto test_cleanup;
+
+  printf("callback: %d done, %d queued\n", completed,
+         curl_multi_info_read_batch(multi, msgs, NUM_HANDLES, &left));
+
+test_cleanup:
+
+  for(i = 0; i < NUM_HANDLES; i++) {
+    curl_multi_remove_handle(multi, curls[i]);
+    curl_easy_cleanup(curls[i]);
+  }
+  curl_multi_cleanup(multi);
+  curl_global_cleanup();
+
+  return res;
+}
@@ -0,0 +1,158 @@
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 1998 - 2015, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at http://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include "test.h"
+
+#include "testutil.h"
+#include "warnless.h"
+#include "memdebug.h"
+
+#define TEST_HANG_TIMEOUT 60 * 1000
+
+#define NUM_HANDLES 3
+
+static size_t discard(char *ptr, size_t size, size_t nmemb, void *userp)
+{
+  (void)ptr;
+  (void)userp;
+  return size * nmemb;
+}
+
+/* print the number of handles in each state that has any */
+static int show_states(CURLM *multi, const char *when)
+{
+  long counts[CURLMSTATE_LAST];
+  int res = 0;
+  int i;
+
+  res = (int)curl_multi_getinfo(multi, CURLMINFO_STATE_COUNTS, counts);
+  if(res)
+    return res;
+
+  printf("%s:", when);
+  for(i = 0; i < CURLMSTATE_LAST; i++) {
+    if(counts[i])
+      printf(" %d=%ld", i, counts[i]);
+  }
+  printf("\n");
+  return 0;
+}
+
+int test(char *URL)
+{
+  CURL *curls[NUM_HANDLES];
+  CURLM *multi = NULL;
+  double times[CURLMSTATE_LAST];
+  double total = 0.0;
+  long value;
+  int still_running;
+  int res = 0;
+  int i;
+
+  for(i = 0; i < NUM_HANDLES; i++)
+    curls[i] = NULL;
+
+  start_test_timing();
+
+  global_init(CURL_GLOBAL_ALL);
+
+  multi_init(multi);
+
+  /* one connection only, so that they all use the same */
+  multi_setopt(multi, CURLMOPT_MAX_TOTAL_CONNECTIONS, 1L);
+
+  for(i = 0; i < NUM_HANDLES; i++) {
+    easy_init(curls[i]);
+    easy_setopt(curls[i], CURLOPT_URL, URL);
+    easy_setopt(curls[i], CURLOPT_WRITEFUNCTION, discard);
+    multi_add_handle(multi, curls[i]);
+  }
+
+  res = show_states(multi, "added");
+  if(res)
+    goto test_cleanup;
+
+  multi_perform(multi, &still_running);
+
+  abort_on_test_timeout();
+
+  while(still_running) {
+    int num;
+    res = curl_multi_wait(multi, NULL, 0, TEST_HANG_TIMEOUT, &num);
+    if(res != CURLM_OK) {
+      printf("curl_multi_wait() returned %d\n", res);
+      res = TEST_ERR_MAJOR_BAD;
+      goto test_cleanup;
+    }
+
+    abort_on_test_timeout();
+
+    multi_perform(multi, &still_running);
+
+    abort_on_test_timeout();
+  }
+
+  res = show_states(multi, "done");
+  if(res)
+    goto test_cleanup;
+
+  curl_multi_getinfo(multi, CURLMINFO_NUM_EASY, &value);
+  printf("easy: %ld\n", value);
+  curl_multi_getinfo(multi, CURLMINFO_RUNNING, &value);
+  printf("running: %ld\n", value);
+  curl_multi_getinfo(multi, CURLMINFO_PENDING, &value);
+  printf("pending: %ld\n", value);
+  curl_multi_getinfo(multi, CURLMINFO_CONNCACHE_SIZE, &value);
+  printf("connections: %ld\n", value);
+
+  res = (int)curl_multi_getinfo(multi, CURLMINFO_STATE_TIMES, times);
+  if(res)
+    goto test_cleanup;
+  for(i = 0; i < CURLMSTATE_LAST; i++) {
+    if(times[i] < 0.0) {
+      printf("negative time in state %d\n", i);
+      res = TEST_ERR_FAILURE;
+    }
+    total += times[i];
+  }
+  printf("time spent: %s\n", (total > 0.0) ? "yes" : "no");
+
+  printf("unknown: %d\n",
+         (int)curl_multi_getinfo(multi, CURLMINFO_NONE, &value));
+
+test_cleanup:
+
+  for(i = 0; i < NUM_HANDLES; i++) {
+    curl_multi_remove_handle(multi, curls[i]);
+    curl_easy_cleanup(curls[i]);
+  }
+
+  if(!res) {
+    curl_multi_getinfo(multi, CURLMINFO_NUM_EASY, &value);
+    printf("easy after removal: %ld\n", value);
+    res = show_states(multi, "removed");
+  }
+
+  curl_multi_cleanup(multi);
+  curl_global_cleanup();
+
+  return res;
+}
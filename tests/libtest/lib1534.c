@@ -0,0 +1,89 @@
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 1998 - 2015, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at http://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include "test.h"
+
+#include "memdebug.h"
+
+#define NUM_HANDLES 3
+
+static size_t discard(char *ptr, size_t size, size_t nmemb, void *userp)
+{
+  (void)ptr;
+  (void)userp;
+  return size * nmemb;
+}
+
+/*
+ * Easy handles that each do their own curl_easy_perform() re-use the
+ * connection left in the connection cache of the share object they use,
+ * also after the handle that made it is gone.
+ */
+int test(char *URL)
+{
+  CURL *curl = NULL;
+  CURLSH *share = NULL;
+  int res = 0;
+  int i;
+
+  global_init(CURL_GLOBAL_ALL);
+
+  share = curl_share_init();
+  if(!share) {
+    fprintf(stderr, "curl_share_init() failed\n");
+    res = TEST_ERR_MAJOR_BAD;
+    goto test_cleanup;
+  }
+  res = (int)curl_share_setopt(share, CURLSHOPT_SHARE,
+                               CURL_LOCK_DATA_CONNECT);
+  if(res) {
+    fprintf(stderr, "curl_share_setopt() failed, with code %d\n", res);
+    goto test_cleanup;
+  }
+
+  for(i = 0; i < NUM_HANDLES; i++) {
+    long connects = -1;
+
+    easy_init(curl);
+    easy_setopt(curl, CURLOPT_URL, URL);
+    easy_setopt(curl, CURLOPT_WRITEFUNCTION, discard);
+    easy_setopt(curl, CURLOPT_SHARE, share);
+
+    res = (int)curl_easy_perform(curl);
+    if(res)
+      goto test_cleanup;
+
+    curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &connects);
+    printf("handle %d connects: %ld\n", i, connects);
+
+    curl_easy_cleanup(curl);
+    curl = NULL;
+  }
+
+test_cleanup:
+
+  curl_easy_cleanup(curl);
+  if(share)
+    curl_share_cleanup(share);
+  curl_global_cleanup();
+
+  return res;
+}
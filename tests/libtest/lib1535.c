@@ -0,0 +1,130 @@
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 1998 - 2015, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at http://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include "test.h"
+
+#include "testutil.h"
+#include "warnless.h"
+#include "memdebug.h"
+
+#define TEST_HANG_TIMEOUT 60 * 1000
+
+#define NUM_PREWARM 2
+
+static size_t discard(char *ptr, size_t size, size_t nmemb, void *userp)
+{
+  (void)ptr;
+  (void)userp;
+  return size * nmemb;
+}
+
+/* drive the multi handle until nothing is running */
+static int run(CURLM *multi)
+{
+  int still_running;
+  int res = 0;
+
+  multi_perform(multi, &still_running);
+
+  abort_on_test_timeout();
+
+  while(still_running) {
+    int num;
+    res = curl_multi_wait(multi, NULL, 0, TEST_HANG_TIMEOUT, &num);
+    if(res != CURLM_OK) {
+      printf("curl_multi_wait() returned %d\n", res);
+      res = TEST_ERR_MAJOR_BAD;
+      goto test_cleanup;
+    }
+
+    abort_on_test_timeout();
+
+    multi_perform(multi, &still_running);
+
+    abort_on_test_timeout();
+  }
+
+test_cleanup:
+
+  return res;
+}
+
+/*
+ * Prewarmed connections are left in the connection cache without any
+ * message or easy handle left behind, and the transfer added afterwards
+ * doesn't have to connect.
+ */
+int test(char *URL)
+{
+  CURL *curl = NULL;
+  CURLM *multi = NULL;
+  long value;
+  int msgs;
+  int left;
+  int res = 0;
+
+  start_test_timing();
+
+  global_init(CURL_GLOBAL_ALL);
+
+  multi_init(multi);
+
+  easy_init(curl);
+  easy_setopt(curl, CURLOPT_URL, URL);
+  easy_setopt(curl, CURLOPT_WRITEFUNCTION, discard);
+
+  res = (int)curl_multi_prewarm(multi, curl, NUM_PREWARM);
+  if(res) {
+    fprintf(stderr, "curl_multi_prewarm() failed, with code %d\n", res);
+    goto test_cleanup;
+  }
+
+  res = run(multi);
+  if(res)
+    goto test_cleanup;
+
+  msgs = 0;
+  while(curl_multi_info_read(multi, &left))
+    msgs++;
+  printf("messages: %d\n", msgs);
+  curl_multi_getinfo(multi, CURLMINFO_NUM_EASY, &value);
+  printf("easy: %ld\n", value);
+  curl_multi_getinfo(multi, CURLMINFO_CONNCACHE_SIZE, &value);
+  printf("connections: %ld\n", value);
+
+  multi_add_handle(multi, curl);
+
+  res = run(multi);
+  if(res)
+    goto test_cleanup;
+
+  curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &value);
+  printf("connects: %ld\n", value);
+
+test_cleanup:
+
+  curl_multi_remove_handle(multi, curl);
+  curl_easy_cleanup(curl);
+  curl_multi_cleanup(multi);
+  curl_global_cleanup();
+
+  return res;
+}
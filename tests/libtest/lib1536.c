@@ -0,0 +1,127 @@
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 1998 - 2015, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at http://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include "test.h"
+
+#include "testutil.h"
+#include "warnless.h"
+#include "memdebug.h"
+
+#define TEST_HANG_TIMEOUT 60 * 1000
+
+static size_t discard(char *ptr, size_t size, size_t nmemb, void *userp)
+{
+  (void)ptr;
+  (void)userp;
+  return size * nmemb;
+}
+
+/* do one transfer with the multi handle */
+static int run(CURLM *multi, CURL *curl)
+{
+  int still_running;
+  int res = 0;
+
+  multi_add_handle(multi, curl);
+
+  multi_perform(multi, &still_running);
+
+  abort_on_test_timeout();
+
+  while(still_running) {
+    int num;
+    res = curl_multi_wait(multi, NULL, 0, TEST_HANG_TIMEOUT, &num);
+    if(res != CURLM_OK) {
+      printf("curl_multi_wait() returned %d\n", res);
+      res = TEST_ERR_MAJOR_BAD;
+      goto test_cleanup;
+    }
+
+    abort_on_test_timeout();
+
+    multi_perform(multi, &still_running);
+
+    abort_on_test_timeout();
+  }
+
+test_cleanup:
+
+  curl_multi_remove_handle(multi, curl);
+  return res;
+}
+
+/*
+ * A connection idle for longer than CURLOPT_MAXAGE_CONN is closed instead of
+ * re-used and counted as such.
+ */
+int test(char *URL)
+{
+  CURL *curl = NULL;
+  CURLM *multi = NULL;
+  long evictions[CURLEVICT_LAST];
+  long connects;
+  int res = 0;
+
+  start_test_timing();
+
+  global_init(CURL_GLOBAL_ALL);
+
+  multi_init(multi);
+
+  easy_init(curl);
+  easy_setopt(curl, CURLOPT_URL, URL);
+  easy_setopt(curl, CURLOPT_WRITEFUNCTION, discard);
+  easy_setopt(curl, CURLOPT_MAXAGE_CONN, 1L);
+
+  res = run(multi, curl);
+  if(res)
+    goto test_cleanup;
+  curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &connects);
+  printf("first connects: %ld\n", connects);
+
+  /* idle for too long */
+  wait_ms(2100);
+
+  res = run(multi, curl);
+  if(res)
+    goto test_cleanup;
+  curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &connects);
+  printf("second connects: %ld\n", connects);
+
+  res = run(multi, curl);
+  if(res)
+    goto test_cleanup;
+  curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &connects);
+  printf("third connects: %ld\n", connects);
+
+  curl_multi_getinfo(multi, CURLMINFO_EVICTIONS, evictions);
+  printf("evicted: dead %ld maxage %ld maxlifetime %ld maxconnects %ld\n",
+         evictions[CURLEVICT_DEAD], evictions[CURLEVICT_MAXAGE],
+         evictions[CURLEVICT_MAXLIFETIME], evictions[CURLEVICT_MAXCONNECTS]);
+
+test_cleanup:
+
+  curl_easy_cleanup(curl);
+  curl_multi_cleanup(multi);
+  curl_global_cleanup();
+
+  return res;
+}
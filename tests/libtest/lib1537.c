@@ -0,0 +1,125 @@
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 1998 - 2015, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at http://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include "test.h"
+
+#include "testutil.h"
+#include "warnless.h"
+#include "memdebug.h"
+
+#define TEST_HANG_TIMEOUT 60 * 1000
+
+#define NUM_HANDLES 4
+
+static size_t discard(char *ptr, size_t size, size_t nmemb, void *userp)
+{
+  (void)ptr;
+  (void)userp;
+  return size * nmemb;
+}
+
+/*
+ * Several transfers resolving names at once with a single resolver thread
+ * all complete, and a transfer removed while its resolve is still waiting
+ * for the thread doesn't disturb the others.
+ */
+int test(char *URL)
+{
+  CURL *curl[NUM_HANDLES];
+  CURL *gone = NULL;
+  CURLM *multi = NULL;
+  CURLMsg *msg;
+  int still_running;
+  int completed = 0;
+  int failed = 0;
+  int left;
+  int i;
+  int res = 0;
+
+  for(i = 0; i < NUM_HANDLES; i++)
+    curl[i] = NULL;
+
+  start_test_timing();
+
+  global_init(CURL_GLOBAL_ALL);
+
+  multi_init(multi);
+
+  multi_setopt(multi, CURLMOPT_MAX_RESOLVER_THREADS, 1L);
+
+  for(i = 0; i < NUM_HANDLES; i++) {
+    easy_init(curl[i]);
+    easy_setopt(curl[i], CURLOPT_URL, URL);
+    easy_setopt(curl[i], CURLOPT_IPRESOLVE, (long)CURL_IPRESOLVE_V4);
+    easy_setopt(curl[i], CURLOPT_WRITEFUNCTION, discard);
+    multi_add_handle(multi, curl[i]);
+  }
+
+  /* this one is not meant to get anywhere */
+  easy_init(gone);
+  easy_setopt(gone, CURLOPT_URL, "http://localhost:1/1537");
+  easy_setopt(gone, CURLOPT_IPRESOLVE, (long)CURL_IPRESOLVE_V4);
+  multi_add_handle(multi, gone);
+
+  multi_perform(multi, &still_running);
+
+  abort_on_test_timeout();
+
+  curl_multi_remove_handle(multi, gone);
+
+  do {
+    int num;
+    res = curl_multi_wait(multi, NULL, 0, TEST_HANG_TIMEOUT, &num);
+    if(res != CURLM_OK) {
+      printf("curl_multi_wait() returned %d\n", res);
+      res = TEST_ERR_MAJOR_BAD;
+      goto test_cleanup;
+    }
+
+    abort_on_test_timeout();
+
+    multi_perform(multi, &still_running);
+
+    abort_on_test_timeout();
+
+    while((msg = curl_multi_info_read(multi, &left))) {
+      if(msg->msg != CURLMSG_DONE)
+        continue;
+      completed++;
+      if(msg->data.result)
+        failed++;
+    }
+  } while(still_running);
+
+  printf("completed: %d failed: %d\n", completed, failed);
+
+test_cleanup:
+
+  for(i = 0; i < NUM_HANDLES; i++) {
+    curl_multi_remove_handle(multi, curl[i]);
+    curl_easy_cleanup(curl[i]);
+  }
+  curl_easy_cleanup(gone);
+  curl_multi_cleanup(multi);
+  curl_global_cleanup();
+
+  return res;
+}
@@ -0,0 +1,105 @@
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 1998 - 2015, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at http://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include "test.h"
+
+#include "memdebug.h"
+
+static int cached;
+
+static int debug_cb(CURL *handle, curl_infotype type, char *data,
+                    size_t size, void *userp)
+{
+  const char *text = "as not resolving";
+  size_t len = strlen(text);
+  size_t i;
+
+  (void)handle;
+  (void)userp;
+
+  if(type != CURLINFO_TEXT)
+    return 0;
+
+  for(i = 0; i + len <= size; i++) {
+    if(!memcmp(data + i, text, len)) {
+      cached = 1;
+      break;
+    }
+  }
+  return 0;
+}
+
+static size_t discard(char *ptr, size_t size, size_t nmemb, void *userp)
+{
+  (void)ptr;
+  (void)userp;
+  return size * nmemb;
+}
+
+/*
+ * A name that fails to resolve is remembered, so the second attempt fails
+ * without asking the resolver. Adding the name with CURLOPT_RESOLVE then
+ * replaces the cached failure.
+ */
+int test(char *URL)
+{
+  CURL *curl = NULL;
+  struct curl_slist *resolve = NULL;
+  char entry[256];
+  CURLcode code;
+  int res = 0;
+
+  snprintf(entry, sizeof(entry), "non-existing-host.haxx.se:%s:%s",
+           libtest_arg2, libtest_arg3);
+
+  global_init(CURL_GLOBAL_ALL);
+
+  easy_init(curl);
+  easy_setopt(curl, CURLOPT_URL, URL);
+  easy_setopt(curl, CURLOPT_WRITEFUNCTION, discard);
+  easy_setopt(curl, CURLOPT_DEBUGFUNCTION, debug_cb);
+  easy_setopt(curl, CURLOPT_VERBOSE, 1L);
+  easy_setopt(curl, CURLOPT_DNS_NEGATIVE_CACHE_TIMEOUT, 60L);
+
+  code = curl_easy_perform(curl);
+  printf("first: %d cached: %d\n", (int)code, cached);
+
+  code = curl_easy_perform(curl);
+  printf("second: %d cached: %d\n", (int)code, cached);
+
+  resolve = curl_slist_append(NULL, entry);
+  if(!resolve) {
+    res = TEST_ERR_MAJOR_BAD;
+    goto test_cleanup;
+  }
+  easy_setopt(curl, CURLOPT_RESOLVE, resolve);
+
+  code = curl_easy_perform(curl);
+  printf("third: %d\n", (int)code);
+
+test_cleanup:
+
+  curl_easy_cleanup(curl);
+  curl_slist_free_all(resolve);
+  curl_global_cleanup();
+
+  return res;
+}
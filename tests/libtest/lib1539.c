@@ -0,0 +1,105 @@
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 1998 - 2015, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at http://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include "test.h"
+
+#include "memdebug.h"
+
+static int cached;
+static int refreshed;
+
+static int contains(const char *data, size_t size, const char *text)
+{
+  size_t len = strlen(text);
+  size_t i;
+
+  for(i = 0; i + len <= size; i++) {
+    if(!memcmp(data + i, text, len))
+      return 1;
+  }
+  return 0;
+}
+
+static int debug_cb(CURL *handle, curl_infotype type, char *data,
+                    size_t size, void *userp)
+{
+  (void)handle;
+  (void)userp;
+
+  if(type == CURLINFO_TEXT) {
+    if(contains(data, size, "found in DNS cache"))
+      cached = 1;
+    if(contains(data, size, "again in the background"))
+      refreshed = 1;
+  }
+  return 0;
+}
+
+static size_t discard(char *ptr, size_t size, size_t nmemb, void *userp)
+{
+  (void)ptr;
+  (void)userp;
+  return size * nmemb;
+}
+
+/*
+ * An expired name is still used with CURLOPT_DNS_SERVE_STALE while it is
+ * resolved again in the background, and only one background resolve is
+ * started for it.
+ */
+int test(char *URL)
+{
+  CURL *curl = NULL;
+  CURLcode code;
+  int res = 0;
+  int i;
+
+  global_init(CURL_GLOBAL_ALL);
+
+  easy_init(curl);
+  easy_setopt(curl, CURLOPT_URL, URL);
+  easy_setopt(curl, CURLOPT_IPRESOLVE, (long)CURL_IPRESOLVE_V4);
+  /* a re-used connection needs no name */
+  easy_setopt(curl, CURLOPT_FORBID_REUSE, 1L);
+  easy_setopt(curl, CURLOPT_WRITEFUNCTION, discard);
+  easy_setopt(curl, CURLOPT_DEBUGFUNCTION, debug_cb);
+  easy_setopt(curl, CURLOPT_VERBOSE, 1L);
+  easy_setopt(curl, CURLOPT_DNS_CACHE_TIMEOUT, 1L);
+  easy_setopt(curl, CURLOPT_DNS_SERVE_STALE, 60L);
+
+  for(i = 0; i < 3; i++) {
+    if(i == 1)
+      /* let the cached name expire */
+      wait_ms(2100);
+
+    cached = refreshed = 0;
+    code = curl_easy_perform(curl);
+    printf("%d: result %d cached %d refreshed %d\n", i, (int)code, cached,
+           refreshed);
+  }
+
+test_cleanup:
+
+  curl_easy_cleanup(curl);
+  curl_global_cleanup();
+
+  return res;
+}
@@ -32,6 +32,8 @@ my $callocs=0;
 my $reallocs=0;
 my $strdups=0;
 my $wcsdups=0;
+my $arenaallocs=0;
+my $arenaresets=0;
 my $showlimit;
 
 while(1) {
@@ -348,6 +350,22 @@ while(<FILE>) {
         }
 
     }
+    # ARENA arena.c:112 alloc(32) = 0x5ddd
+    elsif($_ =~ /^ARENA ([^ ]*):(\d*) (.*)/) {
+        # the chunks these are made from are logged as mallocs, so there is
+        # nothing to track here, only count them
+        $function = $3;
+
+        if($function =~ /alloc\((\d*)\) = 0x([0-9a-f]*)/) {
+            $arenaallocs++;
+        }
+        elsif($function =~ /reset\((\d*)\)/) {
+            $arenaresets++;
+        }
+        else {
+            print "Not recognized input line: $function\n";
+        }
+    }
     else {
         print "Not recognized prefix line: $line\n";
     }
@@ -402,5 +420,8 @@ if($verbose) {
     "Frees: $frees\n",
     "Allocations: ".($mallocs + $callocs + $reallocs + $strdups + $wcsdups)."\n";
 
+    print "Arena allocations: $arenaallocs\n",
+    "Arena resets: $arenaresets\n";
+
     print "Maximum allocated: $maxmem\n";
 }
@@ -224,6 +224,7 @@ my $has_http2;      # set if libcurl is built with HTTP2 support
 my $has_crypto;     # set if libcurl is built with cryptographic support
 my $has_cares;      # set if built with c-ares
 my $has_threadedres;# set if built with threaded resolver
+my $has_asynchdns;  # set if built with an asynchronous resolver
 
 # this version is decided by the particular nghttp2 library that is being used
 my $h2cver = "h2c-14";
@@ -2463,6 +2464,8 @@ sub checksystem {
                 $has_metalink=1;
             }
             if($feat =~ /AsynchDNS/i) {
+                # c-ares or the threaded resolver
+                $has_asynchdns=1;
                 if(!$has_cares) {
                     # this means threaded resolver
                     $has_threadedres=1;
@@ -2969,6 +2972,11 @@ sub singletest {
                     next;
                 }
             }
+            elsif($1 eq "AsynchDNS") {
+                if($has_asynchdns) {
+                    next;
+                }
+            }
             elsif($1 eq "socks") {
                 next;
             }
@@ -3105,6 +3113,11 @@ sub singletest {
                         next;
                     }
                 }
+                elsif($1 eq "AsynchDNS") {
+                    if(!$has_asynchdns) {
+                        next;
+                    }
+                }
                 else {
                     next;
                 }
@@ -287,6 +287,48 @@ UNITTEST_START
   fail_unless(llist_destination->tail == llist_destination->tail,
             "llist_destination tail doesn't equal llist_destination head");
 
+  /**
+   * testing lists with embedded elements
+   * case 1:
+   * the elements given to Curl_llist_insert_node() are linked in as they are
+   * and removing them does not free them
+   */
+  {
+    struct curl_llist *embedded =
+      Curl_llist_alloc_embedded(test_curl_llist_dtor);
+    struct curl_llist_element nodes[3];
+
+    abort_unless(embedded, "Curl_llist_alloc_embedded failed");
+    fail_unless(embedded->embedded, "list not marked as embedded");
+
+    Curl_llist_insert_node(embedded, embedded->tail, &unusedData_case1,
+                           &nodes[0]);
+    Curl_llist_insert_node(embedded, embedded->tail, &unusedData_case3,
+                           &nodes[2]);
+    Curl_llist_insert_node(embedded, &nodes[0], &unusedData_case2,
+                           &nodes[1]);
+    fail_unless(Curl_llist_count(embedded) == 3,
+                "embedded list has the wrong size");
+    fail_unless(embedded->head == &nodes[0] && nodes[0].next == &nodes[1] &&
+                nodes[1].next == &nodes[2] && embedded->tail == &nodes[2],
+                "embedded elements linked in the wrong order");
+    fail_unless(nodes[1].ptr == &unusedData_case2,
+                "embedded element points to the wrong data");
+
+    Curl_llist_remove(embedded, &nodes[1], NULL);
+    fail_unless(nodes[0].next == &nodes[2] && nodes[2].prev == &nodes[0],
+                "removing an embedded element broke the links");
+    fail_unless(nodes[1].ptr == NULL, "removed element still has data");
+
+    /* an element can be inserted again once it is out of the list */
+    Curl_llist_insert_node(embedded, NULL, &unusedData_case2, &nodes[1]);
+    fail_unless(embedded->head == &nodes[1],
+                "inserting with NULL did not make the element the head");
+
+    /* destroying the list leaves the elements to their owner */
+    Curl_llist_destroy(embedded, NULL);
+  }
+
 
 
 UNITTEST_STOP
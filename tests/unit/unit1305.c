@@ -5,7 +5,7 @@
  *                            | (__| |_| |  _ <| |___
  *                             \___|\___/|_| \_\_____|
  *
- * Copyright (C) 1998 - 2011, Daniel Stenberg, <daniel@haxx.se>, et al.
+ * Copyright (C) 1998 - 2015, Daniel Stenberg, <daniel@haxx.se>, et al.
  *
  * This software is licensed as described in the file COPYING, which
  * you should have received as part of this distribution. The terms
@@ -34,13 +34,16 @@
 #define ENABLE_CURLX_PRINTF
 #include "curlx.h"
 
+#include "urldata.h"
 #include "hash.h"
 #include "hostip.h"
 
 #include "memdebug.h" /* LAST include file */
 
 static struct SessionHandle *data;
-static struct curl_hash *hp;
+static struct Curl_dnscache *hp;
+static struct curl_hash *numhash;
+static int freed;
 static char *data_key;
 static struct Curl_dns_entry *data_node;
 
@@ -68,7 +71,8 @@ static void unit_stop( void )
   if (data_key)
     free(data_key);
 
-  Curl_hash_destroy(hp);
+  Curl_hostcache_destroy(hp);
+  Curl_hash_destroy(numhash);
 
   curl_easy_cleanup(data);
   curl_global_cleanup();
@@ -101,6 +105,37 @@ static Curl_addrinfo *fake_ai(void)
   return ai;
 }
 
+/* the data in 'numhash' are ints from the 'values' array, the destructor
+   only counts the calls */
+static void num_dtor(void *p)
+{
+  (void)p;
+  freed++;
+}
+
+/* a deliberately bad hash function, to check that colliding keys work */
+static size_t num_hash_bad(void *key, size_t key_length, size_t slots_num)
+{
+  (void)key;
+  (void)key_length;
+  (void)slots_num;
+  return 0;
+}
+
+static int is_odd(void *user, void *p)
+{
+  (void)user;
+  return *(int *)p % 2;
+}
+
+/* the entry for a name with port 80 in the DNS cache */
+static struct Curl_dns_entry *pick_dns(const char *name)
+{
+  char key[32];
+  snprintf(key, sizeof(key), "%s:80", name);
+  return Curl_hash_pick(&hp->entries, key, strlen(key) + 1);
+}
+
 static CURLcode create_node(void)
 {
   data_key = aprintf("%s:%d", "dummy", 0);
@@ -130,7 +165,7 @@ UNITTEST_START
     abort_unless(rc == CURLE_OK, "data node creation failed");
     key_len = strlen(data_key);
 
-    nodep = Curl_hash_add(hp, data_key, key_len+1, data_node);
+    nodep = Curl_hash_add(&hp->entries, data_key, key_len+1, data_node);
     abort_unless(nodep, "insertion into hash failed");
     /* Freeing will now be done by Curl_hash_destroy */
     data_node = NULL;
@@ -138,4 +173,159 @@ UNITTEST_START
     /* To do: test retrieval, deletion, edge conditions */
   }
 
+  {
+    /* pruning removes the expired entries that are not in use */
+    static const char *const names[] = { "a", "b", "c", "d" };
+    static const long ages[] = { 100, 90, 10, 0 };
+    struct Curl_dns_entry *dns[4];
+    struct Curl_dns_entry *neg;
+    time_t now;
+    int i;
+
+    data->dns.hostcache = hp;
+    data->set.dns_cache_timeout = 60;
+    data->set.dns_negative_timeout = 30;
+    data->set.dns_serve_stale = 0;
+
+    time(&now);
+    for(i = 0; i < 4; i++) {
+      Curl_addrinfo *ai = fake_ai();
+      abort_unless(ai, "address creation failed");
+      dns[i] = Curl_cache_addr(data, ai, names[i], 80);
+      abort_unless(dns[i], "caching failed");
+      dns[i]->timestamp = now - ages[i];
+    }
+    Curl_cache_negative(data, "e", 80);
+    neg = pick_dns("e");
+    abort_unless(neg && !neg->addr, "negative entry not cached");
+    neg->timestamp = now - 40;
+
+    fail_unless(hp->resolved.oldest == dns[0], "wrong oldest entry");
+    fail_unless(hp->resolved.newest == dns[3], "wrong newest entry");
+    fail_unless(hp->failed.oldest == neg, "negative entry not in its list");
+
+    /* "b" is still used */
+    Curl_resolv_unlock(data, dns[0]);
+    Curl_resolv_unlock(data, dns[2]);
+    Curl_resolv_unlock(data, dns[3]);
+    Curl_hostcache_prune(data);
+
+    fail_unless(!pick_dns("a"), "expired entry not pruned");
+    fail_unless(pick_dns("b") == dns[1], "entry in use pruned");
+    fail_unless(pick_dns("c") == dns[2], "fresh entry pruned");
+    fail_unless(!pick_dns("e"), "expired negative entry not pruned");
+    fail_unless(!hp->failed.oldest, "negative list not empty");
+
+    /* once it is no longer used, the next prune removes it */
+    Curl_resolv_unlock(data, dns[1]);
+    Curl_hostcache_prune(data);
+    fail_unless(!pick_dns("b"), "expired entry not pruned after use");
+    fail_unless(hp->resolved.oldest == dns[2], "wrong oldest after prune");
+    fail_unless(pick_dns("d") == dns[3], "fresh entry pruned");
+
+    data->dns.hostcache = NULL;
+  }
+
+  {
+/* enough entries to make the table grow several times */
+#define NUM_KEYS 1000
+    static int values[NUM_KEYS];
+    char key[32];
+    struct curl_hash_iterator iter;
+    struct curl_hash_element *he;
+    int i;
+    int count;
+    int round;
+
+    for(round = 0; round < 2; round++) {
+      /* the second round has all keys collide */
+      numhash = Curl_hash_alloc(7, round ? num_hash_bad : Curl_hash_str,
+                                Curl_str_key_compare, num_dtor);
+      abort_unless(numhash, "hash creation failed");
+      freed = 0;
+
+      for(i = 0; i < NUM_KEYS; i++) {
+        values[i] = i;
+        snprintf(key, sizeof(key), "host%d:%d", i, 80 + i % 3);
+        abort_unless(Curl_hash_add(numhash, key, strlen(key) + 1,
+                                   &values[i]) == &values[i],
+                     "insertion into hash failed");
+      }
+      fail_unless(numhash->size == NUM_KEYS, "wrong number of entries");
+      fail_unless(numhash->slots >= NUM_KEYS, "table did not grow");
+
+      /* every key can be found again and picks the right data */
+      for(i = 0; i < NUM_KEYS; i++) {
+        snprintf(key, sizeof(key), "host%d:%d", i, 80 + i % 3);
+        fail_unless(Curl_hash_pick(numhash, key, strlen(key) + 1) ==
+                    &values[i], "picked the wrong data");
+      }
+      strcpy(key, "nohost:80");
+      fail_unless(Curl_hash_pick(numhash, key, strlen(key) + 1) == NULL,
+                  "picked a key that was never added");
+
+      /* delete every third entry */
+      for(i = 0; i < NUM_KEYS; i += 3) {
+        snprintf(key, sizeof(key), "host%d:%d", i, 80 + i % 3);
+        fail_unless(Curl_hash_delete(numhash, key, strlen(key) + 1) == 0,
+                    "delete failed");
+        fail_unless(Curl_hash_delete(numhash, key, strlen(key) + 1) != 0,
+                    "deleted twice");
+      }
+      fail_unless(freed == (NUM_KEYS + 2) / 3, "destructor not called");
+
+      /* the others are still there, probe sequences survive deletes */
+      for(i = 0; i < NUM_KEYS; i++) {
+        void *p;
+        snprintf(key, sizeof(key), "host%d:%d", i, 80 + i % 3);
+        p = Curl_hash_pick(numhash, key, strlen(key) + 1);
+        fail_unless(p == ((i % 3) ? &values[i] : NULL),
+                    "wrong data after delete");
+      }
+
+      /* replacing data calls the destructor for the old data */
+      freed = 0;
+      snprintf(key, sizeof(key), "host%d:%d", 1, 81);
+      fail_unless(Curl_hash_add(numhash, key, strlen(key) + 1, &values[0]) ==
+                  &values[0], "replace failed");
+      fail_unless(freed == 1, "destructor not called on replace");
+      fail_unless(Curl_hash_pick(numhash, key, strlen(key) + 1) ==
+                  &values[0], "replaced data not picked");
+      fail_unless(Curl_hash_add(numhash, key, strlen(key) + 1, &values[1]) ==
+                  &values[1], "replace failed");
+
+      /* the iterator visits every entry once */
+      count = 0;
+      Curl_hash_start_iterate(numhash, &iter);
+      for(he = Curl_hash_next_element(&iter); he;
+          he = Curl_hash_next_element(&iter))
+        count++;
+      fail_unless((size_t)count == numhash->size, "iterator count wrong");
+
+      /* remove all odd values */
+      Curl_hash_clean_with_criterium(numhash, NULL, is_odd);
+      Curl_hash_start_iterate(numhash, &iter);
+      for(he = Curl_hash_next_element(&iter); he;
+          he = Curl_hash_next_element(&iter))
+        fail_if(*(int *)he->ptr % 2, "odd value left");
+
+      /* deleting while iterating leaves the other entries */
+      Curl_hash_start_iterate(numhash, &iter);
+      for(he = Curl_hash_next_element(&iter); he;
+          he = Curl_hash_next_element(&iter))
+        Curl_hash_delete(numhash, he->key, he->key_len);
+      fail_unless(numhash->size == 0, "entries left after deleting all");
+
+      /* the table is usable after having been emptied */
+      strcpy(key, "again");
+      fail_unless(Curl_hash_add(numhash, key, strlen(key) + 1, &values[2]) ==
+                  &values[2], "insertion after emptying failed");
+      fail_unless(Curl_hash_pick(numhash, key, strlen(key) + 1) == &values[2],
+                  "pick after emptying failed");
+
+      Curl_hash_destroy(numhash);
+      numhash = NULL;
+    }
+  }
+
 UNITTEST_STOP
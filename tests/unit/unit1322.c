@@ -0,0 +1,155 @@
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 1998 - 2015, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at http://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include "curlcheck.h"
+
+#include "timewheel.h"
+
+static struct Curl_wheel wheel;
+
+static CURLcode unit_setup(void)
+{
+  return CURLE_OK;
+}
+
+static void unit_stop(void)
+{
+
+}
+
+static struct timeval tv_add(struct timeval tv, long ms)
+{
+  tv.tv_sec += ms / 1000;
+  tv.tv_usec += (ms % 1000) * 1000;
+  if(tv.tv_usec >= 1000000) {
+    tv.tv_sec++;
+    tv.tv_usec -= 1000000;
+  }
+  return tv;
+}
+
+static int tv_cmp(struct timeval a, struct timeval b)
+{
+  if(a.tv_sec != b.tv_sec)
+    return (a.tv_sec < b.tv_sec) ? -1 : 1;
+  if(a.tv_usec != b.tv_usec)
+    return (a.tv_usec < b.tv_usec) ? -1 : 1;
+  return 0;
+}
+
+UNITTEST_START
+
+/* number of nodes to add to the wheel */
+#define NUM_NODES 500
+
+  struct Curl_wheel_node nodes[NUM_NODES];
+  int seen[NUM_NODES];
+  struct timeval base;
+  struct timeval now;
+  struct timeval next;
+  struct timeval last;
+  struct Curl_wheel_node *t;
+  int i;
+  int left = 0;
+
+  base.tv_sec = 1000;
+  base.tv_usec = 0;
+  Curl_wheel_init(&wheel, base);
+
+  memset(nodes, 0, sizeof(nodes));
+  memset(seen, 0, sizeof(seen));
+
+  fail_if(Curl_wheel_next(&wheel, &next), "empty wheel has a next time");
+
+  for(i = 0; i < NUM_NODES; i++) {
+    /* spread the nodes over all levels, with some in the same millisecond
+       and some beyond the reach of the wheel */
+    long ms = (long)((541L * i * i) % 3000000);
+    struct timeval key = tv_add(base, ms);
+    key.tv_usec += i % 7;
+    if(i % 50 == 49)
+      key.tv_sec += 100000000;
+
+    nodes[i].payload = &seen[i];
+    Curl_wheel_insert(&wheel, &nodes[i], key);
+    fail_unless(Curl_wheel_queued(&nodes[i]), "inserted node not queued");
+  }
+
+  /* take out every fifth node again */
+  for(i = 0; i < NUM_NODES; i += 5) {
+    Curl_wheel_remove(&wheel, &nodes[i]);
+    fail_if(Curl_wheel_queued(&nodes[i]), "removed node still queued");
+    seen[i] = -1;
+  }
+  /* removing twice is harmless */
+  Curl_wheel_remove(&wheel, &nodes[0]);
+
+  for(i = 0; i < NUM_NODES; i++)
+    if(!seen[i])
+      left++;
+  fail_unless(wheel.count == (size_t)left, "wrong node count");
+
+  /* walk time forward in uneven steps and extract what has expired */
+  now = base;
+  last = base;
+  while(left) {
+    struct timeval earliest;
+    int found = 0;
+
+    abort_unless(Curl_wheel_next(&wheel, &next), "no next time");
+
+    /* the next time must never be later than the millisecond tick the
+       earliest remaining node expires at */
+    for(i = 0; i < NUM_NODES; i++) {
+      if(!seen[i] && (!found || tv_cmp(nodes[i].key, earliest) < 0)) {
+        earliest = nodes[i].key;
+        found = 1;
+      }
+    }
+    fail_unless(tv_cmp(next, tv_add(earliest, 1)) <= 0, "next time too late");
+
+    if(tv_cmp(next, now) > 0)
+      now = next;
+    else
+      now = tv_add(now, 1 + (left % 13));
+
+    while((t = Curl_wheel_getbest(&wheel, now)) != NULL) {
+      int *s = t->payload;
+      fail_unless(tv_cmp(t->key, now) <= 0, "node expired early");
+      fail_unless(*s == 0, "node extracted twice or after removal");
+      /* nodes come in expire order, with millisecond precision */
+      fail_unless(tv_cmp(tv_add(t->key, 1), last) >= 0, "out of order");
+      if(tv_cmp(t->key, last) > 0)
+        last = t->key;
+      *s = 1;
+      left--;
+    }
+  }
+
+  fail_unless(wheel.count == 0, "wheel not empty");
+  fail_if(Curl_wheel_next(&wheel, &next), "empty wheel has a next time");
+
+  /* a node set in the past is due immediately */
+  Curl_wheel_insert(&wheel, &nodes[0], base);
+  fail_unless(Curl_wheel_getbest(&wheel, now) == &nodes[0],
+              "past node not due");
+
+UNITTEST_STOP
@@ -0,0 +1,106 @@
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 1998 - 2015, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at http://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include "curlcheck.h"
+
+#include "arena.h"
+
+static struct Curl_arena arena;
+
+static CURLcode unit_setup(void)
+{
+  Curl_arena_init(&arena);
+  return CURLE_OK;
+}
+
+static void unit_stop(void)
+{
+  Curl_arena_destroy(&arena);
+}
+
+UNITTEST_START
+
+  char big[3000];
+  char expect[64];
+  char *first;
+  char *p;
+  char *q;
+  int i;
+
+  /* allocations are aligned and do not overlap */
+  first = Curl_arena_alloc(&arena, 3);
+  abort_unless(first, "allocation failed");
+  p = Curl_arena_alloc(&arena, 5);
+  abort_unless(p, "allocation failed");
+  fail_unless(((size_t)p % sizeof(void *)) == 0, "allocation not aligned");
+  fail_unless(p >= first + 3, "allocations overlap");
+  fail_unless(arena.allocs == 2, "wrong allocation count");
+
+  p = Curl_arena_strdup(&arena, "Host: example.com\r\n");
+  abort_unless(p, "strdup failed");
+  fail_unless(!strcmp(p, "Host: example.com\r\n"), "strdup copy differs");
+
+  p = Curl_arena_memdup(&arena, "example.com:80", 11);
+  abort_unless(p, "memdup failed");
+  fail_unless(!strcmp(p, "example.com"), "memdup not zero terminated");
+
+  p = Curl_arena_aprintf(&arena, "Range: bytes=%d-%d\r\n", 100, 199);
+  abort_unless(p, "aprintf failed");
+  fail_unless(!strcmp(p, "Range: bytes=100-199\r\n"), "aprintf output");
+
+  /* fill up what is left of the chunk so that printing must move on to a
+     new one, the result must still be complete */
+  for(i = 0; i < CURL_ARENA_CHUNK / 16; i++) {
+    q = Curl_arena_aprintf(&arena, "Referer: http://example.com/%d\r\n", i);
+    abort_unless(q, "aprintf failed");
+    snprintf(expect, sizeof(expect), "Referer: http://example.com/%d\r\n", i);
+    fail_unless(!strcmp(q, expect), "aprintf output cut off");
+  }
+  fail_unless(!strcmp(p, "Range: bytes=100-199\r\n"),
+              "earlier allocation overwritten");
+
+  /* larger than a chunk */
+  memset(big, 'a', sizeof(big) - 1);
+  big[sizeof(big) - 1] = 0;
+  p = Curl_arena_aprintf(&arena, "X-Big: %s\r\n", big);
+  abort_unless(p, "aprintf of a large string failed");
+  fail_unless(strlen(p) == sizeof(big) - 1 + 9, "large string cut off");
+  fail_unless(!strncmp(p + 7, big, sizeof(big) - 1), "large string differs");
+
+  /* the current chunk is still used after the large allocation */
+  q = Curl_arena_strdup(&arena, "after");
+  abort_unless(q, "strdup failed");
+  fail_unless(!strcmp(q, "after"), "strdup copy differs");
+
+  /* a reset makes all memory available again and keeps one chunk */
+  Curl_arena_reset(&arena);
+  fail_unless(arena.allocs == 0, "allocation count not reset");
+  fail_unless(arena.head != NULL, "no chunk kept over reset");
+  first = Curl_arena_alloc(&arena, 3);
+  abort_unless(first, "allocation failed");
+  Curl_arena_reset(&arena);
+  p = Curl_arena_alloc(&arena, 3);
+  fail_unless(p == first, "kept chunk not reused from the start");
+
+  Curl_arena_destroy(&arena);
+  fail_unless(arena.head == NULL, "chunks left after destroy");
+
+UNITTEST_STOP
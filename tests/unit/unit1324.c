@@ -0,0 +1,199 @@
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 1998 - 2015, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at http://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include "curlcheck.h"
+
+#include "splay.h"
+#include "timewheel.h"
+#include "timeval.h"
+
+#include "memdebug.h" /* LAST include file */
+
+/*
+ * Timer queue benchmark: the splay tree the multi handle used to keep its
+ * timers in against the timing wheel that replaced it. Every operation
+ * re-arms the timer of a random handle, and every 64 operations the clock
+ * moves one millisecond ahead, the timers that expired are extracted and
+ * armed again, and the time of the next timer is looked up, much like
+ * curl_multi_socket_action() and curl_multi_timeout() do. The results are
+ * written to stdout; both queues must expire the same number of timers.
+ */
+
+#define NUM_OPS 200000
+#define MAX_TIMEOUT 60000 /* milliseconds ahead a timer is set */
+
+static struct Curl_tree *trees;
+static struct Curl_wheel_node *wnodes;
+static struct Curl_wheel wheel;
+static unsigned int seed;
+
+static CURLcode unit_setup(void)
+{
+  return CURLE_OK;
+}
+
+static void unit_stop(void)
+{
+  Curl_safefree(trees);
+  Curl_safefree(wnodes);
+}
+
+static unsigned int bench_rand(void)
+{
+  seed = seed * 1103515245 + 12345;
+  return (seed >> 8);
+}
+
+static struct timeval tv_add(struct timeval tv, long ms)
+{
+  tv.tv_sec += ms / 1000;
+  tv.tv_usec += (ms % 1000) * 1000;
+  if(tv.tv_usec >= 1000000) {
+    tv.tv_sec++;
+    tv.tv_usec -= 1000000;
+  }
+  return tv;
+}
+
+/* the time an expired timer is armed again at does not depend on the order
+   the timers come out in, so both queues are in the same state */
+static struct timeval rearm_time(struct timeval now, int i)
+{
+  return tv_add(now, 1 + (long)(((unsigned long)i * 7919) % MAX_TIMEOUT));
+}
+
+/* returns the number of expired timers and stores the ns per operation */
+static long bench_splay(int num, struct timeval base, double *nsop)
+{
+  struct Curl_tree *root = NULL;
+  struct Curl_tree *removed;
+  struct timeval now = base;
+  struct timeval zero;
+  struct timeval start;
+  long expired = 0;
+  int op;
+  int i;
+
+  zero.tv_sec = 0;
+  zero.tv_usec = 0;
+  seed = 1;
+  for(i = 0; i < num; i++) {
+    trees[i].payload = &trees[i];
+    root = Curl_splayinsert(tv_add(now, bench_rand() % MAX_TIMEOUT), root,
+                            &trees[i]);
+  }
+
+  start = curlx_tvnow();
+  for(op = 0; op < NUM_OPS; op++) {
+    i = (int)(bench_rand() % num);
+    Curl_splayremovebyaddr(root, &trees[i], &root);
+    root = Curl_splayinsert(tv_add(now, bench_rand() % MAX_TIMEOUT), root,
+                            &trees[i]);
+
+    if((op % 64) == 63) {
+      now = tv_add(now, 1);
+      do {
+        root = Curl_splaygetbest(now, root, &removed);
+        if(removed) {
+          expired++;
+          root = Curl_splayinsert(rearm_time(now, (int)(removed - trees)),
+                                  root, removed);
+        }
+      } while(removed);
+      /* the nearest timer ends up at the root */
+      root = Curl_splay(zero, root);
+    }
+  }
+  *nsop = curlx_tvdiff_secs(curlx_tvnow(), start) * 1e9 / NUM_OPS;
+  return expired;
+}
+
+static long bench_wheel(int num, struct timeval base, double *nsop)
+{
+  struct Curl_wheel_node *t;
+  struct timeval now = base;
+  struct timeval next;
+  struct timeval start;
+  long expired = 0;
+  int op;
+  int i;
+
+  seed = 1;
+  Curl_wheel_init(&wheel, base);
+  for(i = 0; i < num; i++) {
+    wnodes[i].payload = &wnodes[i];
+    Curl_wheel_insert(&wheel, &wnodes[i],
+                      tv_add(now, bench_rand() % MAX_TIMEOUT));
+  }
+
+  start = curlx_tvnow();
+  for(op = 0; op < NUM_OPS; op++) {
+    i = (int)(bench_rand() % num);
+    Curl_wheel_remove(&wheel, &wnodes[i]);
+    Curl_wheel_insert(&wheel, &wnodes[i],
+                      tv_add(now, bench_rand() % MAX_TIMEOUT));
+
+    if((op % 64) == 63) {
+      now = tv_add(now, 1);
+      while((t = Curl_wheel_getbest(&wheel, now)) != NULL) {
+        expired++;
+        Curl_wheel_insert(&wheel, t, rearm_time(now, (int)(t - wnodes)));
+      }
+      (void)Curl_wheel_next(&wheel, &next);
+    }
+  }
+  *nsop = curlx_tvdiff_secs(curlx_tvnow(), start) * 1e9 / NUM_OPS;
+  return expired;
+}
+
+UNITTEST_START
+
+  static const int sizes[] = { 1000, 10000, 100000 };
+  struct timeval base;
+  size_t s;
+
+  base.tv_sec = 1000;
+  base.tv_usec = 0;
+
+  printf("handles     splay        wheel\n");
+  for(s = 0; s < sizeof(sizes)/sizeof(sizes[0]); s++) {
+    int num = sizes[s];
+    double splay_ns;
+    double wheel_ns;
+    long splay_expired;
+    long wheel_expired;
+
+    trees = calloc(num, sizeof(struct Curl_tree));
+    wnodes = calloc(num, sizeof(struct Curl_wheel_node));
+    abort_unless(trees && wnodes, "out of memory");
+
+    splay_expired = bench_splay(num, base, &splay_ns);
+    wheel_expired = bench_wheel(num, base, &wheel_ns);
+    fail_unless(splay_expired == wheel_expired,
+                "the queues expired different timers");
+
+    printf("%-8d %6.0f ns/op  %6.0f ns/op\n", num, splay_ns, wheel_ns);
+
+    Curl_safefree(trees);
+    Curl_safefree(wnodes);
+  }
+
+UNITTEST_STOP